@@ -0,0 +1,60 @@
+/*
+  _elfgen.h - Generator of synthetic ELF images for benchmarks
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_BENCH_INTERNAL_ELFGEN_H
+#define TERMIX_BENCH_INTERNAL_ELFGEN_H
+
+#include <stddef.h>
+
+// name of the generated program in the output directory
+#define TMIXBENCH_PROG_NAME       "prog"
+
+/*
+ * kinds of generated relocations
+ */
+typedef enum {
+    TMIXBENCH_RELOC_RELATIVE = 0,
+    TMIXBENCH_RELOC_GLOB_DAT,
+    TMIXBENCH_RELOC_JUMP_SLOT,  // in the PLT relocation table, bound eagerly since there is no PLT
+    TMIXBENCH_RELOC_ABS,
+    TMIXBENCH_NRELOC_KINDS
+} tmixbench_reloc_kind;
+
+/*
+ * shape of a generated program
+ */
+typedef struct {
+    size_t nsegs;  // loadable segments, at least 3: headers and tables, text and data
+    size_t nneeds;  // libraries generated along, each one exporting its share of symbols
+    size_t nsyms;  // imported symbols, or exported ones by the program itself if no libraries
+    size_t nrelocs;  // relocations, RELATIVE ones included
+    unsigned mix[TMIXBENCH_NRELOC_KINDS];  // weights of each kind of relocations
+    size_t strtab_size;  // minimum size of the string table, padded if names are shorter
+} tmixbench_elfgen;
+
+/*
+ * dir - existing directory to write files to
+ *
+ * generate a PIE program as dir/TMIXBENCH_PROG_NAME, and the libraries it requires
+ * as dir/libtmixbenchN.so, with symbols and relocations shaped as params,
+ * the program is never meant to run, only to be parsed, loaded and linked
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+int _tmixbench_gen_elf(const tmixbench_elfgen *params, const char *dir);
+
+#endif /* TERMIX_BENCH_INTERNAL_ELFGEN_H */
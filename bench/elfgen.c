@@ -0,0 +1,532 @@
+/*
+  elfgen.c - Generator of synthetic ELF images for benchmarks
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE  // for asprintf
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../inc/paths.h"
+#include "../ldr/elf/_arch.h"
+#include "../ldr/elf/elf.h"
+
+#include "_elfgen.h"
+
+#if defined(__x86_64__)
+#  define _MACHINE                (EM_X86_64)
+#elif defined(__aarch64__)
+#  define _MACHINE                (EM_AARCH64)
+#elif defined(__i386__)
+#  define _MACHINE                (EM_386)
+#elif defined(__arm__)
+#  define _MACHINE                (EM_ARM)
+#else
+#  error Dont know ELF machine on this platform yet
+#endif
+
+#ifdef TMIX64
+#  define _R_INFO(_sym, _type)    (((uint64_t) (_sym) << 32) | (_type))
+#  define _ELFCLASS               (ELFCLASS64)
+#else
+#  define _R_INFO(_sym, _type)    (((_sym) << 8) | ((_type) & 0xff))
+#  define _ELFCLASS               (ELFCLASS32)
+#endif
+
+#define _ST_INFO(_bind, _type)    (((_bind) << 4) | ((_type) & 0xf))
+
+#define _ALIGN(_x, _a)            (((_x) + (_a) - 1) & ~(size_t) ((_a) - 1))
+
+// extra segment headers besides loadable ones: PT_DYNAMIC, PT_GNU_RELRO and PT_GNU_STACK
+#define _EXTRA_PHDRS              (3)
+
+/*
+ * one image to write
+ */
+typedef struct {
+    const char *soname;  // NULL for the program
+    const char *const *needs;  // array
+    size_t nneeds;
+    const char *const *names;  // array, names of symbols
+    size_t nsyms;
+    bool exported;  // whether symbols are defined by the image, otherwise imported
+    size_t nsegs;
+    size_t counts[TMIXBENCH_NRELOC_KINDS];  // relocations of each kind
+    size_t strtab_size;
+} __image;
+
+/*
+ * C++-style mangled names, long and sharing prefixes like real ones
+ *
+ * returns the size of the name written to buff, the terminator included
+ */
+static size_t __make_name(char *buff, size_t size, size_t i) {
+    static const char *const ns[] = {"4core", "6detail", "7widgets", "5utils"};
+    static const char *const fn[] = {"6updateEv", "4drawERKNS_6CanvasE", "5parseEPKcm", "3getEi"};
+
+    return snprintf(buff, size, "_ZN4tmix%sClass%zuE%s", ns[i % 4], i, fn[(i / 4) % 4]) + 1;
+}
+
+/*
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __write_file(const char *path, const void *buff, size_t size) {
+    FILE *fp = fopen(path, "wb");
+
+    if (!fp)
+        return -1;
+
+    size_t written = fwrite(buff, 1, size, fp);
+    int saved_errno = errno;
+
+    if (fclose(fp) || written != size) {
+        if (written != size)
+            errno = saved_errno;
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * write im to path, layout of sections follows the one of linkers: tables in the first segment,
+ * text and read-only data in the middle, dynamic section and relocated slots in the last one
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __write_image(const char *path, const __image *im) {
+    size_t pagesize = sysconf(_SC_PAGESIZE);
+    size_t nsegs = im->nsegs < 3 ? 3 : im->nsegs;
+    size_t i, k;
+
+    // string table: needs, soname, then names of symbols
+
+    size_t strsz = 1;
+
+    for (i = 0; i < im->nneeds; i++)
+        strsz += strlen(im->needs[i]) + 1;
+
+    if (im->soname)
+        strsz += strlen(im->soname) + 1;
+
+    for (i = 0; i < im->nsyms; i++)
+        strsz += strlen(im->names[i]) + 1;
+
+    if (strsz < im->strtab_size)
+        strsz = im->strtab_size;
+
+    // hash table, exported symbols are sorted by bucket as linkers do,
+    // only the header is there if all symbols are imported
+
+    size_t nbuckets = 1;
+    size_t bloom_size = 1;
+    size_t nchain = 0;
+
+    if (im->exported && im->nsyms) {
+        nbuckets = im->nsyms / 4 + 1;
+        nchain = im->nsyms;
+
+        while (bloom_size * sizeof(size_t) * CHAR_BIT < 8 * im->nsyms)
+            bloom_size <<= 1;
+    }
+
+    size_t nrelatives = im->counts[TMIXBENCH_RELOC_RELATIVE];
+    size_t nrela = nrelatives + im->counts[TMIXBENCH_RELOC_GLOB_DAT] + im->counts[TMIXBENCH_RELOC_ABS];
+    size_t nplt = im->counts[TMIXBENCH_RELOC_JUMP_SLOT];
+    size_t nslots = nrela + nplt;
+
+    // the first segment
+
+    size_t phoff = sizeof(_ElfXX_Ehdr);
+    size_t nphdrs = nsegs + _EXTRA_PHDRS;
+    size_t symtab_off = _ALIGN(phoff + nphdrs * sizeof(_ElfXX_Phdr), sizeof(size_t));
+    size_t strtab_off = symtab_off + (im->nsyms + 1) * sizeof(_ElfXX_Sym);
+    size_t hash_off = _ALIGN(strtab_off + strsz, sizeof(size_t));
+    size_t rela_off = _ALIGN(hash_off + sizeof(Elf_GNU_Hash_Header) + bloom_size * sizeof(_ElfXX_Addr)
+                             + nbuckets * sizeof(Elf32_Word) + nchain * sizeof(Elf32_Word), sizeof(size_t));
+    size_t plt_off = rela_off + nrela * sizeof(_ElfXX_Rela);
+    size_t tables_end = plt_off + nplt * sizeof(_ElfXX_Rela);
+
+    // text and read-only data take a page each, then the last segment
+
+    size_t text_off = _ALIGN(tables_end, pagesize);
+    size_t dyn_off = text_off + (nsegs - 2) * pagesize;
+    size_t ndyn = im->nneeds + (im->soname ? 1 : 0) + 6 + (nrela ? 4 : 0) + (nplt ? 3 : 0);
+    size_t data_off = _ALIGN(dyn_off + ndyn * sizeof(_ElfXX_Dyn), pagesize);
+    size_t size = data_off + (nslots ? nslots : 1) * sizeof(_ElfXX_Addr);
+
+    char *buff = calloc(1, size);
+    uint32_t *hashes = NULL;
+    uint32_t *order = NULL;
+    size_t *name_offs = calloc(im->nsyms + 1, sizeof(size_t));
+    int ret = -1;
+
+    if (!buff || !name_offs)
+        goto exit;
+
+    // strings
+
+    char *strtab = buff + strtab_off;
+    size_t str_used = 1;
+    size_t needs_off = str_used;
+
+    for (i = 0; i < im->nneeds; i++)
+        str_used += sprintf(strtab + str_used, "%s", im->needs[i]) + 1;
+
+    size_t soname_off = str_used;
+
+    if (im->soname)
+        str_used += sprintf(strtab + str_used, "%s", im->soname) + 1;
+
+    for (i = 0; i < im->nsyms; i++) {
+        name_offs[i] = str_used;
+        str_used += sprintf(strtab + str_used, "%s", im->names[i]) + 1;
+    }
+
+    // padding is left zero, strings of nothing
+
+    // symbols, in the order of buckets if exported
+
+    Elf_GNU_Hash_Header *hdr = (Elf_GNU_Hash_Header *) (buff + hash_off);
+    size_t *bloom = (size_t *) (hdr + 1);
+    Elf32_Word *buckets = (Elf32_Word *) (bloom + bloom_size);
+    Elf32_Word *chain = buckets + nbuckets;
+
+    hdr->nbuckets = nbuckets;
+    hdr->bloom_size = bloom_size;
+    hdr->bloom_shift = 10;
+    hdr->symoffset = im->exported ? 1 : im->nsyms + 1;
+
+    if (!(order = calloc(im->nsyms + 1, sizeof(uint32_t))))
+        goto exit;
+
+    for (i = 0; i < im->nsyms; i++)
+        order[i] = i;
+
+    if (nchain) {
+        if (!(hashes = calloc(im->nsyms, sizeof(uint32_t))))
+            goto exit;
+
+        tmixelf_gnu_hash_batch((const char *const *) im->names, im->nsyms, hashes);
+
+        // counting sort by bucket, buckets temporarily hold the end of each bucket
+
+        for (i = 0; i < im->nsyms; i++)
+            buckets[hashes[i] % nbuckets]++;
+
+        for (k = 1; k < nbuckets; k++)
+            buckets[k] += buckets[k - 1];
+
+        for (i = im->nsyms; i--;)
+            order[--buckets[hashes[i] % nbuckets]] = i;
+
+        memset(buckets, 0, nbuckets * sizeof(Elf32_Word));
+
+        for (k = 0; k < im->nsyms; k++) {
+            uint32_t hash = hashes[order[k]];
+            size_t bits = sizeof(size_t) * CHAR_BIT;
+
+            if (!buckets[hash % nbuckets])
+                buckets[hash % nbuckets] = k + 1;
+            else
+                chain[k - 1] &= ~1u;  // not the end of chain anymore
+
+            chain[k] = hash | 1;
+            bloom[(hash / bits) % bloom_size] |= ((size_t) 1 << (hash % bits))
+                                                 | ((size_t) 1 << ((hash >> 10) % bits));
+        }
+    }
+
+    _ElfXX_Sym *syms = (_ElfXX_Sym *) (buff + symtab_off);
+
+    for (k = 0; k < im->nsyms; k++) {
+        _ElfXX_Sym *sym = &syms[k + 1];
+
+        sym->st_name = name_offs[order[k]];
+        sym->st_info = _ST_INFO(STB_GLOBAL, STT_FUNC);
+
+        if (im->exported) {
+            sym->st_shndx = 1;  // any section but SHN_UNDEF
+            sym->st_value = text_off + (k * 16) % pagesize;
+            sym->st_size = 16;
+        }
+    }
+
+    // relocations: RELATIVE ones first as counted by DT_RELACOUNT, each one has its own slot,
+    // symbols are referred in turn
+
+    _ElfXX_Rela *relas = (_ElfXX_Rela *) (buff + rela_off);
+    size_t slot = 0;
+    size_t symidx = 0;
+
+    static const tmixbench_reloc_kind kinds[] = {
+        TMIXBENCH_RELOC_RELATIVE, TMIXBENCH_RELOC_GLOB_DAT, TMIXBENCH_RELOC_ABS, TMIXBENCH_RELOC_JUMP_SLOT,
+    };
+    static const unsigned types[] = {
+        [TMIXBENCH_RELOC_RELATIVE] = _R_ARCH_RELATIVE,
+        [TMIXBENCH_RELOC_GLOB_DAT] = _R_ARCH_GLOB_DAT,
+        [TMIXBENCH_RELOC_JUMP_SLOT] = _R_ARCH_JUMP_SLOT,
+        [TMIXBENCH_RELOC_ABS] = _R_ARCH_ABS,
+    };
+
+    for (k = 0; k < sizeof(kinds) / sizeof(*kinds); k++) {
+        tmixbench_reloc_kind kind = kinds[k];
+
+        for (i = 0; i < im->counts[kind]; i++, slot++) {
+            _ElfXX_Rela *rela = &relas[slot];  // PLT ones follow the others
+
+            rela->r_offset = data_off + slot * sizeof(_ElfXX_Addr);
+
+            if (kind == TMIXBENCH_RELOC_RELATIVE) {
+                rela->r_info = _R_INFO(0, types[kind]);
+                rela->r_addend = text_off + (slot * 16) % pagesize;
+            } else {
+                rela->r_info = _R_INFO(symidx % im->nsyms + 1, types[kind]);
+                rela->r_addend = kind == TMIXBENCH_RELOC_ABS ? 8 : 0;
+                symidx++;
+            }
+        }
+    }
+
+    // dynamic section
+
+    _ElfXX_Dyn *dyns = (_ElfXX_Dyn *) (buff + dyn_off);
+    size_t d = 0;
+
+#define _DYN(_tag, _val)  do {                                                  \
+                              dyns[d].d_tag = (_tag);                           \
+                              dyns[d].d_un.d_val = (_val);                      \
+                              d++;                                              \
+                          } while (0)
+
+    for (i = 0; i < im->nneeds; i++) {
+        _DYN(DT_NEEDED, needs_off);
+        needs_off += strlen(im->needs[i]) + 1;
+    }
+
+    if (im->soname)
+        _DYN(DT_SONAME, soname_off);
+
+    _DYN(DT_GNU_HASH, hash_off);
+    _DYN(DT_STRTAB, strtab_off);
+    _DYN(DT_STRSZ, strsz);
+    _DYN(DT_SYMTAB, symtab_off);
+    _DYN(DT_SYMENT, sizeof(_ElfXX_Sym));
+
+    if (nrela) {
+        _DYN(DT_RELA, rela_off);
+        _DYN(DT_RELASZ, nrela * sizeof(_ElfXX_Rela));
+        _DYN(DT_RELAENT, sizeof(_ElfXX_Rela));
+        _DYN(DT_RELACOUNT, nrelatives);
+    }
+
+    // no DT_PLTGOT, so nothing is bound lazily
+    if (nplt) {
+        _DYN(DT_JMPREL, plt_off);
+        _DYN(DT_PLTRELSZ, nplt * sizeof(_ElfXX_Rela));
+        _DYN(DT_PLTREL, DT_RELA);
+    }
+
+    _DYN(DT_NULL, 0);
+
+#undef _DYN
+
+    // segment headers
+
+    _ElfXX_Phdr *phdrs = (_ElfXX_Phdr *) (buff + phoff);
+    size_t p = 0;
+
+    phdrs[p++] = (_ElfXX_Phdr) {
+        .p_type = PT_LOAD, .p_flags = PF_R, .p_offset = 0, .p_vaddr = 0,
+        .p_filesz = tables_end, .p_memsz = tables_end, .p_align = pagesize,
+    };
+
+    for (k = 0; k < nsegs - 2; k++) {
+        size_t off = text_off + k * pagesize;
+
+        // text and read-only data in turn
+        phdrs[p++] = (_ElfXX_Phdr) {
+            .p_type = PT_LOAD, .p_flags = k % 2 ? PF_R : PF_R | PF_X, .p_offset = off, .p_vaddr = off,
+            .p_filesz = pagesize, .p_memsz = pagesize, .p_align = pagesize,
+        };
+    }
+
+    phdrs[p++] = (_ElfXX_Phdr) {
+        .p_type = PT_LOAD, .p_flags = PF_R | PF_W, .p_offset = dyn_off, .p_vaddr = dyn_off,
+        .p_filesz = size - dyn_off, .p_memsz = size - dyn_off, .p_align = pagesize,
+    };
+    phdrs[p++] = (_ElfXX_Phdr) {
+        .p_type = PT_DYNAMIC, .p_flags = PF_R | PF_W, .p_offset = dyn_off, .p_vaddr = dyn_off,
+        .p_filesz = d * sizeof(_ElfXX_Dyn), .p_memsz = d * sizeof(_ElfXX_Dyn), .p_align = sizeof(size_t),
+    };
+    phdrs[p++] = (_ElfXX_Phdr) {
+        .p_type = PT_GNU_RELRO, .p_flags = PF_R, .p_offset = dyn_off, .p_vaddr = dyn_off,
+        .p_filesz = data_off - dyn_off, .p_memsz = data_off - dyn_off, .p_align = 1,
+    };
+    phdrs[p++] = (_ElfXX_Phdr) {
+        .p_type = PT_GNU_STACK, .p_flags = PF_R | PF_W, .p_align = 16,
+    };
+
+    // finally the header
+
+    _ElfXX_Ehdr *ehdr = (_ElfXX_Ehdr *) buff;
+
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = _ELFCLASS;
+#ifdef TMIX_BIG_ENDIAN
+    ehdr->e_ident[EI_DATA] = ELFDATA2MSB;
+#else
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+#endif
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = _MACHINE;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_entry = text_off;
+    ehdr->e_phoff = phoff;
+    ehdr->e_ehsize = sizeof(_ElfXX_Ehdr);
+    ehdr->e_phentsize = sizeof(_ElfXX_Phdr);
+    ehdr->e_phnum = p;
+
+    ret = __write_file(path, buff, size);
+
+exit:
+    ;  // dummy statement after jump label to make compiler happy
+
+    int saved_errno = errno;
+
+    free(buff);
+    free(hashes);
+    free(order);
+    free(name_offs);
+    errno = saved_errno;
+
+    return ret;
+}
+
+int _tmixbench_gen_elf(const tmixbench_elfgen *params, const char *dir) {
+    size_t nsyms = params->nsyms;
+    size_t nneeds = params->nneeds;
+    char *names_buff = malloc(nsyms * 64 + 1);
+    const char **names = calloc(nsyms + 1, sizeof(char *));
+    const char **lib_names = calloc(nsyms + 1, sizeof(char *));
+    char **needs = calloc(nneeds + 1, sizeof(char *));
+    char *path = NULL;
+    size_t used = 0;
+    size_t i, k;
+    int ret = -1;
+
+    if (!names_buff || !names || !lib_names || !needs)
+        goto exit;
+
+    for (i = 0; i < nsyms; i++) {
+        names[i] = &names_buff[used];
+        used += __make_name(&names_buff[used], nsyms * 64 + 1 - used, i);
+    }
+
+    // libraries export symbols in turn
+
+    for (k = 0; k < nneeds; k++) {
+        size_t n = 0;
+
+        if (asprintf(&needs[k], "libtmixbench%zu.so", k) < 0) {
+            needs[k] = NULL;
+            goto exit;
+        }
+
+        for (i = k; i < nsyms; i += nneeds)
+            lib_names[n++] = names[i];
+
+        __image lib = {
+            .soname = needs[k],
+            .names = lib_names,
+            .nsyms = n,
+            .exported = true,
+            .nsegs = 3,
+        };
+
+        if (!(path = _tmix_join_path(dir, needs[k])) || __write_image(path, &lib) < 0)
+            goto exit;
+
+        free(path);
+        path = NULL;
+    }
+
+    // then the program, relocations are split by weights, the remainder goes to the first kind
+
+    __image prog = {
+        .needs = (const char *const *) needs,
+        .nneeds = nneeds,
+        .names = names,
+        .nsyms = nsyms,
+        .exported = !nneeds,
+        .nsegs = params->nsegs,
+        .strtab_size = params->strtab_size,
+    };
+    unsigned total = 0;
+
+    for (k = 0; k < TMIXBENCH_NRELOC_KINDS; k++) {
+        // relocations need symbols to refer to, except RELATIVE ones
+        if (nsyms || k == TMIXBENCH_RELOC_RELATIVE)
+            total += params->mix[k];
+    }
+
+    size_t assigned = 0;
+
+    for (k = 0; k < TMIXBENCH_NRELOC_KINDS && total; k++) {
+        if (nsyms || k == TMIXBENCH_RELOC_RELATIVE) {
+            prog.counts[k] = (size_t) ((unsigned long long) params->nrelocs * params->mix[k] / total);
+            assigned += prog.counts[k];
+        }
+    }
+
+    for (k = 0; k < TMIXBENCH_NRELOC_KINDS; k++) {
+        if ((nsyms || k == TMIXBENCH_RELOC_RELATIVE) && (!total || params->mix[k])) {
+            prog.counts[k] += params->nrelocs - assigned;
+            break;
+        }
+    }
+
+    if (!(path = _tmix_join_path(dir, TMIXBENCH_PROG_NAME)) || __write_image(path, &prog) < 0)
+        goto exit;
+
+    ret = 0;
+
+exit:
+    ;  // dummy statement after jump label to make compiler happy
+
+    int saved_errno = errno;
+
+    for (k = 0; k < nneeds && needs; k++)
+        free(needs[k]);
+
+    free(needs);
+    free(path);
+    free(lib_names);
+    free(names);
+    free(names_buff);
+    errno = saved_errno;
+
+    return ret;
+}
@@ -0,0 +1,319 @@
+/*
+  hash_bench.c - Benchmark of symbol hashing and lookup
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../ldr/elf/elf.h"
+
+// times each benchmark is repeated, the best one is reported
+#define _ROUNDS                   (20)
+
+/*
+ * synthetic image: an exporting library with a GNU hash table,
+ * and the imported symbols of a guest looking it up
+ */
+typedef struct {
+    char *names;  // storage of all names
+    tmixelf_info lib;
+    tmixelf_sym *exports;  // lib.syms.data
+    tmixelf_sym *imports;  // half of them are exported by lib
+    const char **import_names;
+    size_t n;
+    size_t *bloom;
+    uint32_t *buckets;
+    uint32_t *chain;
+} __image;
+
+static double __now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void __update_best(double *best, double hash, double lookup) {
+    if (hash < best[0])
+        best[0] = hash;
+
+    if (lookup < best[1])
+        best[1] = lookup;
+}
+
+/*
+ * C++-style mangled names, long and sharing prefixes like real ones
+ */
+static size_t __make_name(char *buff, size_t size, size_t i, bool exported) {
+    static const char *const ns[] = {"4core", "6detail", "7widgets", "5utils"};
+    static const char *const fn[] = {"6updateEv", "4drawERKNS_6CanvasE", "5parseEPKcm", "3getEi"};
+
+    return snprintf(buff, size, "_ZN4tmix%s%zuClass%zu%sE%s",
+                    ns[i % 4], strlen(ns[(i / 4) % 4]), i, exported ? "" : "Missing", fn[(i / 16) % 4]) + 1;
+}
+
+static int __build(__image *im, size_t n) {
+    size_t i;
+
+    memset(im, 0, sizeof(*im));
+    im->n = n;
+
+    // names of exported symbols, then names missing from the library
+
+    size_t cap = 2 * n * 128;
+    size_t used = 0;
+    size_t j;
+
+    im->names = malloc(cap);
+    im->exports = calloc(n + 1, sizeof(tmixelf_sym));
+    im->imports = calloc(n, sizeof(tmixelf_sym));
+    im->import_names = calloc(n, sizeof(char *));
+
+    if (!im->names || !im->exports || !im->imports || !im->import_names)
+        return -1;
+
+    char **export_names = calloc(n, sizeof(char *));
+    uint32_t *hashes = calloc(n, sizeof(uint32_t));
+
+    if (!export_names || !hashes) {
+        free(export_names);
+        free(hashes);
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        export_names[i] = &im->names[used];
+        used += __make_name(&im->names[used], cap - used, i, true);
+        hashes[i] = tmixelf_gnu_hash(export_names[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (i % 2) {
+            im->import_names[i] = &im->names[used];
+            used += __make_name(&im->names[used], cap - used, i, false);
+        } else {
+            im->import_names[i] = export_names[(i * 7) % n];
+        }
+
+        im->imports[i].name = im->import_names[i];
+        im->imports[i].imported = true;
+    }
+
+    // hash table in the same layout emitted by linkers: symbols sorted by bucket
+
+    uint32_t nbuckets = n / 4 + 1;
+    uint32_t bloom_size = 1;
+
+    while (bloom_size * sizeof(size_t) * CHAR_BIT < 8 * n)
+        bloom_size <<= 1;
+
+    im->bloom = calloc(bloom_size, sizeof(size_t));
+    im->buckets = calloc(nbuckets, sizeof(uint32_t));
+    im->chain = calloc(n, sizeof(uint32_t));
+
+    if (!im->bloom || !im->buckets || !im->chain) {
+        free(export_names);
+        free(hashes);
+        return -1;
+    }
+
+    // counting sort by bucket, buckets temporarily hold the end of each bucket
+
+    uint32_t *order = calloc(n, sizeof(uint32_t));
+
+    if (!order) {
+        free(export_names);
+        free(hashes);
+        return -1;
+    }
+
+    uint32_t b;
+
+    for (i = 0; i < n; i++)
+        im->buckets[hashes[i] % nbuckets]++;
+
+    for (b = 1; b < nbuckets; b++)
+        im->buckets[b] += im->buckets[b - 1];
+
+    for (i = n; i--;)
+        order[--im->buckets[hashes[i] % nbuckets]] = i;
+
+    memset(im->buckets, 0, nbuckets * sizeof(uint32_t));
+
+    for (j = 0; j < n; j++) {
+        i = order[j];
+        b = hashes[i] % nbuckets;
+
+        if (!im->buckets[b])
+            im->buckets[b] = j + 1;
+        else
+            im->chain[j - 1] &= ~1u;  // not the end of chain anymore
+
+        im->exports[j + 1].name = export_names[i];
+        im->exports[j + 1].type = TMIXELF_SYM_FUNC;
+        im->exports[j + 1].off = 0x1000 + i * 16;
+        im->chain[j] = hashes[i] | 1;
+    }
+
+    free(order);
+
+    for (i = 0; i < n; i++) {
+        size_t bits = sizeof(size_t) * CHAR_BIT;
+
+        im->bloom[(hashes[i] / bits) % bloom_size] |= ((size_t) 1 << (hashes[i] % bits))
+                                                      | ((size_t) 1 << ((hashes[i] >> 10) % bits));
+    }
+
+    free(export_names);
+    free(hashes);
+
+    im->lib.syms.data = im->exports;
+    im->lib.syms.size = n + 1;
+    im->lib.hashtab.nbuckets = nbuckets;
+    im->lib.hashtab.symoffset = 1;
+    im->lib.hashtab.bloom_size = bloom_size;
+    im->lib.hashtab.bloom_shift = 10;
+    im->lib.hashtab.bloom = im->bloom;
+    im->lib.hashtab.buckets = im->buckets;
+    im->lib.hashtab.chain = im->chain;
+
+    return 0;
+}
+
+static void __destroy(__image *im) {
+    free(im->names);
+    free(im->exports);
+    free(im->imports);
+    free(im->import_names);
+    free(im->bloom);
+    free(im->buckets);
+    free(im->chain);
+}
+
+static int __run(size_t n) {
+    __image im;
+
+    if (__build(&im, n) < 0) {
+        perror("error building synthetic image");
+        __destroy(&im);
+        return -1;
+    }
+
+    uint32_t *hashes = calloc(n, sizeof(uint32_t));
+    const tmixelf_sym **res = calloc(n, sizeof(tmixelf_sym *));
+    const tmixelf_sym **res_batch = calloc(n, sizeof(tmixelf_sym *));
+    double best[2][2] = {{1e9, 1e9}, {1e9, 1e9}};  // [scalar, batch][hash, lookup]
+    size_t found = 0, found_batch = 0;
+    size_t r, i;
+    int ret = -1;
+
+    if (!hashes || !res || !res_batch) {
+        perror("error allocating buffers");
+        goto exit;
+    }
+
+    for (r = 0; r < _ROUNDS; r++) {
+        // one symbol at a time
+        double t0 = __now();
+
+        for (i = 0; i < n; i++)
+            im.imports[i].hash = tmixelf_gnu_hash(im.import_names[i]);
+
+        double t1 = __now();
+
+        found = 0;
+
+        for (i = 0; i < n; i++) {
+            res[i] = tmixelf_lookup_sym(&im.lib, im.imports[i].name, im.imports[i].hash);
+            found += !!res[i];
+        }
+
+        double t2 = __now();
+
+        __update_best(best[0], t1 - t0, t2 - t1);
+
+        // the whole image at once
+        t0 = __now();
+
+        tmixelf_gnu_hash_batch(im.import_names, n, hashes);
+
+        for (i = 0; i < n; i++)
+            im.imports[i].hash = hashes[i];
+
+        t1 = __now();
+
+        found_batch = tmixelf_lookup_syms(&im.lib, im.imports, n, res_batch);
+
+        t2 = __now();
+
+        __update_best(best[1], t1 - t0, t2 - t1);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (hashes[i] != tmixelf_gnu_hash(im.import_names[i])) {
+            fprintf(stderr, "batch hash mismatch for %s\n", im.import_names[i]);
+            goto exit;
+        }
+    }
+
+    if (found != n / 2 + n % 2 || found_batch != found || memcmp(res, res_batch, n * sizeof(*res))) {
+        fprintf(stderr, "batch results mismatch for %zu symbols\n", n);
+        goto exit;
+    }
+
+    printf("%zu symbols, %s kernels\n", n, tmixelf_simd_name());
+    printf("  hash:   scalar %9.1f us, batch %9.1f us, speedup %.2fx\n",
+           best[0][0] * 1e6, best[1][0] * 1e6, best[0][0] / best[1][0]);
+    printf("  lookup: scalar %9.1f us, batch %9.1f us, speedup %.2fx\n",
+           best[0][1] * 1e6, best[1][1] * 1e6, best[0][1] / best[1][1]);
+    printf("  total:  scalar %9.1f us, batch %9.1f us, speedup %.2fx\n",
+           (best[0][0] + best[0][1]) * 1e6, (best[1][0] + best[1][1]) * 1e6,
+           (best[0][0] + best[0][1]) / (best[1][0] + best[1][1]));
+
+    ret = 0;
+
+exit:
+    free(hashes);
+    free(res);
+    free(res_batch);
+    __destroy(&im);
+
+    return ret;
+}
+
+/*
+ * entrypoint
+ */
+int main(int argc, char **argv) {
+    static const size_t counts[] = {10000, 100000};
+    size_t i;
+
+    if (argc > 1)
+        return __run(strtoul(argv[1], NULL, 0)) < 0 ? 1 : 0;
+
+    for (i = 0; i < sizeof(counts) / sizeof(*counts); i++) {
+        if (__run(counts[i]) < 0)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,556 @@
+/*
+  ldr_bench.c - Benchmark of parsing, loading and linking synthetic images
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../inc/paths.h"
+#include "../ldr/dynld.h"
+#include "../ldr/elf/elf.h"
+#include "../ldr/load.h"
+
+#include "_elfgen.h"
+
+// slope on a log-log scale above which a step of a sweep is flagged, 1 is linear
+#define _SUPERLINEAR_SLOPE        (1.25)
+// steps faster than this are too noisy to be flagged
+#define _NOISE_FLOOR_NS           (20000)
+
+typedef enum {
+    __PARSE = 0,  // tmixelf_parse_info
+    __LOAD,  // tmixldr_load_elf
+    __LINK,  // tmixdynld_handle_elf, libraries loaded and linked as well
+    __NPHASES
+} __phase;
+
+typedef struct {
+    uint64_t min, p50, p90, p99, max;  // in ns
+} __stats;
+
+/*
+ * a sweep scales one parameter by a factor in each step, from is a shape the rest are taken from
+ */
+typedef struct {
+    const char *name;
+    size_t field;  // offset in tmixbench_elfgen
+    bool tie_relocs;  // whether relocations are scaled with the field, one per symbol
+    size_t from, to, factor;
+    tmixbench_elfgen base;
+} __sweep;
+
+static const char *const __phase_names[__NPHASES] = {"parse", "load", "link"};
+
+static const __sweep __sweeps[] = {
+    {"syms", offsetof(tmixbench_elfgen, nsyms), true, 1000, 1000000, 10,
+     {.nsegs = 3, .nneeds = 4, .mix = {0, 2, 1, 1}}},
+    {"relocs", offsetof(tmixbench_elfgen, nrelocs), false, 1000, 1000000, 10,
+     {.nsegs = 3, .nneeds = 4, .nsyms = 1000, .mix = {6, 2, 1, 1}}},
+    {"needs", offsetof(tmixbench_elfgen, nneeds), false, 1, 64, 4,
+     {.nsegs = 3, .nsyms = 10000, .nrelocs = 10000, .mix = {0, 2, 1, 1}}},
+    {"segs", offsetof(tmixbench_elfgen, nsegs), false, 3, 192, 4,
+     {.nneeds = 1, .nsyms = 1000, .nrelocs = 1000, .mix = {6, 2, 1, 1}}},
+    {"strtab", offsetof(tmixbench_elfgen, strtab_size), false, 65536, 64 << 20, 8,
+     {.nsegs = 3, .nneeds = 1, .nsyms = 1000, .nrelocs = 1000, .mix = {6, 2, 1, 1}}},
+};
+
+static size_t __warmup = 2;
+static size_t __reps = 10;
+
+static uint64_t __now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int __cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * nearest-rank percentiles of n samples, sorted in place
+ */
+static void __summarize(uint64_t *samples, size_t n, __stats *st) {
+    qsort(samples, n, sizeof(uint64_t), __cmp_u64);
+
+    st->min = samples[0];
+    st->p50 = samples[(n * 50 + 99) / 100 - 1];
+    st->p90 = samples[(n * 90 + 99) / 100 - 1];
+    st->p99 = samples[(n * 99 + 99) / 100 - 1];
+    st->max = samples[n - 1];
+}
+
+/*
+ * run a phase on the program at path, linking is done in a forked process,
+ * since libraries and remembered symbols are process-wide
+ *
+ * returns the time taken in ns, otherwise -1 and prints the error
+ */
+static int64_t __measure(const char *path, __phase phase) {
+    int pipefd[2] = {-1, -1};
+    pid_t pid = 0;
+
+    if (phase == __LINK) {
+        if (pipe(pipefd) < 0) {
+            perror("error creating pipe");
+            return -1;
+        }
+
+        if ((pid = fork()) < 0) {
+            perror("error forking");
+            close(pipefd[0]);
+            close(pipefd[1]);
+
+            return -1;
+        }
+
+        if (pid) {
+            // parent, waits for the result
+
+            int64_t ns = -1;
+            int status;
+
+            close(pipefd[1]);
+
+            if (read(pipefd[0], &ns, sizeof(ns)) != sizeof(ns))
+                ns = -1;
+
+            close(pipefd[0]);
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR);
+
+            return ns;
+        }
+
+        close(pipefd[0]);
+    }
+
+    int fd = open(path, O_RDONLY);
+    tmixelf_info ei = {};
+    tmixldr_elf e = {};
+    int64_t ns = -1;
+    uint64_t t0 = 0;
+
+    if (fd < 0) {
+        perror("error opening generated program");
+        goto exit;
+    }
+
+    if (phase == __PARSE)
+        t0 = __now_ns();
+
+    if (tmixelf_parse_info(fd, &ei) < 0) {
+        perror("error parsing generated program");
+        goto exit;
+    }
+
+    if (phase == __PARSE) {
+        ns = __now_ns() - t0;
+        goto exit;
+    }
+
+    if (phase == __LOAD)
+        t0 = __now_ns();
+
+    if (tmixldr_load_elf(fd, &ei, &e) < 0) {
+        perror("error loading generated program");
+        goto exit;
+    }
+
+    if (phase == __LOAD) {
+        ns = __now_ns() - t0;
+        goto exit;
+    }
+
+    t0 = __now_ns();
+
+    if (tmixdynld_handle_elf(e.base, &ei) < 0) {
+        perror("error linking generated program");
+        goto exit;
+    }
+
+    ns = __now_ns() - t0;
+
+exit:
+    if (phase == __LINK) {
+        if (write(pipefd[1], &ns, sizeof(ns)) != sizeof(ns))
+            _exit(EXIT_FAILURE);
+
+        _exit(EXIT_SUCCESS);
+    }
+
+    if (e.base)
+        tmixldr_unload_elf(&e, &ei);
+
+    tmixelf_free_info(&ei);
+
+    if (fd >= 0)
+        close(fd);
+
+    return ns;
+}
+
+/*
+ * returns 0 if succeed, otherwise -1
+ */
+static int __bench(const char *path, __phase phase, __stats *st) {
+    uint64_t *samples = calloc(__reps, sizeof(uint64_t));
+    size_t i;
+
+    if (!samples) {
+        perror("error allocating samples");
+        return -1;
+    }
+
+    for (i = 0; i < __warmup + __reps; i++) {
+        int64_t ns = __measure(path, phase);
+
+        if (ns < 0) {
+            free(samples);
+            return -1;
+        }
+
+        if (i >= __warmup)
+            samples[i - __warmup] = ns;
+    }
+
+    __summarize(samples, __reps, st);
+    free(samples);
+
+    return 0;
+}
+
+/*
+ * remove dir and the files generated in it
+ */
+static void __remove_dir(const char *dir) {
+    DIR *d = opendir(dir);
+    struct dirent *ent;
+
+    while (d && (ent = readdir(d))) {
+        if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+            continue;
+
+        char *path = _tmix_join_path(dir, ent->d_name);
+
+        if (path)
+            unlink(path);
+
+        free(path);
+    }
+
+    if (d)
+        closedir(d);
+
+    rmdir(dir);
+}
+
+/*
+ * generate a program shaped as params in a temporary directory, and benchmark all phases on it
+ *
+ * returns 0 if succeed, otherwise -1
+ */
+static int __run(const tmixbench_elfgen *params, __stats st[__NPHASES]) {
+    const char *tmp = getenv("TMPDIR");
+    char *dir = _tmix_join_path(tmp && *tmp ? tmp : "/tmp", "tmixbench-XXXXXX");
+    char *path = NULL;
+    int ret = -1;
+    size_t i;
+
+    if (!dir || !mkdtemp(dir)) {
+        perror("error creating temporary directory");
+        free(dir);
+
+        return -1;
+    }
+
+    // libraries are found next to the program, and loaded by ourselves
+    if (setenv("TMIXDYNLD_LIBRARY_PATH", dir, 1) < 0 || _tmixbench_gen_elf(params, dir) < 0) {
+        perror("error generating program");
+        goto exit;
+    }
+
+    if (!(path = _tmix_join_path(dir, TMIXBENCH_PROG_NAME)))
+        goto exit;
+
+    for (i = 0; i < __NPHASES; i++) {
+        if (__bench(path, i, &st[i]) < 0)
+            goto exit;
+    }
+
+    ret = 0;
+
+exit:
+    __remove_dir(dir);
+    free(path);
+    free(dir);
+
+    return ret;
+}
+
+static void __print_shape(const tmixbench_elfgen *params) {
+    printf("%zu segments, %zu libraries, %zu symbols, %zu relocations (mix %u:%u:%u:%u), string table %zu bytes\n",
+           params->nsegs, params->nneeds, params->nsyms, params->nrelocs,
+           params->mix[TMIXBENCH_RELOC_RELATIVE], params->mix[TMIXBENCH_RELOC_GLOB_DAT],
+           params->mix[TMIXBENCH_RELOC_JUMP_SLOT], params->mix[TMIXBENCH_RELOC_ABS], params->strtab_size);
+}
+
+/*
+ * returns 0 if succeed, otherwise -1
+ */
+static int __run_single(const tmixbench_elfgen *params) {
+    __stats st[__NPHASES];
+    size_t i;
+
+    __print_shape(params);
+
+    if (__run(params, st) < 0)
+        return -1;
+
+    printf("  %-6s %10s %10s %10s %10s %10s  (us, %zu runs after %zu warmups)\n",
+           "phase", "min", "p50", "p90", "p99", "max", __reps, __warmup);
+
+    for (i = 0; i < __NPHASES; i++)
+        printf("  %-6s %10.1f %10.1f %10.1f %10.1f %10.1f\n", __phase_names[i],
+               st[i].min / 1e3, st[i].p50 / 1e3, st[i].p90 / 1e3, st[i].p99 / 1e3, st[i].max / 1e3);
+
+    return 0;
+}
+
+/*
+ * run a sweep and compare medians of each step with the previous one, the slope on a log-log scale
+ * tells how time grows with the parameter
+ *
+ * returns the number of steps flagged as super-linear if succeed, otherwise -1
+ */
+static int __run_sweep(const __sweep *sw) {
+    tmixbench_elfgen params = sw->base;
+    __stats prev[__NPHASES], st[__NPHASES];
+    size_t prev_x = 0;
+    size_t x;
+    int flagged = 0;
+
+    printf("sweep of %s:\n", sw->name);
+    printf("  %10s", sw->name);
+
+    size_t i;
+
+    for (i = 0; i < __NPHASES; i++)
+        printf(" %12s %6s", __phase_names[i], "slope");
+
+    printf("\n");
+
+    for (x = sw->from; x <= sw->to; x *= sw->factor) {
+        *(size_t *) ((char *) &params + sw->field) = x;
+
+        if (sw->tie_relocs)
+            params.nrelocs = x;
+
+        if (__run(&params, st) < 0)
+            return -1;
+
+        printf("  %10zu", x);
+
+        for (i = 0; i < __NPHASES; i++) {
+            printf(" %12.1f", st[i].p50 / 1e3);
+
+            if (!prev_x) {
+                printf(" %6s", "");
+                continue;
+            }
+
+            double slope = log((double) st[i].p50 / prev[i].p50) / log((double) x / prev_x);
+            bool super = slope > _SUPERLINEAR_SLOPE && st[i].p50 > _NOISE_FLOOR_NS;
+
+            printf(" %5.2f%s", slope, super ? "!" : " ");
+            flagged += super;
+        }
+
+        printf("\n");
+        fflush(stdout);
+
+        memcpy(prev, st, sizeof(prev));
+        prev_x = x;
+    }
+
+    return flagged;
+}
+
+/*
+ * returns the size in str, with an optional suffix K or M, 0 if invalid
+ */
+static size_t __parse_size(const char *str) {
+    char *end;
+    size_t n = strtoul(str, &end, 0);
+
+    if (end == str)
+        return 0;
+
+    if (*end == 'k' || *end == 'K')
+        n <<= 10, end++;
+    else if (*end == 'm' || *end == 'M')
+        n <<= 20, end++;
+
+    return *end ? 0 : n;
+}
+
+/*
+ * entrypoint
+ */
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        {"warmup", required_argument, NULL, 'w'},
+        {"reps", required_argument, NULL, 'r'},
+        {"segs", required_argument, NULL, 'S'},
+        {"needs", required_argument, NULL, 'N'},
+        {"syms", required_argument, NULL, 'Y'},
+        {"relocs", required_argument, NULL, 'R'},
+        {"mix", required_argument, NULL, 'M'},
+        {"strtab", required_argument, NULL, 'T'},
+        {"sweep", optional_argument, NULL, 's'},
+        {"generate", required_argument, NULL, 'g'},
+        {NULL, 0, NULL, 0},
+    };
+    tmixbench_elfgen params = {
+        .nsegs = 3,
+        .nneeds = 4,
+        .nsyms = 10000,
+        .nrelocs = 20000,
+        .mix = {6, 2, 1, 1},  // mostly RELATIVE ones as in PIEs
+    };
+    bool shaped = false;  // whether a single shape is asked
+    bool sweep = false;
+    const char *sweep_name = NULL;  // NULL for all
+    const char *gen_dir = NULL;
+    int c;
+
+    while ((c = getopt_long(argc, argv, "w:r:", options, NULL)) != -1) {
+        switch (c) {
+            case 'w':
+                __warmup = strtoul(optarg, NULL, 0);
+                break;
+            case 'r':
+                if (!(__reps = strtoul(optarg, NULL, 0)))
+                    goto usage_and_exit;
+                break;
+            case 'S':
+                shaped = true;
+                if ((params.nsegs = __parse_size(optarg)) < 3)
+                    goto usage_and_exit;
+                break;
+            case 'N':
+                shaped = true;
+                params.nneeds = strtoul(optarg, NULL, 0);
+                break;
+            case 'Y':
+                shaped = true;
+                if (!(params.nsyms = __parse_size(optarg)) && strcmp(optarg, "0"))
+                    goto usage_and_exit;
+                break;
+            case 'R':
+                shaped = true;
+                if (!(params.nrelocs = __parse_size(optarg)) && strcmp(optarg, "0"))
+                    goto usage_and_exit;
+                break;
+            case 'M':
+                shaped = true;
+                if (sscanf(optarg, "%u,%u,%u,%u", &params.mix[TMIXBENCH_RELOC_RELATIVE],
+                           &params.mix[TMIXBENCH_RELOC_GLOB_DAT], &params.mix[TMIXBENCH_RELOC_JUMP_SLOT],
+                           &params.mix[TMIXBENCH_RELOC_ABS]) != 4)
+                    goto usage_and_exit;
+                break;
+            case 'T':
+                shaped = true;
+                params.strtab_size = __parse_size(optarg);
+                break;
+            case 's':
+                sweep = true;
+                sweep_name = optarg;
+                break;
+            case 'g':
+                gen_dir = optarg;
+                break;
+            default:
+usage_and_exit:
+                fprintf(stderr, "Usage: %s [-w <warmups>] [-r <runs>] [--segs <n>] [--needs <n>] [--syms <n>]\n"
+                                "       [--relocs <n>] [--mix <relative,glob_dat,jump_slot,abs>] [--strtab <size>]\n"
+                                "       [--sweep[=syms|relocs|needs|segs|strtab]] [--generate <dir>]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc || (sweep && (shaped || gen_dir)))
+        goto usage_and_exit;
+
+    if (gen_dir) {
+        // only write the files, e.g. to be run by tmixldr -t
+        if (_tmixbench_gen_elf(&params, gen_dir) < 0) {
+            perror("error generating program");
+            return EXIT_FAILURE;
+        }
+
+        return EXIT_SUCCESS;
+    }
+
+    if (!sweep && __run_single(&params) < 0)
+        return EXIT_FAILURE;
+
+    if (shaped)
+        return EXIT_SUCCESS;
+
+    // sweeps flagging super-linear steps make the exit status 2
+
+    int flagged = 0;
+    size_t i;
+
+    for (i = 0; i < sizeof(__sweeps) / sizeof(*__sweeps); i++) {
+        if (sweep_name && strcmp(sweep_name, __sweeps[i].name))
+            continue;
+
+        printf("\n");
+
+        int ret = __run_sweep(&__sweeps[i]);
+
+        if (ret < 0)
+            return EXIT_FAILURE;
+
+        flagged += ret;
+    }
+
+    if (flagged) {
+        printf("\n%d steps grow faster than n^%.2f, marked with !\n", flagged, _SUPERLINEAR_SLOPE);
+        return 2;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,107 @@
+/*
+  arena.c - Bump allocator
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../inc/arena.h"
+
+// default size of a block, larger allocations get a block of their own size
+#define _BLOCK_SIZE               (16 * 1024)
+
+#define _ALIGN                    (_Alignof(max_align_t))
+#define _ROUND_UP(_x, _align)     ((((_x) + (_align) - 1) / (_align)) * (_align))
+
+struct _tmix_arena_block {
+    struct _tmix_arena_block *next;  // previously filled block
+    size_t size;  // usable size
+    size_t used;
+    _Alignas(max_align_t) unsigned char data[];
+};
+
+void *_tmix_arena_alloc(tmix_arena *arena, size_t size) {
+    size = _ROUND_UP(size ? size : 1, _ALIGN);
+
+    struct _tmix_arena_block *block = arena->head;
+
+    if (!block || block->size - block->used < size) {
+        // need a new block
+
+        size_t block_size = size > _BLOCK_SIZE ? size : _BLOCK_SIZE;
+
+        if (block_size > SIZE_MAX - sizeof(struct _tmix_arena_block)) {
+            errno = ENOMEM;
+            return NULL;
+        }
+
+        struct _tmix_arena_block *new_block = malloc(sizeof(struct _tmix_arena_block) + block_size);
+
+        if (!new_block)
+            return NULL;
+
+        new_block->size = block_size;
+        new_block->used = 0;
+
+        if (block && block->size - block->used > block_size - size) {
+            // current block still has more room left, keep allocating from it
+            new_block->next = block->next;
+            block->next = new_block;
+        } else {
+            new_block->next = block;
+            arena->head = new_block;
+        }
+
+        block = new_block;
+    }
+
+    void *res = &block->data[block->used];
+
+    block->used += size;
+
+    return res;
+}
+
+void *_tmix_arena_calloc(tmix_arena *arena, size_t n, size_t size) {
+    if (size && n > SIZE_MAX / size) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    void *res = _tmix_arena_alloc(arena, n * size);
+
+    if (res)
+        memset(res, 0, n * size);
+
+    return res;
+}
+
+void _tmix_arena_free(tmix_arena *arena) {
+    struct _tmix_arena_block *block = arena->head;
+
+    while (block) {
+        struct _tmix_arena_block *next = block->next;
+
+        free(block);
+        block = next;
+    }
+
+    arena->head = NULL;
+}
@@ -0,0 +1,242 @@
+/*
+  prof.c - Timing and counters of loading phases
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <sys/resource.h>
+#endif
+
+#include "../inc/prof.h"
+
+bool ___tmix_prof_enabled = false;
+uint64_t ___tmix_prof_counters[TMIX_PROF_NCOUNTERS] = {};
+
+static uint64_t __start_ns = 0;  // when our libraries were loaded, only written once by the constructor below
+static bool __started = false;  // whether the startup phase was recorded
+static uint64_t __ns[TMIX_PROF_NPHASES] = {};
+static tmix_prof_phase __current = TMIX_PROF_OTHER;
+static uint64_t __since = 0;  // when the current phase started
+
+static const char *const __phase_names[TMIX_PROF_NPHASES] = {
+    [TMIX_PROF_STARTUP] = "startup",
+    [TMIX_PROF_PARSE] = "parse",
+    [TMIX_PROF_LOAD] = "load",
+    [TMIX_PROF_DEPS] = "deps",
+    [TMIX_PROF_RESOLVE] = "resolve",
+    [TMIX_PROF_RELOCATE] = "relocate",
+    [TMIX_PROF_RELRO] = "relro",
+    [TMIX_PROF_INIT] = "init",
+    [TMIX_PROF_OTHER] = "other",
+};
+
+static const char *const __counter_names[TMIX_PROF_NCOUNTERS] = {
+    [TMIX_PROF_BYTES_READ] = "bytes_read",
+    [TMIX_PROF_MMAPS] = "mmaps",
+    [TMIX_PROF_MPROTECTS] = "mprotects",
+    [TMIX_PROF_RELOCS] = "relocs",
+    [TMIX_PROF_LOOKUPS] = "lookups",
+    [TMIX_PROF_MINOR_FAULTS] = "minor_faults",
+    [TMIX_PROF_MAJOR_FAULTS] = "major_faults",
+};
+
+/*
+ * returns the monotonic time in nanoseconds
+ */
+static uint64_t __now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER freq, count;
+
+    // wont fail since Windows XP
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+
+    return (uint64_t) count.QuadPart / freq.QuadPart * 1000000000
+           + (uint64_t) count.QuadPart % freq.QuadPart * 1000000000 / freq.QuadPart;
+#else
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+void _tmix_prof_enable(void) {
+    uint64_t now = __now_ns();
+
+    memset(__ns, 0, sizeof(__ns));
+    memset(___tmix_prof_counters, 0, sizeof(___tmix_prof_counters));
+
+    if (!__started) {
+        __started = true;
+        __ns[TMIX_PROF_STARTUP] = now - __start_ns;
+    }
+
+    __current = TMIX_PROF_OTHER;
+    __since = now;
+    ___tmix_prof_enabled = true;
+}
+
+void _tmix_prof_disable(void) {
+    ___tmix_prof_enabled = false;
+}
+
+tmix_prof_phase _tmix_prof_switch(tmix_prof_phase phase) {
+    tmix_prof_phase prev = __current;
+
+    if (!___tmix_prof_enabled)
+        return prev;
+
+    uint64_t now = __now_ns();
+
+    __ns[__current] += now - __since;
+    __since = now;
+    __current = phase;
+
+    return prev;
+}
+
+void _tmix_prof_snapshot(tmix_prof *prof) {
+    // account the current phase up to now
+    _tmix_prof_switch(__current);
+
+    memcpy(prof->ns, __ns, sizeof(prof->ns));
+
+    size_t i;
+
+    for (i = 0; i < TMIX_PROF_NCOUNTERS; i++)
+        prof->counters[i] = __atomic_load_n(&___tmix_prof_counters[i], __ATOMIC_RELAXED);
+
+#ifndef _WIN32
+    struct rusage usage;
+
+    if (!getrusage(RUSAGE_SELF, &usage)) {
+        prof->counters[TMIX_PROF_MINOR_FAULTS] = usage.ru_minflt;
+        prof->counters[TMIX_PROF_MAJOR_FAULTS] = usage.ru_majflt;
+    }
+#endif
+}
+
+void _tmix_prof_print(const tmix_prof *prof, FILE *fp) {
+    uint64_t total = 0;
+    size_t i;
+
+    fprintf(fp, "%-16s %12s\n", "phase", "time (us)");
+
+    for (i = 0; i < TMIX_PROF_NPHASES; i++) {
+        fprintf(fp, "%-16s %12.1f\n", __phase_names[i], prof->ns[i] / 1000.0);
+        total += prof->ns[i];
+    }
+
+    fprintf(fp, "%-16s %12.1f\n", "total", total / 1000.0);
+    fprintf(fp, "\n%-16s %12s\n", "counter", "value");
+
+    for (i = 0; i < TMIX_PROF_NCOUNTERS; i++)
+        fprintf(fp, "%-16s %12" PRIu64 "\n", __counter_names[i], prof->counters[i]);
+}
+
+int _tmix_prof_write_json(const tmix_prof *prof, const char *program, const char *path) {
+    // appended as a whole line, so records of concurrent processes never interleave
+
+    char line[4096];
+    size_t len = 0;
+    size_t i;
+
+#define _APPEND(...)  do {                                                                   \
+                          int n = snprintf(line + len, sizeof(line) - len, __VA_ARGS__);     \
+                          if (n < 0 || (size_t) n >= sizeof(line) - len)                     \
+                              goto too_long;                                                 \
+                          len += n;                                                          \
+                      } while (0)
+
+    _APPEND("{\"program\":");
+
+    if (!program)
+        _APPEND("null");
+    else {
+        _APPEND("\"");
+
+        for (; *program; program++) {
+            unsigned char c = *program;
+
+            if (c == '"' || c == '\\')
+                _APPEND("\\%c", c);
+            else if (c < 0x20)
+                _APPEND("\\u%04x", c);
+            else
+                _APPEND("%c", c);
+        }
+
+        _APPEND("\"");
+    }
+
+    uint64_t total = 0;
+
+    _APPEND(",\"phases_ns\":{");
+
+    for (i = 0; i < TMIX_PROF_NPHASES; i++) {
+        _APPEND("%s\"%s\":%" PRIu64, i ? "," : "", __phase_names[i], prof->ns[i]);
+        total += prof->ns[i];
+    }
+
+    _APPEND("},\"total_ns\":%" PRIu64 ",\"counters\":{", total);
+
+    for (i = 0; i < TMIX_PROF_NCOUNTERS; i++)
+        _APPEND("%s\"%s\":%" PRIu64, i ? "," : "", __counter_names[i], prof->counters[i]);
+
+    _APPEND("}}\n");
+
+#undef _APPEND
+
+    FILE *fp = fopen(path, "a");
+
+    if (!fp)
+        return -1;
+
+    // a single write of the whole line
+    setvbuf(fp, NULL, _IONBF, 0);
+
+    size_t written = fwrite(line, 1, len, fp);
+    int saved_errno = errno;
+
+    fclose(fp);
+
+    if (written != len) {
+        errno = saved_errno;
+        return -1;
+    }
+
+    return 0;
+
+too_long:
+    errno = ENAMETOOLONG;
+    return -1;
+}
+
+__attribute__((constructor)) static void __init_prof(void) {
+    __start_ns = __now_ns();
+}
@@ -0,0 +1,63 @@
+/*
+  arena.h - Bump allocator
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_COMMON_INCLUDE_ARENA_H
+#define TERMIX_COMMON_INCLUDE_ARENA_H
+
+#include <sys/types.h>
+
+#include "../inc/abi.h"
+
+#ifdef __clangd__
+   // for making IDE happy
+#  define _tmixlibcommon_api
+#else
+#  ifdef TMIX_BUILDING_LIBCOMMON_SHLIB
+#    define _tmixlibcommon_api      __tmixapi_export
+#  else
+#    define _tmixlibcommon_api      __tmixapi_import
+#  endif
+#endif
+
+struct _tmix_arena_block;
+
+/*
+ * memory allocated from an arena is never freed individually,
+ * but released all at once together with the arena
+ *
+ * initialize this struct with zero
+ */
+typedef struct {
+    struct _tmix_arena_block *head;  // block currently allocating from
+} tmix_arena;
+
+/*
+ * returns a block of memory aligned for any type, NULL and sets errno if failed
+ */
+_tmixlibcommon_api void *_tmix_arena_alloc(tmix_arena *arena, size_t size);
+
+/*
+ * same as _tmix_arena_alloc, but the returned memory is zeroed
+ */
+_tmixlibcommon_api void *_tmix_arena_calloc(tmix_arena *arena, size_t n, size_t size);
+
+/*
+ * release all memory allocated from the arena, the arena can be reused afterwards
+ */
+_tmixlibcommon_api void _tmix_arena_free(tmix_arena *arena);
+
+#endif /* TERMIX_COMMON_INCLUDE_ARENA_H */
@@ -0,0 +1,130 @@
+/*
+  probes.h - Static tracepoints compatible with SystemTap SDT
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_COMMON_INCLUDE_PROBES_H
+#define TERMIX_COMMON_INCLUDE_PROBES_H
+
+#include <stdint.h>
+
+/*
+ * each probe is a single nop plus a .note.stapsdt entry describing where its arguments are,
+ * tools like bpftrace, perf and SystemTap find them in the ELF without any runtime support,
+ * e.g. usdt:/path/to/libtmixloader.so:termix:resolve_end
+ *
+ * all arguments are passed as uintptr_t, so they are cheap to evaluate even if nobody listens,
+ * strings are passed as pointers
+ *
+ * configure with -DTERMIX_ENABLE_PROBES=OFF to compile them out
+ */
+#if defined(__ELF__) && !defined(TMIX_DISABLE_PROBES) \
+    && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__))
+#  define TMIX_PROBES_SUPPORTED
+#endif
+
+#ifdef TMIX_PROBES_SUPPORTED
+
+#if __SIZEOF_POINTER__ == 8
+#  define _TMIX_PROBE_ADDR              ".8byte"
+#else
+#  define _TMIX_PROBE_ADDR              ".4byte"
+#endif
+
+// memory operands on x86 are understood by tracers, registers only elsewhere to be safe
+#if defined(__x86_64__) || defined(__i386__)
+#  define _TMIX_PROBE_CONSTRAINT        "nor"
+#else
+#  define _TMIX_PROBE_CONSTRAINT        "r"
+#endif
+
+// an argument is described as size@location, a negative size passed to %n prints an unsigned one
+#define _TMIX_PROBE_ARG(_n)             "%n[_s" #_n "]@%[_a" #_n "]"
+#define _TMIX_PROBE_OPERAND(_n, _x)     [_s##_n] "n" (-(int) sizeof(uintptr_t)), \
+                                        [_a##_n] _TMIX_PROBE_CONSTRAINT ((uintptr_t) (_x))
+
+#define _TMIX_PROBE(_name, _args, ...)  __asm__ __volatile__ (                               \
+    "990: nop\n"                                                                             \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                                            \
+    ".balign 4\n"                                                                            \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                                       \
+    "991: .asciz \"stapsdt\"\n"                                                              \
+    "992: .balign 4\n"                                                                       \
+    "993: " _TMIX_PROBE_ADDR " 990b\n"                                                       \
+    _TMIX_PROBE_ADDR " _.stapsdt.base\n"                                                     \
+    _TMIX_PROBE_ADDR " 0\n"  /* no semaphore */                                              \
+    ".asciz \"termix\"\n"                                                                    \
+    ".asciz \"" #_name "\"\n"                                                                \
+    ".asciz \"" _args "\"\n"                                                                 \
+    "994: .balign 4\n"                                                                       \
+    ".popsection\n"                                                                          \
+    ".ifndef _.stapsdt.base\n"                                                               \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n"                  \
+    ".weak _.stapsdt.base\n"                                                                 \
+    ".hidden _.stapsdt.base\n"                                                               \
+    "_.stapsdt.base: .space 1\n"                                                             \
+    ".size _.stapsdt.base, 1\n"                                                              \
+    ".popsection\n"                                                                          \
+    ".endif\n"                                                                               \
+    :: __VA_ARGS__)
+
+#define _tmix_probe0(_name)                             _TMIX_PROBE(_name, "")
+#define _tmix_probe1(_name, _a1)                        _TMIX_PROBE(_name, _TMIX_PROBE_ARG(1), \
+                                                                    _TMIX_PROBE_OPERAND(1, _a1))
+#define _tmix_probe2(_name, _a1, _a2)                   _TMIX_PROBE(_name, _TMIX_PROBE_ARG(1) " " _TMIX_PROBE_ARG(2), \
+                                                                    _TMIX_PROBE_OPERAND(1, _a1),            \
+                                                                    _TMIX_PROBE_OPERAND(2, _a2))
+#define _tmix_probe3(_name, _a1, _a2, _a3)              _TMIX_PROBE(_name, _TMIX_PROBE_ARG(1) " " _TMIX_PROBE_ARG(2) \
+                                                                    " " _TMIX_PROBE_ARG(3),                 \
+                                                                    _TMIX_PROBE_OPERAND(1, _a1),            \
+                                                                    _TMIX_PROBE_OPERAND(2, _a2),            \
+                                                                    _TMIX_PROBE_OPERAND(3, _a3))
+#define _tmix_probe4(_name, _a1, _a2, _a3, _a4)         _TMIX_PROBE(_name, _TMIX_PROBE_ARG(1) " " _TMIX_PROBE_ARG(2) \
+                                                                    " " _TMIX_PROBE_ARG(3) " " _TMIX_PROBE_ARG(4), \
+                                                                    _TMIX_PROBE_OPERAND(1, _a1),            \
+                                                                    _TMIX_PROBE_OPERAND(2, _a2),            \
+                                                                    _TMIX_PROBE_OPERAND(3, _a3),            \
+                                                                    _TMIX_PROBE_OPERAND(4, _a4))
+
+#else
+
+#define _tmix_probe0(_name)                             do {} while (0)
+#define _tmix_probe1(_name, _a1)                        do { (void) (_a1); } while (0)
+#define _tmix_probe2(_name, _a1, _a2)                   do { (void) (_a1); (void) (_a2); } while (0)
+#define _tmix_probe3(_name, _a1, _a2, _a3)              do { (void) (_a1); (void) (_a2); (void) (_a3); } while (0)
+#define _tmix_probe4(_name, _a1, _a2, _a3, _a4)         do { (void) (_a1); (void) (_a2); (void) (_a3); \
+                                                             (void) (_a4); } while (0)
+
+#endif /* TMIX_PROBES_SUPPORTED */
+
+/*
+ * list of probes, arguments in order:
+ *
+ * parse_start       fd
+ * parse_end         fd, result (0 or -1), whether taken from the cache
+ * map_segment       address, size in memory, flags (tmixelf_seg_flag)
+ * lib_open          name, whether loaded natively, address of the first segment or the host handle
+ * resolve_start     name
+ * resolve_end       name, address (0 if missing), providing library (NULL if remembered), whether remembered,
+ *                   symbols searched in a batch only fire it after resolve_batch_end
+ * resolve_batch_start
+ *                   number of symbols, those not remembered among the ones bound while linking an image
+ * resolve_batch_end number of symbols, number of them found
+ * relocate          address of the image, kind (string), count
+ * relro             address, size
+ * entry             address of the entrypoint
+ */
+
+#endif /* TERMIX_COMMON_INCLUDE_PROBES_H */
@@ -0,0 +1,119 @@
+/*
+  prof.h - Timing and counters of loading phases
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_COMMON_INCLUDE_PROF_H
+#define TERMIX_COMMON_INCLUDE_PROF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "../inc/abi.h"
+
+#ifdef __clangd__
+   // for making IDE happy
+#  define _tmixlibcommon_api
+#else
+#  ifdef TMIX_BUILDING_LIBCOMMON_SHLIB
+#    define _tmixlibcommon_api      __tmixapi_export
+#  else
+#    define _tmixlibcommon_api      __tmixapi_import
+#  endif
+#endif
+
+/*
+ * phases time is spent in, exactly one of them is current at any time
+ */
+typedef enum {
+    TMIX_PROF_STARTUP = 0,  // constructors of our libraries, until recording starts
+    TMIX_PROF_PARSE,  // parsing information of the program
+    TMIX_PROF_LOAD,  // mapping the program
+    TMIX_PROF_DEPS,  // loading libraries, including the preloaded one
+    TMIX_PROF_RESOLVE,  // looking up symbols
+    TMIX_PROF_RELOCATE,  // applying relocations, symbol lookups excluded
+    TMIX_PROF_RELRO,  // protecting relro segments
+    TMIX_PROF_INIT,  // running initialization functions of libraries
+    TMIX_PROF_OTHER,  // everything else until the program starts
+    TMIX_PROF_NPHASES
+} tmix_prof_phase;
+
+typedef enum {
+    TMIX_PROF_BYTES_READ = 0,  // bytes read from files instead of mapped
+    TMIX_PROF_MMAPS,  // mmap calls, including reservations
+    TMIX_PROF_MPROTECTS,  // mprotect calls
+    TMIX_PROF_RELOCS,  // relocations applied, including RELATIVE ones
+    TMIX_PROF_LOOKUPS,  // imported symbols resolved, remembered ones included
+    TMIX_PROF_MINOR_FAULTS,  // since the process started, only filled by snapshots
+    TMIX_PROF_MAJOR_FAULTS,  // same as above
+    TMIX_PROF_NCOUNTERS
+} tmix_prof_counter;
+
+typedef struct {
+    uint64_t ns[TMIX_PROF_NPHASES];  // time spent in each phase
+    uint64_t counters[TMIX_PROF_NCOUNTERS];
+} tmix_prof;
+
+extern _tmixlibcommon_api bool ___tmix_prof_enabled;  // dont use directly
+extern _tmixlibcommon_api uint64_t ___tmix_prof_counters[TMIX_PROF_NCOUNTERS];  // dont use directly
+
+/*
+ * add n to the counter if recording
+ */
+#define _tmix_prof_count(_counter, _n)    do {                                                       \
+                                              if (___tmix_prof_enabled)                              \
+                                                  __atomic_fetch_add(&___tmix_prof_counters[_counter], \
+                                                                     (_n), __ATOMIC_RELAXED);        \
+                                          } while (0)
+
+/*
+ * start recording from scratch in phase TMIX_PROF_OTHER, the first call in a process
+ * attributes the time since our libraries were loaded to TMIX_PROF_STARTUP
+ */
+_tmixlibcommon_api void _tmix_prof_enable(void);
+
+/*
+ * stop recording, so code running afterwards, e.g. lazy binding in the program, costs a single check again
+ */
+_tmixlibcommon_api void _tmix_prof_disable(void);
+
+/*
+ * phase - the phase time is spent in from now on
+ *
+ * returns the previous phase, so callers can switch back, does nothing unless recording
+ */
+_tmixlibcommon_api tmix_prof_phase _tmix_prof_switch(tmix_prof_phase phase);
+
+/*
+ * prof - output buffer, time and counters recorded so far
+ */
+_tmixlibcommon_api void _tmix_prof_snapshot(tmix_prof *prof);
+
+/*
+ * print prof as a human readable table
+ */
+_tmixlibcommon_api void _tmix_prof_print(const tmix_prof *prof, FILE *fp);
+
+/*
+ * program - path of the program prof is about, might be NULL
+ *
+ * append prof as a single-line JSON record to the file at path
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+_tmixlibcommon_api int _tmix_prof_write_json(const tmix_prof *prof, const char *program, const char *path);
+
+#endif /* TERMIX_COMMON_INCLUDE_PROF_H */
@@ -0,0 +1,50 @@
+/*
+  _batch.h - Checking many ELF files in one process
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_BATCH_H
+#define TERMIX_LOADER_INTERNAL_BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * how far each file is taken, each stage includes the previous ones
+ */
+typedef enum {
+    TMIXLDR_INTERNAL_CHECK_PARSE = 0,
+    TMIXLDR_INTERNAL_CHECK_MAP,  // mapped and unmapped again
+    TMIXLDR_INTERNAL_CHECK_LINK,  // libraries and imported symbols are found, nothing is relocated
+    TMIXLDR_INTERNAL_CHECK_NSTAGES
+} tmixldr_internal_check_stage;
+
+/*
+ * args - array, paths of files, or @file to read paths from file, one per line, @- for stdin
+ * count - number of args
+ * stage - the last stage to take files through
+ * info - whether to print parsed information of files as well
+ * nthreads - number of threads, 0 for the number of CPUs
+ * cache_dir - directory caching parsed information, NULL to disable caching
+ *
+ * check files in a thread pool, printing a JSON record per file to stdout in the order given,
+ * then a summary to stderr
+ *
+ * returns 0 if all files pass, 1 if some fail, otherwise prints the error, returns -1 and sets errno
+ */
+int _tmixldr_internal_batch(const char *const *args, size_t count, tmixldr_internal_check_stage stage,
+                            bool info, size_t nthreads, const char *cache_dir);
+
+#endif /* TERMIX_LOADER_INTERNAL_BATCH_H */
@@ -0,0 +1,123 @@
+/*
+  _deps.h - Libraries required by loaded images
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_DEPENDENCIES_H
+#define TERMIX_LOADER_INTERNAL_DEPENDENCIES_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "elf/elf.h"
+
+#include "_relcache.h"
+#include "dynld.h"
+
+/*
+ * a library symbols of images are resolved from, loaded by us if possible, otherwise by the host
+ */
+typedef struct {
+    char *name;  // name required by DT_NEEDED, or path of a preloaded one
+    const char *soname;  // DT_SONAME of the loaded library, NULL if unknown
+    bool native;  // whether loaded by us, so it never goes through the host dynamic linker
+    void *handle;  // only if loaded by the host
+    void *base;  // address of the first loaded segment, only if native
+    tmixelf_info *ei;  // only if native, never freed, since images keep referring to it
+    bool linked;  // whether relocations are applied, only if native
+    ssize_t tls_off;  // offset of its TLS block from the thread pointer, only if native with a TLS segment
+    tmixdynld_internal_provider provider;  // zero if unknown
+#ifndef _WIN32
+    dev_t dev;
+    ino_t ino;  // zero if unknown
+#endif
+    const char *const *needs;  // array, names required by the library itself, NULL if unknown
+    size_t nneeds;
+} tmixdynld_internal_lib;
+
+/*
+ * ei - information of the image being linked
+ * cache_dir - directory caching parsed information of libraries, NULL to disable caching
+ *
+ * load libraries required by ei and all their dependencies, each one only once,
+ * appending them to the global scope in breadth-first order
+ *
+ * libraries required by images are searched in directories listed in environment
+ * variable TMIXDYNLD_LIBRARY_PATH, then the directory of test libraries, then by the host,
+ * the library at TMIXDYNLD_LIBC_PATH is always loaded before all others
+ *
+ * the ones found by us are loaded natively, unless they cannot be, their relocations
+ * are left to the caller
+ *
+ * returns 0 if succeed, otherwise prints the error, returns -1 and sets errno
+ */
+int _tmixdynld_internal_load_deps(const tmixelf_info *ei, const char *cache_dir);
+
+/*
+ * names - array, names or paths of libraries
+ * count - number of names
+ * cache_dir - directory caching parsed information of libraries, NULL to disable caching
+ *
+ * same as _tmixdynld_internal_load_deps, but libraries are given by the caller
+ */
+int _tmixdynld_internal_load_libs(const char *const *names, size_t count, const char *cache_dir);
+
+/*
+ * count - output, number of loaded libraries
+ *
+ * returns all loaded libraries in the global scope order
+ */
+tmixdynld_internal_lib *_tmixdynld_internal_get_deps(size_t *count);
+
+/*
+ * hash - GNU hash of name
+ * provider - output, name of the library defining it, untouched if not found
+ *
+ * returns the address of the first definition of name in the global scope, NULL if not found
+ */
+void *_tmixdynld_internal_lookup_deps(const char *name, uint32_t hash, const char **provider);
+
+/*
+ * syms - array, symbols to look up, hash fields must be set
+ * n - number of syms
+ * addrs - output, addrs[i] is set to the address of syms[i], NULL if not found
+ * providers - output, providers[i] is set to the name of the library defining syms[i], NULL if not found
+ *
+ * same as calling _tmixdynld_internal_lookup_deps for each symbol, but bloom filters of each
+ * library loaded by us are probed for the whole batch at once
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+int _tmixdynld_internal_lookup_deps_batch(const tmixelf_sym *syms, size_t n, void **addrs, const char **providers);
+
+/*
+ * hash - GNU hash of name
+ * module_off - output, offset of the TLS block defining name from the thread pointer
+ * sym_off - output, offset of name within the block
+ *
+ * find the first definition of thread-local name in the global scope
+ *
+ * returns 0 if found, otherwise -1 and sets errno, ENOENT if not defined, EINVAL if the first definition
+ * is not thread-local, ENOTSUP if defined by a library loaded by the host, whose TLS is not laid out by us
+ */
+int _tmixdynld_internal_lookup_tls(const char *name, uint32_t hash, ssize_t *module_off, size_t *sym_off);
+
+/*
+ * same as tmixdynld_check_elf
+ */
+int _tmixdynld_internal_check_deps(const tmixelf_info *ei, const char *cache_dir, tmixdynld_check *res);
+
+#endif /* TERMIX_LOADER_INTERNAL_DEPENDENCIES_H */
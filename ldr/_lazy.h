@@ -0,0 +1,58 @@
+/*
+  _lazy.h - Lazy binding of PLT entries
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_LAZY_H
+#define TERMIX_LOADER_INTERNAL_LAZY_H
+
+#include <sys/types.h>
+
+#include "elf/elf.h"
+
+/*
+ * architectures with a resolver trampoline
+ */
+#if defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__)
+#  define TMIXDYNLD_LAZY_SUPPORTED
+#endif
+
+/*
+ * base - address of the first loaded segment
+ * ei - information of the loaded elf, must be valid as long as the image is in use
+ *
+ * point all PLT entries of ei to the resolver trampoline, so each symbol is
+ * bound by _tmixdynld_internal_resolve on its first call
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+int _tmixdynld_internal_setup_lazy(void *base, const tmixelf_info *ei);
+
+/*
+ * returns the number of symbols bound lazily so far
+ */
+size_t _tmixdynld_internal_lazy_count(void);
+
+/*
+ * base - address of the first loaded segment of the image referring to sym
+ *
+ * returns the address of sym, otherwise prints the error and returns NULL,
+ * which is not an error if sym is weak
+ *
+ * defined in dynld.c
+ */
+void *_tmixdynld_internal_resolve(void *base, const tmixelf_sym *sym);
+
+#endif /* TERMIX_LOADER_INTERNAL_LAZY_H */
@@ -0,0 +1,67 @@
+/*
+  _relcache.h - Cache of relocation results
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_RELOCATION_CACHE_H
+#define TERMIX_LOADER_INTERNAL_RELOCATION_CACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "elf/elf.h"
+
+/*
+ * a loaded library which symbols are resolved from
+ */
+typedef struct {
+    uintptr_t base;  // address symbol offsets are relative to
+    uintptr_t start;  // start address of its loaded segments
+    uintptr_t end;  // end address of its loaded segments
+    tmix_array build_id;  // GNU build ID (i.e. bytes), cannot be cached if empty
+} tmixdynld_internal_provider;
+
+// provider index of bindings with absolute values, e.g. missing weak symbols bound to zero
+#define TMIXDYNLD_INTERNAL_NO_PROVIDER      UINT32_MAX
+// provider index of bindings left untouched, e.g. thread-local ones, which depend on the order of loading
+#define TMIXDYNLD_INTERNAL_NOT_CACHED       (UINT32_MAX - 1)
+
+/*
+ * result of a resolved relocation
+ */
+typedef struct {
+    size_t off;  // location relative to the image base where the address is stored
+    size_t sym_off;  // address of the symbol relative to the base of its provider
+    uint32_t provider;  // index of the provider, or one of the special ones above
+} tmixdynld_internal_binding;
+
+/*
+ * apply the cached bindings of ei loaded at base, if all providers are unchanged
+ *
+ * returns 0 if applied, otherwise -1 and nothing is touched
+ */
+int _tmixdynld_internal_apply_cached(const char *cache_dir, void *base, const tmixelf_info *ei,
+                                     const tmixdynld_internal_provider *providers, size_t nproviders);
+
+/*
+ * save bindings of ei, replacing the old entry
+ *
+ * returns 0 if success, otherwise -1 and sets errno
+ */
+int _tmixdynld_internal_save_cached(const char *cache_dir, const tmixelf_info *ei,
+                                    const tmixdynld_internal_provider *providers, size_t nproviders,
+                                    const tmixdynld_internal_binding *bindings, size_t count);
+
+#endif /* TERMIX_LOADER_INTERNAL_RELOCATION_CACHE_H */
@@ -0,0 +1,55 @@
+/*
+  _server.h - Fork server of the ELF loader
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_SERVER_H
+#define TERMIX_LOADER_INTERNAL_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * a client connects to the socket of the server and sends a request header with its
+ * stdin, stdout and stderr attached as SCM_RIGHTS, followed by the strings, the server
+ * answers with an int32_t once the program exits, the same as the exit status of tmixldr
+ */
+#define TMIXLDR_INTERNAL_REQUEST_MAGIC        UINT32_C(0x786d6974)  // "tmix"
+#define TMIXLDR_INTERNAL_REQUEST_MAX_SIZE     (2 * 1024 * 1024)  // as much as ARG_MAX usually allows
+
+#define TMIXLDR_INTERNAL_REQUEST_DEBUG        (1 << 0)  // same as -d
+
+typedef struct {
+    uint32_t magic;
+    uint32_t flags;
+    uint32_t size;  // size of the strings following, each ends with NUL: cwd, arguments then environment
+    uint32_t argc;  // number of arguments, the first one is the path of the ELF
+    uint32_t envc;  // number of environment variables
+} tmixldr_internal_request;
+
+/*
+ * sock_path - path of the Unix socket to create, replacing a stale one
+ * run - loads and runs the ELF at argv[0] with argv and envp in the current process,
+ *       never returns if succeed
+ *
+ * accept requests forever, each one is served by a forked process, which forks again
+ * to run the program with stdio, working directory, arguments and environment of the client,
+ * then reports its exit status, so everything loaded before calling this is shared by all programs
+ *
+ * returns -1 and sets errno if the socket cannot be served
+ */
+int _tmixldr_internal_serve(const char *sock_path, void (*run)(char *const *argv, char *const *envp, bool debug));
+
+#endif /* TERMIX_LOADER_INTERNAL_SERVER_H */
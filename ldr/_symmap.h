@@ -0,0 +1,55 @@
+/*
+  _symmap.h - Map of resolved symbols
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_SYMBOL_MAP_H
+#define TERMIX_LOADER_INTERNAL_SYMBOL_MAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * the map is shared by all images linked in the process, and safe to use from
+ * threads of the guest, since symbols might be bound lazily
+ */
+
+/*
+ * hash - GNU hash of name
+ * addr - output, NULL if the symbol is known to be missing
+ *
+ * returns whether name is in the map, counted as a hit or a miss
+ */
+bool _tmixdynld_internal_symmap_get(uint32_t hash, const char *name, void **addr);
+
+/*
+ * remember the address of name, NULL if it cannot be found
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+int _tmixdynld_internal_symmap_put(uint32_t hash, const char *name, void *addr);
+
+/*
+ * forget missing symbols remembered so far, once a library joins the global scope
+ */
+void _tmixdynld_internal_symmap_scope_grown(void);
+
+/*
+ * returns the number of hits and misses of _tmixdynld_internal_symmap_get so far
+ */
+void _tmixdynld_internal_symmap_stats(size_t *hits, size_t *misses);
+
+#endif /* TERMIX_LOADER_INTERNAL_SYMBOL_MAP_H */
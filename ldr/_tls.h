@@ -0,0 +1,64 @@
+/*
+  _tls.h - Static thread-local storage of loaded images
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_INTERNAL_TLS_H
+#define TERMIX_LOADER_INTERNAL_TLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "elf/elf.h"
+
+/*
+ * architectures whose thread pointer and TLS layout are known
+ */
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__))
+#  define TMIXDYNLD_TLS_SUPPORTED
+#endif
+
+/*
+ * base - address of the first loaded segment
+ * ei - information of the loaded elf with a TLS segment
+ * program - whether ei is the program, whose block has a fixed offset as in a new process,
+ *           otherwise it is a library, placed anywhere else in the reservation
+ * tls_off - output, offset of the block from the thread pointer
+ *
+ * allocate the TLS block of ei from the reservation given to tmixdynld_set_static_tls,
+ * initialize it in the calling thread, and record it for threads created later
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, ENOTSUP if nothing is reserved
+ * or ei is aligned more than TMIXDYNLD_STATIC_TLS_ALIGN, ENOMEM if the reservation is exhausted
+ */
+int _tmixdynld_internal_alloc_tls(void *base, const tmixelf_info *ei, bool program, ssize_t *tls_off);
+
+/*
+ * returns the function resolving TLS descriptors, whose second word is the offset from the thread pointer,
+ * NULL if not supported
+ */
+void *_tmixdynld_internal_tlsdesc_static(void);
+
+/*
+ * hash - GNU hash of name
+ *
+ * returns our own definition of name replacing the one of the host, NULL if none,
+ * i.e. __tls_get_addr for blocks laid out by us, and pthread_create if new threads
+ * need to initialize them
+ */
+void *_tmixdynld_internal_tls_builtin(const char *name, uint32_t hash);
+
+#endif /* TERMIX_LOADER_INTERNAL_TLS_H */
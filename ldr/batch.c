@@ -0,0 +1,446 @@
+/*
+  batch.c - Checking many ELF files in one process
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "dynld.h"
+#include "elf/elf.h"
+#include "load.h"
+
+#include "_batch.h"
+
+/*
+ * a file to check, filled by a worker, then printed and released in order
+ */
+typedef struct {
+    const char *path;
+    tmixldr_internal_check_stage failed;  // TMIXLDR_INTERNAL_CHECK_NSTAGES if passed
+    int err;  // errno of the failed stage, 0 if something is missing while linking
+    tmixelf_info ei;  // only kept for printing if parsed
+    bool parsed;
+    tmixdynld_check check;  // only if linked
+    bool done;
+} __job;
+
+static const char *const __stage_names[TMIXLDR_INTERNAL_CHECK_NSTAGES] = {
+    [TMIXLDR_INTERNAL_CHECK_PARSE] = "parse",
+    [TMIXLDR_INTERNAL_CHECK_MAP] = "map",
+    [TMIXLDR_INTERNAL_CHECK_LINK] = "link",
+};
+
+static __job *__jobs = NULL;  // array
+static size_t __njobs = 0;
+static size_t __next = 0;  // index of the next job to take, shared by workers
+static tmixldr_internal_check_stage __stage = TMIXLDR_INTERNAL_CHECK_PARSE;
+static const char *__cache_dir = NULL;
+static pthread_mutex_t __mutex = PTHREAD_MUTEX_INITIALIZER;  // guards done of jobs
+static pthread_cond_t __cond = PTHREAD_COND_INITIALIZER;  // signaled once a job is done
+
+/*
+ * returns whether ei is a shared library rather than a program
+ */
+static bool __is_library(const tmixelf_info *ei) {
+    return ei->soname || !ei->entry;
+}
+
+/*
+ * take the file of job through all stages asked
+ */
+static void __check(__job *job) {
+    int fd = open(job->path, O_RDONLY);
+
+    job->failed = TMIXLDR_INTERNAL_CHECK_PARSE;
+
+    if (fd < 0 || tmixelf_parse_info_cached(fd, __cache_dir, &job->ei) < 0)
+        goto error;
+
+    job->parsed = true;
+
+    // exports of libraries are only looked up with a GNU hash table
+    if (__is_library(&job->ei) && !job->ei.hashtab.nbuckets) {
+        errno = ENOTSUP;
+        goto error;
+    }
+
+    if (__stage >= TMIXLDR_INTERNAL_CHECK_MAP) {
+        tmixldr_elf e = {};
+
+        job->failed = TMIXLDR_INTERNAL_CHECK_MAP;
+
+        if (tmixldr_load_elf(fd, &job->ei, &e) < 0)
+            goto error;
+
+        tmixldr_unload_elf(&e, &job->ei);
+    }
+
+    if (__stage >= TMIXLDR_INTERNAL_CHECK_LINK) {
+        job->failed = TMIXLDR_INTERNAL_CHECK_LINK;
+
+        if (tmixdynld_check_elf(&job->ei, __cache_dir, &job->check) < 0)
+            goto error;
+
+        if (job->check.missing_libs || job->check.missing_syms) {
+            job->err = 0;
+            goto exit;
+        }
+    }
+
+    job->failed = TMIXLDR_INTERNAL_CHECK_NSTAGES;
+
+    goto exit;
+
+error:
+    job->err = errno;
+
+exit:
+    if (fd >= 0)
+        close(fd);
+}
+
+static void *__worker(void *arg) {
+    (void) arg;
+
+    for (;;) {
+        size_t i = __atomic_fetch_add(&__next, 1, __ATOMIC_RELAXED);
+
+        if (i >= __njobs)
+            return NULL;
+
+        __check(&__jobs[i]);
+
+        pthread_mutex_lock(&__mutex);
+        __jobs[i].done = true;
+        pthread_cond_broadcast(&__cond);
+        pthread_mutex_unlock(&__mutex);
+    }
+}
+
+/*
+ * print str as a JSON string, NULL as null
+ */
+static void __print_str(const char *str) {
+    if (!str) {
+        fputs("null", stdout);
+        return;
+    }
+
+    putchar('"');
+
+    for (; *str; str++) {
+        unsigned char c = *str;
+
+        if (c == '"' || c == '\\')
+            printf("\\%c", c);
+        else if (c < 0x20)
+            printf("\\u%04x", c);
+        else
+            putchar(c);
+    }
+
+    putchar('"');
+}
+
+/*
+ * print the record of job as a single line
+ */
+static void __print_job(const __job *job, bool info) {
+    bool ok = job->failed == TMIXLDR_INTERNAL_CHECK_NSTAGES;
+
+    fputs("{\"path\":", stdout);
+    __print_str(job->path);
+    printf(",\"ok\":%s,\"failed\":", ok ? "true" : "false");
+    __print_str(ok ? NULL : __stage_names[job->failed]);
+    fputs(",\"error\":", stdout);
+
+    if (ok)
+        fputs("null", stdout);
+    else if (job->err)
+        __print_str(strerror(job->err));
+    else
+        __print_str(job->check.missing_libs ? "library not found" : "symbol not found");
+
+    if (__stage >= TMIXLDR_INTERNAL_CHECK_LINK && (ok || job->failed == TMIXLDR_INTERNAL_CHECK_LINK)) {
+        const tmixdynld_check *check = &job->check;
+
+        printf(",\"libs\":%zu,\"imports\":%zu,\"missing_libs\":%zu,\"missing_syms\":%zu,\"first_missing_lib\":",
+               check->libs, check->imports, check->missing_libs, check->missing_syms);
+        __print_str(check->first_missing_lib);
+        fputs(",\"first_missing_sym\":", stdout);
+        __print_str(check->first_missing_sym);
+    }
+
+    if (info && job->parsed) {
+        const tmixelf_info *ei = &job->ei;
+        const char *const *needs = ei->needs.data;  // array
+        const unsigned char *build_id = ei->build_id.data;  // array
+        size_t i;
+
+        printf(",\"segments\":%zu,\"mem_size\":%zu,\"align\":%zu,\"entry\":%zu,\"soname\":",
+               ei->segs.size, ei->mem_size, ei->align, ei->entry);
+        __print_str(ei->soname);
+        fputs(",\"needs\":[", stdout);
+
+        for (i = 0; i < ei->needs.size; i++) {
+            if (i)
+                putchar(',');
+
+            __print_str(needs[i]);
+        }
+
+        printf("],\"syms\":%zu,\"relocs\":%zu,\"relatives\":%zu,\"relr\":%zu,\"relros\":%zu,"
+               "\"bind_now\":%s,\"execstack\":%s,\"build_id\":",
+               ei->syms.size, ei->relocs.size, ei->relatives.size, ei->relr.size, ei->relros.size,
+               ei->bind_now ? "true" : "false", ei->execstack ? "true" : "false");
+
+        if (!ei->build_id.size)
+            fputs("null", stdout);
+        else {
+            putchar('"');
+
+            for (i = 0; i < ei->build_id.size; i++)
+                printf("%02x", build_id[i]);
+
+            putchar('"');
+        }
+    }
+
+    fputs("}\n", stdout);
+}
+
+/*
+ * append the paths listed in the file at list_path, one per line, to paths
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __read_list(const char *list_path, char ***paths, size_t *count, size_t *capacity) {
+    FILE *fp = strcmp(list_path, "-") ? fopen(list_path, "r") : stdin;
+    char *line = NULL;
+    size_t line_size = 0;
+    ssize_t len;
+    int ret = -1;
+
+    if (!fp)
+        return -1;
+
+    while ((len = getline(&line, &line_size, fp)) >= 0) {
+        while (len && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+            line[--len] = '\0';
+
+        if (!len)
+            continue;  // blank lines are fine
+
+        if (*count == *capacity) {
+            size_t new_capacity = *capacity ? 2 * *capacity : 64;
+            char **new_paths = realloc(*paths, new_capacity * sizeof(char *));
+
+            if (!new_paths)
+                goto exit;
+
+            *paths = new_paths;
+            *capacity = new_capacity;
+        }
+
+        if (!((*paths)[*count] = strdup(line)))
+            goto exit;
+
+        (*count)++;
+    }
+
+    if (ferror(fp))
+        goto exit;
+
+    ret = 0;
+
+exit:
+    ;  // dummy statement after jump label to make compiler happy
+
+    int saved_errno = errno;
+
+    free(line);
+
+    if (fp != stdin)
+        fclose(fp);
+
+    errno = saved_errno;
+
+    return ret;
+}
+
+static uint64_t __now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int _tmixldr_internal_batch(const char *const *args, size_t count, tmixldr_internal_check_stage stage,
+                            bool info, size_t nthreads, const char *cache_dir) {
+    char **paths = NULL;  // array, all owned
+    size_t npaths = 0;
+    size_t capacity = 0;
+    pthread_t *threads = NULL;
+    size_t nstarted = 0;
+    size_t i;
+    int ret = -1;
+
+    // expand lists first, so records are numbered as given
+
+    for (i = 0; i < count; i++) {
+        if (args[i][0] == '@') {
+            if (__read_list(args[i] + 1, &paths, &npaths, &capacity) < 0) {
+                fprintf(stderr, "error reading list %s: %s\n", args[i] + 1, strerror(errno));
+                goto exit;
+            }
+
+            continue;
+        }
+
+        if (npaths == capacity) {
+            size_t new_capacity = capacity ? 2 * capacity : 64;
+            char **new_paths = realloc(paths, new_capacity * sizeof(char *));
+
+            if (!new_paths)
+                goto nomem;
+
+            paths = new_paths;
+            capacity = new_capacity;
+        }
+
+        if (!(paths[npaths] = strdup(args[i])))
+            goto nomem;
+
+        npaths++;
+    }
+
+    if (!npaths) {
+        fprintf(stderr, "no elf file to check\n");
+
+        errno = EINVAL;
+        goto exit;
+    }
+
+    if (!nthreads) {
+        long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+        nthreads = ncpus > 0 ? ncpus : 1;
+    }
+
+    if (nthreads > npaths)
+        nthreads = npaths;
+
+    if (!(__jobs = calloc(npaths, sizeof(__job))) || !(threads = calloc(nthreads, sizeof(pthread_t))))
+        goto nomem;
+
+    for (i = 0; i < npaths; i++)
+        __jobs[i].path = paths[i];
+
+    __njobs = npaths;
+    __next = 0;
+    __stage = stage;
+    __cache_dir = cache_dir;
+
+    uint64_t start = __now_ns();
+
+    for (nstarted = 0; nstarted < nthreads; nstarted++) {
+        int err = pthread_create(&threads[nstarted], NULL, __worker, NULL);
+
+        if (err) {
+            // the ones started take all jobs anyway
+            if (!nstarted) {
+                errno = err;
+                perror("error starting threads");
+                goto exit;
+            }
+
+            break;
+        }
+    }
+
+    // records are printed as soon as all earlier ones are, jobs are released right after
+
+    size_t failed[TMIXLDR_INTERNAL_CHECK_NSTAGES] = {};
+    size_t nfailed = 0;
+
+    for (i = 0; i < npaths; i++) {
+        __job *job = &__jobs[i];
+
+        pthread_mutex_lock(&__mutex);
+
+        while (!job->done)
+            pthread_cond_wait(&__cond, &__mutex);
+
+        pthread_mutex_unlock(&__mutex);
+
+        __print_job(job, info);
+
+        if (job->failed != TMIXLDR_INTERNAL_CHECK_NSTAGES) {
+            failed[job->failed]++;
+            nfailed++;
+        }
+
+        if (job->parsed)
+            tmixelf_free_info(&job->ei);
+    }
+
+    fflush(stdout);
+
+    fprintf(stderr, "checked %zu files in %.1f ms with %zu threads: %zu passed, %zu failed",
+            npaths, (__now_ns() - start) / 1e6, nstarted, npaths - nfailed, nfailed);
+
+    if (nfailed) {
+        fprintf(stderr, " (parse %zu, map %zu, link %zu)", failed[TMIXLDR_INTERNAL_CHECK_PARSE],
+                failed[TMIXLDR_INTERNAL_CHECK_MAP], failed[TMIXLDR_INTERNAL_CHECK_LINK]);
+    }
+
+    fprintf(stderr, "\n");
+
+    ret = nfailed ? 1 : 0;
+    goto exit;
+
+nomem:
+    perror("error preparing batch");
+
+exit:
+    ;  // dummy statement after jump label to make compiler happy
+
+    int saved_errno = errno;
+
+    for (i = 0; i < nstarted; i++)
+        pthread_join(threads[i], NULL);
+
+    for (i = 0; i < npaths; i++)
+        free(paths[i]);
+
+    free(paths);
+    free(threads);
+    free(__jobs);
+    __jobs = NULL;
+    __njobs = 0;
+    errno = saved_errno;
+
+    return ret;
+}
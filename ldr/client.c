@@ -0,0 +1,202 @@
+/*
+  client.c - Client of the ELF loader fork server
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "_server.h"
+
+extern char **environ;  // passed to the program
+
+/*
+ * returns 0 if all size bytes are written, otherwise -1 and sets errno
+ */
+static int __write_full(int fd, const void *buff, size_t size) {
+    while (size) {
+        ssize_t ret = write(fd, buff, size);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret < 0)
+            return -1;
+
+        buff = (const char *) buff + ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+/*
+ * strs - strings ending with NULL
+ * count - output, number of strings
+ *
+ * returns the total size of strs including NULs
+ */
+static size_t __strings_size(char *const *strs, uint32_t *count) {
+    size_t size = 0;
+
+    for (*count = 0; strs[*count]; (*count)++)
+        size += strlen(strs[*count]) + 1;
+
+    return size;
+}
+
+/*
+ * returns 0 if all strs, ending with NULL, are written with their NULs, otherwise -1 and sets errno
+ */
+static int __write_strings(int fd, char *const *strs) {
+    for (; *strs; strs++) {
+        if (__write_full(fd, *strs, strlen(*strs) + 1) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * entrypoint, kept free of termix libraries, so starting it costs nothing but the process
+ */
+int main(int argc, char **argv) {
+    bool debug = false;
+    int c;
+
+    // options after the path belong to the program
+    while ((c = getopt(argc, argv, "+d")) != -1) {
+        switch (c) {
+            case 'd':
+                debug = true;
+                break;
+            default:
+usage_and_exit:
+                fprintf(stderr, "Usage: %s [-d] <socket> <elf file> [arg...]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (argc - optind < 2)
+        goto usage_and_exit;
+
+    const char *sock_path = argv[optind];
+    char *const *prog_argv = &argv[optind + 1];  // the path being argv[0]
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path is too long\n");
+        return EXIT_FAILURE;
+    }
+
+    strcpy(addr.sun_path, sock_path);
+
+    // the program runs in our working directory
+
+    char cwd[PATH_MAX];
+
+    if (!getcwd(cwd, sizeof(cwd))) {
+        perror("error getting working directory");
+        return EXIT_FAILURE;
+    }
+
+    // so do our arguments and environment
+
+    uint32_t prog_argc, envc;
+    size_t cwd_size = strlen(cwd) + 1;
+    size_t argv_size = __strings_size(prog_argv, &prog_argc);
+    size_t envp_size = __strings_size(environ, &envc);
+
+    if (cwd_size + argv_size + envp_size > TMIXLDR_INTERNAL_REQUEST_MAX_SIZE) {
+        fprintf(stderr, "arguments and environment are too long\n");
+        return EXIT_FAILURE;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("error connecting to server");
+        return EXIT_FAILURE;
+    }
+
+    // stdio is sent with the header, the strings follow
+
+    tmixldr_internal_request req = {
+        .magic = TMIXLDR_INTERNAL_REQUEST_MAGIC,
+        .flags = debug ? TMIXLDR_INTERNAL_REQUEST_DEBUG : 0,
+        .size = cwd_size + argv_size + envp_size,
+        .argc = prog_argc,
+        .envc = envc,
+    };
+    int fds[3] = { STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO };
+    union {
+        char buff[CMSG_SPACE(sizeof(fds))];
+        struct cmsghdr align;
+    } control = {};
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buff,
+        .msg_controllen = sizeof(control.buff),
+    };
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    ssize_t ret;
+
+    while ((ret = sendmsg(fd, &msg, 0)) < 0 && errno == EINTR);
+
+    if (ret < 0 || __write_full(fd, (char *) &req + ret, sizeof(req) - ret) < 0
+        || __write_full(fd, cwd, cwd_size) < 0 || __write_strings(fd, prog_argv) < 0
+        || __write_strings(fd, environ) < 0) {
+        perror("error sending request");
+        return EXIT_FAILURE;
+    }
+
+    // then wait for the program to exit
+
+    int32_t code;
+    size_t got = 0;
+
+    while (got < sizeof(code)) {
+        ret = read(fd, (char *) &code + got, sizeof(code) - got);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret <= 0) {
+            fprintf(stderr, "server closed the connection unexpectedly\n");
+            return EXIT_FAILURE;
+        }
+
+        got += ret;
+    }
+
+    return code;
+}
@@ -0,0 +1,992 @@
+/*
+  deps.c - Libraries required by loaded images
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#define _GNU_SOURCE  // for dl_iterate_phdr and dlinfo
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifdef _WIN32
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <dlfcn.h>
+#  ifndef __APPLE__
+#    include <link.h>
+#  endif
+#endif
+
+#include "../inc/paths.h"
+#include "../inc/probes.h"
+#include "../inc/types.h"
+
+#include "elf/elf.h"
+
+#include "_deps.h"
+#include "_relcache.h"
+#include "_symmap.h"
+#include "load.h"
+
+// test libraries are installed here until real ones are shipped
+#define _LIB_DIR                  "../share/termix/tests"
+
+#ifdef _WIN32
+#  define _PATH_LIST_SEP          ';'
+#else
+#  define _PATH_LIST_SEP          ':'
+#endif
+
+static tmixdynld_internal_lib *__libs = NULL;  // global scope, in breadth-first order
+static size_t __nlibs = 0;
+static size_t __libs_capacity = 0;
+static bool __preloaded = false;
+
+/*
+ * a library found by checks, apart from the global scope, never released
+ */
+typedef struct {
+    char *name;  // name required by DT_NEEDED, or path of the preloaded one
+    tmixelf_info *ei;  // only if parsed
+    void *handle;  // only if loaded by the host already, both NULL if not found at all
+} __checked_lib;
+
+// shared by all checks, entries are allocated one by one, so they never move
+static __checked_lib **__checked = NULL;
+static size_t __nchecked = 0;
+static size_t __checked_capacity = 0;
+static pthread_mutex_t __checked_lock = PTHREAD_MUTEX_INITIALIZER;  // only held to look up or append entries
+
+#ifdef __linux__  // where dlinfo is available
+#  define _HAVE_LINKMAP
+
+/*
+ * collect the address range, build ID, soname and needs of the loaded library
+ * whose base and path are in lm
+ */
+static int __inspect_phdrs(struct dl_phdr_info *info, size_t size, void *data) {
+    (void) size;
+
+    tmixdynld_internal_lib *lib = ((void **) data)[0];
+    const struct link_map *lm = ((void **) data)[1];
+
+    if (info->dlpi_addr != lm->l_addr || !info->dlpi_name || strcmp(info->dlpi_name, lm->l_name))
+        return 0;
+
+    tmixdynld_internal_provider *p = &lib->provider;
+    const ElfW(Dyn) *dyns = NULL;
+    size_t i;
+
+    p->base = info->dlpi_addr;
+    p->start = UINTPTR_MAX;
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        uintptr_t addr = info->dlpi_addr + phdr->p_vaddr;
+
+        if (phdr->p_type == PT_LOAD) {
+            if (addr < p->start)
+                p->start = addr;
+
+            if (addr + phdr->p_memsz > p->end)
+                p->end = addr + phdr->p_memsz;
+        } else if (phdr->p_type == PT_DYNAMIC)
+            dyns = (const ElfW(Dyn) *) addr;
+        else if (phdr->p_type == PT_NOTE) {
+            // notes are already mapped, walk them in place
+            size_t align = phdr->p_align == 8 ? 8 : 4;
+            size_t off = 0;
+
+            while (off + sizeof(ElfW(Nhdr)) <= phdr->p_memsz) {
+                const ElfW(Nhdr) *nhdr = (const ElfW(Nhdr) *) (addr + off);
+                size_t desc_off = (off + sizeof(*nhdr) + nhdr->n_namesz + align - 1) & ~(align - 1);
+
+                if (desc_off + nhdr->n_descsz > phdr->p_memsz)
+                    break;
+
+                if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == sizeof("GNU")
+                    && !memcmp(nhdr + 1, "GNU", sizeof("GNU"))) {
+                    p->build_id.data = (void *) (addr + desc_off);
+                    p->build_id.size = nhdr->n_descsz;
+                }
+
+                off = (desc_off + nhdr->n_descsz + align - 1) & ~(align - 1);
+            }
+        }
+    }
+
+    if (!dyns)
+        return 1;
+
+    // the dynamic section is mapped as well, count needs and find the string table first
+
+    const ElfW(Dyn) *dyn;
+    uintptr_t strtab = 0;
+    size_t soname = SIZE_MAX;
+
+    for (dyn = dyns; dyn->d_tag != DT_NULL; dyn++) {
+        if (dyn->d_tag == DT_NEEDED)
+            lib->nneeds++;
+        else if (dyn->d_tag == DT_STRTAB)
+            strtab = dyn->d_un.d_ptr;
+        else if (dyn->d_tag == DT_SONAME)
+            soname = dyn->d_un.d_val;
+    }
+
+    // glibc relocates the address in place, others might not
+    if (strtab < info->dlpi_addr)
+        strtab += info->dlpi_addr;
+
+    const char **needs = NULL;
+
+    if (!strtab || !lib->nneeds || !(needs = calloc(lib->nneeds, sizeof(const char *))))
+        lib->nneeds = 0;  // needs are unknown then
+
+    for (dyn = dyns, i = 0; dyn->d_tag != DT_NULL && needs; dyn++) {
+        if (dyn->d_tag == DT_NEEDED)
+            needs[i++] = (const char *) (strtab + dyn->d_un.d_val);
+    }
+
+    lib->needs = needs;
+
+    if (strtab && soname != SIZE_MAX)
+        lib->soname = (const char *) (strtab + soname);
+
+    return 1;
+}
+#endif /* _HAVE_LINKMAP */
+
+/*
+ * collect everything about lib known to the host loader, fields stay zero if unknown
+ */
+static void __inspect(tmixdynld_internal_lib *lib) {
+#ifdef _HAVE_LINKMAP
+    struct link_map *lm = NULL;
+    struct stat st;
+
+    if (dlinfo(lib->handle, RTLD_DI_LINKMAP, &lm) < 0 || !lm)
+        return;
+
+    if (lm->l_name && *lm->l_name && !stat(lm->l_name, &st)) {
+        lib->dev = st.st_dev;
+        lib->ino = st.st_ino;
+    }
+
+    dl_iterate_phdr(__inspect_phdrs, (void *[]) {lib, lm});
+#else
+    (void) lib;
+#endif
+}
+
+/*
+ * dirs - directories separated by _PATH_LIST_SEP, NULL for none
+ *
+ * returns the path of name in the first directory having it, the caller should free it, NULL if not found
+ */
+static char *__search_list(const char *dirs, const char *name) {
+    char *path;
+
+    while (dirs && *dirs) {
+        const char *end = strchr(dirs, _PATH_LIST_SEP);
+        size_t len = end ? (size_t) (end - dirs) : strlen(dirs);
+        char *dir = strndup(dirs, len);
+
+        if (!dir)
+            return NULL;
+
+        // an empty entry means the current directory
+        path = _tmix_join_path(*dir ? dir : ".", name);
+        free(dir);
+
+        if (path && !access(path, F_OK))
+            return path;
+
+        free(path);
+        dirs = end ? end + 1 : NULL;
+    }
+
+    return NULL;
+}
+
+/*
+ * returns the path of name in TMIXDYNLD_LIBRARY_PATH or the directory of test libraries,
+ * the caller should free it, NULL if not found there
+ */
+static char *__search(const char *name) {
+    char *path = __search_list(getenv("TMIXDYNLD_LIBRARY_PATH"), name);
+
+    if (path)
+        return path;
+
+    if (!_tmix_progdir)
+        return NULL;  // sth went wrong during startup
+
+    char *dir = _tmix_join_path(_tmix_progdir, _LIB_DIR);
+
+    if (!dir)
+        return NULL;
+
+    path = _tmix_join_path(dir, name);
+    free(dir);
+
+    if (path && !access(path, F_OK))
+        return path;
+
+    free(path);
+
+    return NULL;
+}
+
+static void *__open(const char *path) {
+#ifdef _WIN32
+    return LoadLibrary(path);
+#else
+    return dlopen(path, RTLD_LAZY);
+#endif
+}
+
+/*
+ * same as __open, but only if the host has loaded it already, so nothing of it runs
+ */
+static void *__open_loaded(const char *name) {
+#ifdef _WIN32
+    HMODULE handle = NULL;
+
+    // takes a reference as LoadLibrary does
+    return GetModuleHandleExA(0, name, &handle) ? handle : NULL;
+#else
+    return dlopen(name, RTLD_LAZY | RTLD_NOLOAD);
+#endif
+}
+
+#ifdef _HAVE_LINKMAP
+/*
+ * look for a file named ((void **) data)[0] next to each library loaded by the host,
+ * the first one found is stored in ((void **) data)[1]
+ */
+static int __search_loaded_dirs(struct dl_phdr_info *info, size_t size, void *data) {
+    (void) size;
+
+    const char *slash = info->dlpi_name ? strrchr(info->dlpi_name, '/') : NULL;
+
+    if (!slash)
+        return 0;
+
+    char *dir = strndup(info->dlpi_name, slash - info->dlpi_name);
+    char *path = dir ? _tmix_join_path(*dir ? dir : "/", ((void **) data)[0]) : NULL;
+
+    free(dir);
+
+    if (path && !access(path, F_OK)) {
+        ((void **) data)[1] = path;
+        return 1;
+    }
+
+    free(path);
+
+    return 0;
+}
+#endif
+
+/*
+ * returns the path the host would most likely load name from, the caller should free it,
+ * NULL if not found
+ *
+ * only LD_LIBRARY_PATH, directories of loaded libraries and a few usual ones are searched
+ */
+static char *__search_host(const char *name) {
+#ifdef _WIN32
+    (void) name;
+
+    return NULL;
+#else
+    char *path = __search_list(getenv("LD_LIBRARY_PATH"), name);
+
+#ifdef _HAVE_LINKMAP
+    void *data[2] = {(void *) name, NULL};
+
+    if (!path && dl_iterate_phdr(__search_loaded_dirs, data))
+        path = data[1];
+#endif
+
+    if (!path)
+        path = __search_list("/lib64:/usr/lib64:/lib:/usr/lib:/usr/local/lib", name);
+
+    return path;
+#endif
+}
+
+static void __close(void *handle) {
+#ifdef _WIN32
+    FreeLibrary(handle);
+#else
+    dlclose(handle);
+#endif
+}
+
+/*
+ * returns whether name is loaded already, by the required name or the soname,
+ * libraries loaded by path also match their file names, as they might have no soname
+ */
+static bool __is_loaded(const char *name) {
+    size_t i;
+
+    for (i = 0; i < __nlibs; i++) {
+        const char *file_name = strrchr(__libs[i].name, '/');
+
+        if (!strcmp(__libs[i].name, name) || (__libs[i].soname && !strcmp(__libs[i].soname, name))
+            || (file_name && !strcmp(file_name + 1, name)))
+            return true;
+    }
+
+    return false;
+}
+
+/*
+ * load the library at path by ourselves, relocations are left to the caller
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, lib is untouched then,
+ * ENOTSUP if it has no GNU hash table, since its exports could not be looked up
+ */
+static int __load_native(const char *path, const char *cache_dir, tmixdynld_internal_lib *lib) {
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return -1;
+
+    tmixelf_info *ei = calloc(1, sizeof(tmixelf_info));
+    tmixldr_elf e = {};
+    int saved_errno;
+
+#ifndef _WIN32
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        goto error;
+#endif
+
+    if (!ei || tmixelf_parse_info_cached(fd, cache_dir, ei) < 0)
+        goto error;
+
+    if (!ei->hashtab.nbuckets) {
+        tmixelf_free_info(ei);
+        errno = ENOTSUP;
+
+        goto error;
+    }
+
+    if (tmixldr_load_elf(fd, ei, &e) < 0) {
+        saved_errno = errno;
+        tmixelf_free_info(ei);
+        errno = saved_errno;
+
+        goto error;
+    }
+
+    close(fd);
+
+    lib->native = true;
+    lib->base = e.base;
+    lib->ei = ei;
+    lib->soname = ei->soname;
+    lib->provider = (tmixdynld_internal_provider) {(uintptr_t) e.base, (uintptr_t) e.base,
+                                                   (uintptr_t) e.base + ei->mem_size, ei->build_id};
+#ifndef _WIN32
+    lib->dev = st.st_dev;
+    lib->ino = st.st_ino;
+#endif
+    lib->needs = ei->needs.data;
+    lib->nneeds = ei->needs.size;
+
+    return 0;
+
+error:
+    saved_errno = errno;
+    free(ei);
+    close(fd);
+    errno = saved_errno;
+
+    return -1;
+}
+
+/*
+ * release a library not appended to the global scope
+ */
+static void __unload(tmixdynld_internal_lib *lib) {
+    if (lib->native) {
+        tmixldr_elf e = {.base = lib->base};
+
+        tmixldr_unload_elf(&e, lib->ei);
+        tmixelf_free_info(lib->ei);
+        free(lib->ei);
+    } else {
+        __close(lib->handle);
+        free((void *) lib->needs);
+    }
+}
+
+/*
+ * name - required name, or a path if it contains a slash
+ * search - whether to search our directories and load it natively before asking the host,
+ *          false for the preloaded one and the libraries required by the host ones,
+ *          which are loaded by the host already
+ * cache_dir - directory caching parsed information, NULL to disable caching
+ *
+ * load the library and append it to the global scope, unless it's loaded already,
+ * it's loaded natively if found by us, otherwise by the host
+ *
+ * returns 0 if succeed, otherwise prints the error, returns -1 and sets errno
+ */
+static int __add_lib(const char *name, bool search, const char *cache_dir) {
+    if (__is_loaded(name))
+        return 0;
+
+    char *path = search && !strchr(name, '/') ? __search(name) : NULL;
+    const char *file = path ? path : search && strchr(name, '/') ? name : NULL;
+    tmixdynld_internal_lib lib = {};
+
+    // files we cannot handle are still left to the host, e.g. built for the host or without a GNU hash table
+
+    if (!file || __load_native(file, cache_dir, &lib) < 0)
+        lib.handle = __open(file ? file : name);
+
+    free(path);
+
+    if (!lib.native && !lib.handle) {
+#ifdef _WIN32
+        // TODO: use FormatMessage to print human readable error message
+        fprintf(stderr, "error while loading library %s: WinError %ld\n", name, GetLastError());
+#else
+        const char *err = dlerror();
+
+        if (err)
+            fprintf(stderr, "error while loading library %s: %s\n", name, err);
+        else
+            fprintf(stderr, "unknown error while loading library %s\n", name);
+#endif
+
+        errno = ENOENT;
+        return -1;
+    }
+
+    if (!lib.native)
+        __inspect(&lib);
+
+    // a file is loaded only once, though it might be required by other names
+
+    size_t i;
+
+    for (i = 0; i < __nlibs; i++) {
+        if ((lib.handle && __libs[i].handle == lib.handle)
+#ifndef _WIN32
+            || (lib.ino && __libs[i].dev == lib.dev && __libs[i].ino == lib.ino)
+#endif
+            ) {
+            __unload(&lib);
+
+            return 0;
+        }
+    }
+
+    if (__nlibs == __libs_capacity) {
+        size_t capacity = __libs_capacity ? 2 * __libs_capacity : 8;
+        tmixdynld_internal_lib *libs = realloc(__libs, capacity * sizeof(tmixdynld_internal_lib));
+
+        if (!libs)
+            goto error;
+
+        __libs = libs;
+        __libs_capacity = capacity;
+    }
+
+    if (!(lib.name = strdup(name)))
+        goto error;
+
+    __libs[__nlibs++] = lib;
+    _tmixdynld_internal_symmap_scope_grown();  // it might define symbols missing so far
+
+    _tmix_probe3(lib_open, lib.name, lib.native, lib.native ? lib.base : lib.handle);
+
+    return 0;
+
+error:
+    perror("error while loading library");
+
+    __unload(&lib);
+
+    return -1;
+}
+
+int _tmixdynld_internal_load_deps(const tmixelf_info *ei, const char *cache_dir) {
+    return _tmixdynld_internal_load_libs(ei->needs.data, ei->needs.size, cache_dir);
+}
+
+int _tmixdynld_internal_load_libs(const char *const *names, size_t count, const char *cache_dir) {
+    size_t first = __nlibs;  // libraries loaded by this call
+    size_t i, j;
+
+    if (!__preloaded) {
+        const char *libc_path = getenv("TMIXDYNLD_LIBC_PATH");
+
+        __preloaded = true;
+
+        if (libc_path && __add_lib(libc_path, false, cache_dir) < 0) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        if (__add_lib(names[i], true, cache_dir) < 0)
+            return -1;
+    }
+
+    // then walk the graph breadth first, the list itself is the queue,
+    // needs of native libraries are searched as the ones of images
+
+    for (i = first; i < __nlibs; i++) {
+        for (j = 0; j < __libs[i].nneeds; j++) {
+            if (__add_lib(__libs[i].needs[j], __libs[i].native, cache_dir) < 0)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+tmixdynld_internal_lib *_tmixdynld_internal_get_deps(size_t *count) {
+    *count = __nlibs;
+
+    return __libs;
+}
+
+/*
+ * lib - a library loaded by the host
+ * outside - output, whether the definition found is in another library
+ *
+ * returns the address of name the host finds from lib, NULL if not found
+ */
+static void *__lookup_host(const tmixdynld_internal_lib *lib, const char *name, bool *outside) {
+#ifdef _WIN32
+    void *the_sym = GetProcAddress(lib->handle, name);
+#else
+    void *the_sym = dlsym(lib->handle, name);
+#endif
+
+    // the host also searches dependencies of the library, which come later in our scope,
+    // so only take definitions inside the library itself if its range is known
+
+    *outside = the_sym && lib->provider.end
+               && ((uintptr_t) the_sym < lib->provider.start || (uintptr_t) the_sym >= lib->provider.end);
+
+    return the_sym;
+}
+
+void *_tmixdynld_internal_lookup_deps(const char *name, uint32_t hash, const char **provider) {
+    void *first_found = NULL;
+    const char *first_provider = NULL;
+    size_t i;
+
+    for (i = 0; i < __nlibs; i++) {
+        const tmixdynld_internal_lib *lib = &__libs[i];
+
+        if (lib->native) {
+            // exported symbols are looked up by ourselves
+            const tmixelf_sym *sym = tmixelf_lookup_sym(lib->ei, name, hash);
+
+            if (sym) {
+                *provider = lib->name;
+                return (char *) lib->base + sym->off;
+            }
+
+            continue;
+        }
+
+        bool outside;
+        void *the_sym = __lookup_host(lib, name, &outside);
+
+        if (!the_sym)
+            continue;
+
+        if (!outside) {
+            *provider = lib->name;
+            return the_sym;
+        }
+
+        if (!first_found) {
+            first_found = the_sym;
+            first_provider = lib->name;
+        }
+    }
+
+    // defined in a library not in our scope, e.g. its needs are unknown
+    if (first_found)
+        *provider = first_provider;
+
+    return first_found;
+}
+
+int _tmixdynld_internal_lookup_deps_batch(const tmixelf_sym *syms, size_t n, void **addrs, const char **providers) {
+    // symbols still missing are kept at the front of a copy, with their indices in syms,
+    // since images take a contiguous batch
+
+    tmixelf_sym *pending = malloc(n * sizeof(tmixelf_sym));
+    size_t *idx = malloc(n * sizeof(size_t));
+    const tmixelf_sym **found = malloc(n * sizeof(const tmixelf_sym *));
+    size_t npending = n;
+    size_t i, j, k;
+
+    if (n && (!pending || !idx || !found)) {
+        free(pending);
+        free(idx);
+        free(found);
+
+        return -1;
+    }
+
+    for (i = 0; i < n; i++) {
+        pending[i] = syms[i];
+        idx[i] = i;
+        addrs[i] = NULL;
+        providers[i] = NULL;
+    }
+
+    for (i = 0; i < __nlibs && npending; i++) {
+        const tmixdynld_internal_lib *lib = &__libs[i];
+
+        if (lib->native)
+            tmixelf_lookup_syms(lib->ei, pending, npending, found);
+
+        for (j = k = 0; j < npending; j++) {
+            bool outside = false;
+            void *the_sym = lib->native ? (found[j] ? (char *) lib->base + found[j]->off : NULL)
+                                        : __lookup_host(lib, pending[j].name, &outside);
+
+            // the first definition outside of our scope is taken unless one is found later
+            if (the_sym && (!outside || !addrs[idx[j]])) {
+                addrs[idx[j]] = the_sym;
+                providers[idx[j]] = lib->name;
+            }
+
+            if (the_sym && !outside)
+                continue;
+
+            pending[k] = pending[j];
+            idx[k++] = idx[j];
+        }
+
+        npending = k;
+    }
+
+    free(pending);
+    free(idx);
+    free(found);
+
+    return 0;
+}
+
+int _tmixdynld_internal_lookup_tls(const char *name, uint32_t hash, ssize_t *module_off, size_t *sym_off) {
+    size_t i;
+
+    for (i = 0; i < __nlibs; i++) {
+        const tmixdynld_internal_lib *lib = &__libs[i];
+
+        if (lib->native) {
+            const tmixelf_sym *sym = tmixelf_lookup_sym(lib->ei, name, hash);
+
+            if (!sym)
+                continue;
+
+            if (sym->type != TMIXELF_SYM_TLS || !lib->ei->tls.size) {
+                errno = EINVAL;
+                return -1;
+            }
+
+            *module_off = lib->tls_off;
+            *sym_off = sym->off;
+
+            return 0;
+        }
+
+        // libraries opened by us might have their blocks allocated lazily by the host,
+        // at a different offset in each thread, so there is no offset to bind to
+#ifdef _WIN32
+        if (GetProcAddress(lib->handle, name)) {
+#else
+        if (dlsym(lib->handle, name)) {
+#endif
+            errno = ENOTSUP;
+            return -1;
+        }
+    }
+
+    errno = ENOENT;
+    return -1;
+}
+
+/*
+ * returns the checked library required as name, NULL if not checked yet
+ */
+static __checked_lib *__find_checked(const char *name) {
+    size_t i;
+
+    for (i = 0; i < __nchecked; i++) {
+        if (!strcmp(__checked[i]->name, name))
+            return __checked[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * name - required name, or a path if it contains a slash
+ * search - same as __add_lib
+ *
+ * find the library the same way as __add_lib, but never run anything of it: the ones found by us
+ * are parsed, the host ones are taken if it has loaded them already, otherwise parsed as well
+ * if found where the host searches, anything else is missing
+ *
+ * results are remembered, missing libraries as well
+ *
+ * returns the library if succeed, otherwise NULL and sets errno
+ */
+static const __checked_lib *__check_lib(const char *name, bool search, const char *cache_dir) {
+    pthread_mutex_lock(&__checked_lock);
+    __checked_lib *found = __find_checked(name);
+    pthread_mutex_unlock(&__checked_lock);
+
+    if (found)
+        return found;
+
+    char *path = search && !strchr(name, '/') ? __search(name) : NULL;
+    const char *file = path ? path : search && strchr(name, '/') ? name : NULL;
+    __checked_lib *lib = calloc(1, sizeof(__checked_lib));
+
+    if (!lib || !(lib->name = strdup(name))) {
+        free(lib);
+        free(path);
+
+        return NULL;
+    }
+
+    if (!file && !(lib->handle = __open_loaded(name)))
+        file = path = __search_host(name);
+
+    if (file) {
+        int fd = open(file, O_RDONLY);
+
+        if (fd >= 0 && (lib->ei = calloc(1, sizeof(tmixelf_info)))
+            && tmixelf_parse_info_cached(fd, cache_dir, lib->ei) < 0) {
+            free(lib->ei);
+            lib->ei = NULL;
+        }
+
+        if (fd >= 0)
+            close(fd);
+    }
+
+    free(path);
+
+    // another check might have found it meanwhile, the first one is kept
+
+    pthread_mutex_lock(&__checked_lock);
+
+    if ((found = __find_checked(name)))
+        goto discard;
+
+    if (__nchecked == __checked_capacity) {
+        size_t capacity = __checked_capacity ? 2 * __checked_capacity : 16;
+        __checked_lib **checked = realloc(__checked, capacity * sizeof(__checked_lib *));
+
+        if (!checked)
+            goto discard;
+
+        __checked = checked;
+        __checked_capacity = capacity;
+    }
+
+    __checked[__nchecked++] = lib;
+    pthread_mutex_unlock(&__checked_lock);
+
+    return lib;
+
+discard:
+    pthread_mutex_unlock(&__checked_lock);
+
+    int saved_errno = errno;
+
+    if (lib->ei) {
+        tmixelf_free_info(lib->ei);
+        free(lib->ei);
+    }
+
+    if (lib->handle)
+        __close(lib->handle);
+
+    free(lib->name);
+    free(lib);
+    errno = saved_errno;
+
+    return found;  // NULL if failed to append
+}
+
+/*
+ * returns whether the checked library defines name
+ */
+static bool __lookup_checked(const __checked_lib *lib, const char *name, uint32_t hash) {
+    if (lib->ei)
+        return tmixelf_lookup_sym(lib->ei, name, hash) != NULL;
+
+#ifdef _WIN32
+    return GetProcAddress(lib->handle, name) != NULL;
+#else
+    return dlsym(lib->handle, name) != NULL;
+#endif
+}
+
+/*
+ * libraries a check resolves symbols from, in breadth-first order
+ */
+typedef struct {
+    const __checked_lib **libs;  // array
+    size_t size;
+    size_t capacity;
+} __closure;
+
+/*
+ * append the library required as name to the closure, unless it's there already,
+ * missing ones are counted in res instead
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __add_checked(__closure *closure, const char *name, bool search, const char *cache_dir,
+                         tmixdynld_check *res) {
+    const __checked_lib *lib = __check_lib(name, search, cache_dir);
+    size_t i;
+
+    if (!lib)
+        return -1;
+
+    if (!lib->ei && !lib->handle) {
+        if (!res->missing_libs++)
+            res->first_missing_lib = name;
+
+        return 0;
+    }
+
+    for (i = 0; i < closure->size; i++) {
+        if (closure->libs[i] == lib)
+            return 0;
+    }
+
+    if (closure->size == closure->capacity) {
+        size_t capacity = closure->capacity ? 2 * closure->capacity : 8;
+        const __checked_lib **libs = realloc(closure->libs, capacity * sizeof(__checked_lib *));
+
+        if (!libs)
+            return -1;
+
+        closure->libs = libs;
+        closure->capacity = capacity;
+    }
+
+    closure->libs[closure->size++] = lib;
+
+    return 0;
+}
+
+int _tmixdynld_internal_check_deps(const tmixelf_info *ei, const char *cache_dir, tmixdynld_check *res) {
+    __closure closure = {};
+    size_t i, j;
+    int ret = -1;
+
+    memset(res, 0, sizeof(*res));
+
+    const char *libc_path = getenv("TMIXDYNLD_LIBC_PATH");
+
+    if (libc_path && __add_checked(&closure, libc_path, false, cache_dir, res) < 0)
+        goto exit;
+
+    const char *const *needs = ei->needs.data;  // array
+
+    for (i = 0; i < ei->needs.size; i++) {
+        if (__add_checked(&closure, needs[i], true, cache_dir, res) < 0)
+            goto exit;
+    }
+
+    // needs of libraries found by us are walked as well, the host resolves the others by itself
+
+    for (i = 0; i < closure.size; i++) {
+        const tmixelf_info *lib_ei = closure.libs[i]->ei;
+
+        for (j = 0; lib_ei && j < lib_ei->needs.size; j++) {
+            if (__add_checked(&closure, ((const char *const *) lib_ei->needs.data)[j], true, cache_dir, res) < 0)
+                goto exit;
+        }
+    }
+
+    res->libs = closure.size;
+
+    // then every imported symbol
+
+    const tmixelf_sym *syms = ei->syms.data;  // array
+
+    for (i = 0; i < ei->syms.size; i++) {
+        if (!syms[i].imported)
+            continue;
+
+        res->imports++;
+
+        for (j = 0; j < closure.size && !__lookup_checked(closure.libs[j], syms[i].name, syms[i].hash); j++);
+
+        if (j == closure.size && !syms[i].weak && !res->missing_syms++)
+            res->first_missing_sym = syms[i].name;
+    }
+
+    ret = 0;
+
+exit:
+    free(closure.libs);
+
+    return ret;
+}
+
+__attribute__((destructor)) static void __destroy_deps(void) {
+    while (__nlibs) {
+        tmixdynld_internal_lib *lib = &__libs[--__nlibs];
+
+        // native ones are kept, like images loaded by us
+        if (!lib->native) {
+            __close(lib->handle);
+            free((void *) lib->needs);
+        }
+
+        free(lib->name);
+    }
+
+    free(__libs);
+    __libs = NULL;
+    __libs_capacity = 0;
+}
@@ -17,6 +17,7 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -28,84 +29,634 @@
 #  define WIN32_LEAN_AND_MEAN
 #  include <windows.h>
 #else
-#  include <dlfcn.h>
 #  include <sys/mman.h>
+#  include <unistd.h>
 #endif
 
-#include "../inc/paths.h"
+#include "../inc/probes.h"
+#include "../inc/prof.h"
 #include "../inc/types.h"
 
 #include "elf/elf.h"
 
+#include "_deps.h"
+#include "_lazy.h"
+#include "_relcache.h"
+#include "_symmap.h"
+#include "_tls.h"
 #include "dynld.h"
 
-#define _LIBC_PATH               "../share/termix/tests/" _TMIX_SHLIB_PREFIX "tmixfakelibc" _TMIX_SHLIB_SUFFIX
+#define _IS_TLS_RELOC(_type)      ((_type) >= TMIXELF_RELOC_TPOFF)
 
-static void *__libc = NULL;
+#if defined(__linux__) && !defined(MADV_POPULATE_WRITE)
+#  define MADV_POPULATE_WRITE     (23)  // since Linux 5.14
+#endif
 
-int tmixdynld_handle_elf(void *base, const tmixelf_info *ei) {
-    if (!__libc) {
-        // dylib handle was failed to open
-        errno = EAGAIN;
-        return -1;
+static size_t __pagesize = 4096;  // only written once by the constructor below
+static bool __populate = true;  // whether pages are populated before relocating
+static bool __bind_now = false;  // whether lazy binding is disabled
+static tmixdynld_stats __stats = {};
+
+/*
+ * walks locations of packed RELATIVE relocation entries one by one
+ *
+ * an even word is the location of an entry, an odd one is a bitmap of the following
+ * 8 * sizeof(size_t) - 1 words, whose lowest bit is the flag
+ */
+typedef struct {
+    const size_t *relr;  // array
+    const size_t *relr_end;
+    size_t next;  // location after the last addressed one
+    size_t bitmap;  // bits not walked yet of the current bitmap, without the flag
+    size_t bitmap_off;  // location of the first word covered by the current bitmap
+} __relr_cursor;
+
+/*
+ * returns whether there is another location, stored in off
+ */
+static bool __relr_next(__relr_cursor *cursor, size_t *off) {
+    for (;;) {
+        if (cursor->bitmap) {
+            *off = cursor->bitmap_off + __builtin_ctzll(cursor->bitmap) * sizeof(size_t);
+            cursor->bitmap &= cursor->bitmap - 1;
+            return true;
+        }
+
+        if (cursor->relr == cursor->relr_end)
+            return false;
+
+        size_t word = *cursor->relr++;
+
+        if (!(word & 1)) {
+            *off = word;
+            cursor->next = word + sizeof(size_t);
+            return true;
+        }
+
+        cursor->bitmap = word >> 1;
+        cursor->bitmap_off = cursor->next;
+        cursor->next += (8 * sizeof(size_t) - 1) * sizeof(size_t);
+    }
+}
+
+/*
+ * count pages written by relocations of ei, which are sorted by location,
+ * and populate them at once instead of taking a copy-on-write fault on each
+ *
+ * returns the number of those pages
+ */
+static size_t __populate_pages(void *base, const tmixelf_info *ei) {
+    const tmixelf_reloc *relocs = ei->relocs.data;  // array
+    const tmixelf_relative *relatives = ei->relatives.data;  // array
+    __relr_cursor cursor = {.relr = ei->relr.data, .relr_end = (const size_t *) ei->relr.data + ei->relr.size};
+    size_t count = 0;
+    size_t start = 0, end = 0;  // run of adjacent pages not populated yet
+    size_t i = 0, j = 0;
+    size_t relr_off;
+    bool relr_left = __relr_next(&cursor, &relr_off);
+
+    // walk all sorted lists at once
+
+    for (;;) {
+        size_t off = SIZE_MAX;
+        int from = -1;
+
+        if (i < ei->relocs.size && relocs[i].off < off) {
+            off = relocs[i].off;
+            from = 0;
+        }
+
+        if (j < ei->relatives.size && relatives[j].off < off) {
+            off = relatives[j].off;
+            from = 1;
+        }
+
+        if (relr_left && relr_off < off) {
+            off = relr_off;
+            from = 2;
+        }
+
+        if (from == 0)
+            i++;
+        else if (from == 1)
+            j++;
+        else if (from == 2)
+            relr_left = __relr_next(&cursor, &relr_off);
+
+        bool done = from < 0;
+        size_t page = done ? SIZE_MAX : off / __pagesize;
+
+        if (page >= start && page < end)
+            continue;  // same page
+
+        if (!done)
+            count++;
+
+        if (page == end && !done) {
+            end++;
+            continue;
+        }
+
+#ifdef MADV_POPULATE_WRITE
+        // failures are ignored, pages are simply faulted in then
+        if (__populate && end > start
+            && madvise((char *) base + start * __pagesize, (end - start) * __pagesize, MADV_POPULATE_WRITE) < 0
+            && errno == EINVAL)
+            __populate = false;  // not supported by the kernel
+#endif
+
+        if (done)
+            break;
+
+        start = page;
+        end = page + 1;
+    }
+
+    return count;
+}
+
+/*
+ * apply RELATIVE relocations of ei, no symbols are involved
+ *
+ * returns the number of applied entries
+ */
+static size_t __apply_relatives(char *base, const tmixelf_info *ei) {
+    const tmixelf_relative *relatives = ei->relatives.data;  // array
+    size_t count = ei->relatives.size;
+    size_t i;
+
+    if (ei->implicit_addends) {
+        for (i = 0; i < count; i++)
+            *(uintptr_t *) (base + relatives[i].off) += (uintptr_t) base;
+    } else {
+        for (i = 0; i < count; i++)
+            *(uintptr_t *) (base + relatives[i].off) = (uintptr_t) base + relatives[i].addend;
+    }
+
+    // packed ones are decoded a word at a time, never expanded into a list
+
+    const size_t *relr = ei->relr.data;  // array
+    uintptr_t *where = NULL;
+
+    for (i = 0; i < ei->relr.size; i++) {
+        size_t word = relr[i];
+
+        if (!(word & 1)) {
+            where = (uintptr_t *) (base + word);
+            *where++ += (uintptr_t) base;
+            count++;
+            continue;
+        }
+
+        uintptr_t *p = where;
+
+        for (word >>= 1; word; word >>= 1, p++) {
+            if (word & 1) {
+                *p += (uintptr_t) base;
+                count++;
+            }
+        }
+
+        where += 8 * sizeof(size_t) - 1;
+    }
+
+    return count;
+}
+
+void *_tmixdynld_internal_resolve(void *base, const tmixelf_sym *sym) {
+    if (!sym->imported)
+        return (char *) base + sym->off;  // defined by the image itself
+
+    // a few functions of the host are replaced to serve TLS laid out by us
+
+    void *builtin = _tmixdynld_internal_tls_builtin(sym->name, sym->hash);
+
+    if (builtin)
+        return builtin;
+
+    // lookups are remembered, missing symbols as well
+
+    void *the_sym;
+    const char *provider = NULL;  // only known on a miss
+    tmix_prof_phase prev = _tmix_prof_switch(TMIX_PROF_RESOLVE);
+
+    _tmix_probe1(resolve_start, sym->name);
+
+    bool hit = _tmixdynld_internal_symmap_get(sym->hash, sym->name, &the_sym);
+
+    if (!hit) {
+        the_sym = _tmixdynld_internal_lookup_deps(sym->name, sym->hash, &provider);
+
+        _tmixdynld_internal_symmap_put(sym->hash, sym->name, the_sym);  // failures are ignored
+    }
+
+    _tmix_probe4(resolve_end, sym->name, the_sym, provider, hit);
+    _tmix_prof_switch(prev);
+    _tmix_prof_count(TMIX_PROF_LOOKUPS, 1);
+
+    // missing weak symbols are bound to zero, which is up to the caller
+    if (!the_sym && !sym->weak)
+        fprintf(stderr, "error while relocating symbol %s: symbol not found\n", sym->name);
+
+    return the_sym;
+}
+
+/*
+ * wanted - wanted[i] tells whether to resolve the i-th symbol of ei
+ * addrs - output, addrs[i] is set to the address of each wanted symbol
+ *
+ * same as calling _tmixdynld_internal_resolve for each wanted symbol, but the ones
+ * not remembered yet are looked up in a batch
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, missing symbols are not an error here
+ */
+static int __resolve_syms(void *base, const tmixelf_info *ei, const bool *wanted, void **addrs) {
+    const tmixelf_sym *syms = ei->syms.data;  // array
+    tmixelf_sym *misses = malloc(ei->syms.size * sizeof(tmixelf_sym));
+    size_t *idx = malloc(ei->syms.size * sizeof(size_t));  // index of each miss in syms
+    void **miss_addrs = malloc(ei->syms.size * sizeof(void *));
+    const char **providers = malloc(ei->syms.size * sizeof(const char *));
+    size_t nmisses = 0;
+    size_t nlookups = 0;
+    size_t i;
+    int ret = -1;
+
+    if (!misses || !idx || !miss_addrs || !providers)
+        goto exit;
+
+    tmix_prof_phase prev = _tmix_prof_switch(TMIX_PROF_RESOLVE);
+
+    for (i = 0; i < ei->syms.size; i++) {
+        if (!wanted[i])
+            continue;
+
+        if (!syms[i].imported) {
+            addrs[i] = (char *) base + syms[i].off;
+            continue;
+        }
+
+        if ((addrs[i] = _tmixdynld_internal_tls_builtin(syms[i].name, syms[i].hash)))
+            continue;
+
+        nlookups++;
+
+        // the ones not remembered are timed as a batch below
+        _tmix_probe1(resolve_start, syms[i].name);
+
+        if (_tmixdynld_internal_symmap_get(syms[i].hash, syms[i].name, &addrs[i])) {
+            _tmix_probe4(resolve_end, syms[i].name, addrs[i], NULL, true);
+            continue;
+        }
+
+        misses[nmisses] = syms[i];
+        idx[nmisses++] = i;
+    }
+
+    _tmix_probe1(resolve_batch_start, nmisses);
+
+    if (_tmixdynld_internal_lookup_deps_batch(misses, nmisses, miss_addrs, providers) < 0) {
+        _tmix_probe2(resolve_batch_end, nmisses, 0);
+        _tmix_prof_switch(prev);
+        goto exit;
+    }
+
+    size_t nfound = 0;
+
+    for (i = 0; i < nmisses; i++) {
+        if (miss_addrs[i])
+            nfound++;
+    }
+
+    _tmix_probe2(resolve_batch_end, nmisses, nfound);
+
+    for (i = 0; i < nmisses; i++) {
+        addrs[idx[i]] = miss_addrs[i];
+
+        _tmixdynld_internal_symmap_put(misses[i].hash, misses[i].name, miss_addrs[i]);  // failures are ignored
+
+        _tmix_probe4(resolve_end, misses[i].name, miss_addrs[i], providers[i], false);
+    }
+
+    _tmix_prof_switch(prev);
+    _tmix_prof_count(TMIX_PROF_LOOKUPS, nlookups);
+
+    // missing weak symbols are bound to zero, which is up to the caller
+    for (i = 0; i < nmisses; i++) {
+        if (!miss_addrs[i] && !misses[i].weak)
+            fprintf(stderr, "error while relocating symbol %s: symbol not found\n", misses[i].name);
+    }
+
+    ret = 0;
+
+exit:
+    free(misses);
+    free(idx);
+    free(miss_addrs);
+    free(providers);
+
+    return ret;
+}
+
+/*
+ * bind thread-local relocations of an image, whose own block is at tls_off from the thread pointer,
+ * which are never cached, since blocks are placed in the order images are loaded
+ *
+ * returns the number of bound entries if succeed, otherwise -1 and sets errno
+ */
+static ssize_t __bind_tls(char *base, const tmixelf_info *ei, ssize_t tls_off) {
+    const tmixelf_reloc *relocs = ei->relocs.data;  // array
+    const tmixelf_sym *syms = ei->syms.data;  // array
+    ssize_t count = 0;
+    size_t i;
+
+    for (i = 0; i < ei->relocs.size; i++) {
+        if (!_IS_TLS_RELOC(relocs[i].type))
+            continue;
+
+        // the image itself if no symbol is given
+
+        const tmixelf_sym *sym = relocs[i].symidx ? &syms[relocs[i].symidx] : NULL;
+        ssize_t module_off = tls_off;
+        size_t sym_off = sym && !sym->imported ? sym->off : 0;
+
+        if (sym && sym->imported) {
+            if (_tmixdynld_internal_lookup_tls(sym->name, sym->hash, &module_off, &sym_off) < 0) {
+                if (errno == ENOTSUP) {
+                    fprintf(stderr, "error while relocating symbol %s: thread-local symbol of a host library\n",
+                            sym->name);
+
+                    return -1;
+                }
+
+                if (errno == EINVAL) {
+                    fprintf(stderr, "error while relocating symbol %s: not a thread-local symbol\n", sym->name);
+
+                    return -1;
+                }
+
+                if (!sym->weak) {
+                    fprintf(stderr, "error while relocating symbol %s: thread-local symbol not found\n", sym->name);
+
+                    errno = EAGAIN;
+                    return -1;
+                }
+
+                module_off = 0;  // missing weak symbol
+            }
+        } else if (!ei->tls.size) {
+            errno = ENOEXEC;
+            return -1;
+        }
+
+        // the addend of a descriptor is in its second word
+
+        uintptr_t *ptr = (uintptr_t *) (base + relocs[i].off);
+        uintptr_t addend = !ei->implicit_addends ? (uintptr_t) relocs[i].addend
+                           : relocs[i].type == TMIXELF_RELOC_TLSDESC ? ptr[1] : ptr[0];
+
+        switch (relocs[i].type) {
+            case TMIXELF_RELOC_TPOFF:
+                *ptr = module_off + sym_off + addend;
+                break;
+            case TMIXELF_RELOC_DTPMOD:
+                *ptr = module_off;  // taken by __tls_get_addr as is
+                break;
+            case TMIXELF_RELOC_DTPOFF:
+                *ptr = sym_off + addend;
+                break;
+            case TMIXELF_RELOC_TLSDESC:
+                if (!(ptr[0] = (uintptr_t) _tmixdynld_internal_tlsdesc_static())) {
+                    errno = ENOTSUP;
+                    return -1;
+                }
+
+                ptr[1] = module_off + sym_off + addend;
+                break;
+            default:
+                break;
+        }
+
+        count++;
+    }
+
+    return count;
+}
+
+/*
+ * run initialization functions of a native library
+ */
+static void __run_init(char *base, const tmixelf_info *ei) {
+    // arguments of the guest are not known here
+    if (ei->init)
+        ((__tmixabi void (*)(int, char **, char **)) (base + ei->init))(0, NULL, NULL);
+
+    // entries are already relocated
+    const uintptr_t *funcs = (const uintptr_t *) (base + ei->init_array.off);
+    size_t i;
+
+    for (i = 0; i < ei->init_array.size / sizeof(uintptr_t); i++) {
+        if (funcs[i] && funcs[i] != UINTPTR_MAX)
+            ((__tmixabi void (*)(int, char **, char **)) funcs[i])(0, NULL, NULL);
     }
+}
 
+/*
+ * apply all relocations of an image, with its libraries loaded, and its TLS block
+ * at tls_off from the thread pointer if it has one
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __link(void *base, const tmixelf_info *ei, ssize_t tls_off, const char *cache_dir) {
     size_t i;
 
-    if (ei->relocs.size) {
+    _tmix_prof_switch(TMIX_PROF_RELOCATE);
+
+    // relocations are sorted by location when parsed, so they are applied page by page,
+    // RELATIVE ones first, which need no symbols
+
+    __stats.relocs = ei->relocs.size;
+    __stats.dirty_pages = __populate_pages(base, ei);
+    __stats.relatives = __apply_relatives(base, ei);
+    _tmix_prof_count(TMIX_PROF_RELOCS, __stats.relatives + __stats.relocs);
+    _tmix_probe3(relocate, base, "relative", __stats.relatives);
+
+    // symbols are either from loaded libraries or the image itself,
+    // results can only be cached if all of them have build IDs
+
+    size_t ndeps;
+    const tmixdynld_internal_lib *deps = _tmixdynld_internal_get_deps(&ndeps);
+    size_t nproviders = ndeps + 1;
+    tmixdynld_internal_provider *providers = malloc(nproviders * sizeof(tmixdynld_internal_provider));
+    bool cacheable = cache_dir && ei->build_id.size && providers;
+
+    if (!providers)
+        nproviders = 0;
+
+    for (i = 0; i < ndeps && providers; i++) {
+        providers[i] = deps[i].provider;
+
+        if (!providers[i].build_id.size)
+            cacheable = false;
+    }
+
+    if (providers)
+        providers[ndeps] = (tmixdynld_internal_provider) {(uintptr_t) base, (uintptr_t) base,
+                                                           (uintptr_t) base + ei->mem_size, ei->build_id};
+
+    __stats.cached = ei->relocs.size && !_tmixdynld_internal_apply_cached(cache_dir, base, ei, providers, nproviders);
+
+    // applying cached results is as cheap as setting up lazy binding, so symbols are bound
+    // eagerly on a cache miss to fill the cache, otherwise on their first call unless asked not to
+
+    __stats.lazy = ei->relocs.size && !__stats.cached && !cacheable && !__bind_now && !ei->bind_now
+                   && ei->pltgot && !_tmixdynld_internal_setup_lazy(base, ei);
+
+    if (__stats.cached)
+        _tmix_probe3(relocate, base, "cached", ei->relocs.size);
+
+    // symbols of other kinds of relocations are still bound now
+
+    if (ei->relocs.size && !__stats.cached) {
         tmixelf_reloc *relocs = ei->relocs.data;
         tmixelf_sym *syms = ei->syms.data;
 
         assert(relocs);
         assert(syms);
 
+        // results are recorded for the cache, unless some symbols come from other libraries
+
+        tmixdynld_internal_binding *bindings = NULL;
+
+        if (cacheable && !(bindings = calloc(ei->relocs.size, sizeof(tmixdynld_internal_binding))))
+            cacheable = false;
+
+        // symbols bound now are resolved at once, or one by one if memory is short
+
+        bool *wanted = calloc(ei->syms.size, sizeof(bool));
+        void **addrs = malloc(ei->syms.size * sizeof(void *));
+
+        for (i = 0; i < ei->relocs.size && wanted; i++) {
+            if (!(__stats.lazy && relocs[i].type == TMIXELF_RELOC_JUMP_SLOT) && !_IS_TLS_RELOC(relocs[i].type))
+                wanted[relocs[i].symidx] = true;
+        }
+
+        if (!wanted || !addrs || __resolve_syms(base, ei, wanted, addrs) < 0) {
+            free(addrs);
+            addrs = NULL;
+        }
+
+        free(wanted);
+
+        size_t bound = 0;
+        size_t ntls = 0;
+
         for (i = 0; i < ei->relocs.size; i++) {
-            // FIXME: support other shlibs
-            tmixelf_sym *sym = &syms[relocs[i].symidx];
+            if (__stats.lazy && relocs[i].type == TMIXELF_RELOC_JUMP_SLOT)
+                continue;  // already set up
 
-            assert(sym->imported);
+            if (_IS_TLS_RELOC(relocs[i].type)) {
+                // bound below in any case
+                if (cacheable)
+                    bindings[i] = (tmixdynld_internal_binding) {.off = relocs[i].off,
+                                                                .provider = TMIXDYNLD_INTERNAL_NOT_CACHED};
 
-#ifdef _WIN32
-            void *the_sym = GetProcAddress(__libc, sym->name);
-#else
-            void *the_sym = dlsym(__libc, sym->name);
-#endif
+                ntls++;
+                continue;
+            }
 
-            if (!the_sym) {
-#ifdef _WIN32
-                // TODO: use FormatMessage to print human readable error message
-                fprintf(stderr, "error while relocating symbol %s: WinError %ld\n", sym->name, GetLastError());
-#else
-                const char *err = dlerror();
+            const tmixelf_sym *sym = &syms[relocs[i].symidx];
+            void *the_sym = addrs ? addrs[relocs[i].symidx] : _tmixdynld_internal_resolve(base, sym);
 
-                if (err)
-                    fprintf(stderr, "error while relocating symbol %s: %s\n", sym->name, err);
-                else
-                    fprintf(stderr, "unknown error while relocating symbol %s\n", sym->name);  // how
-#endif
+            if (!the_sym && !sym->weak) {
+                free(addrs);
+                free(bindings);
+                free(providers);
 
                 errno = EAGAIN;
                 return -1;
             }
 
-            intptr_t *ptr = (intptr_t *)((char *)base + relocs[i].off);
+            uintptr_t *ptr = (uintptr_t *) ((char *) base + relocs[i].off);
+            uintptr_t value = (uintptr_t) the_sym;
+
+            if (relocs[i].type == TMIXELF_RELOC_ABS)
+                value += ei->implicit_addends ? *ptr : relocs[i].addend;
 
-            *ptr = (intptr_t)the_sym;
+            *ptr = value;
+            bound++;
+
+            if (cacheable) {
+                uintptr_t addr = (uintptr_t) the_sym;
+                size_t p;
+
+                for (p = 0; p < nproviders && (addr < providers[p].start || addr >= providers[p].end); p++);
+
+                bindings[i].off = relocs[i].off;
+
+                if (!the_sym) {
+                    // missing weak symbol
+                    bindings[i].sym_off = value;
+                    bindings[i].provider = TMIXDYNLD_INTERNAL_NO_PROVIDER;
+                } else if (p == nproviders)
+                    cacheable = false;
+                else {
+                    bindings[i].sym_off = value - providers[p].base;
+                    bindings[i].provider = p;
+                }
+            }
         }
+
+        _tmix_probe3(relocate, base, "symbol", bound);
+
+        if (__stats.lazy)
+            _tmix_probe3(relocate, base, "lazy", ei->relocs.size - bound - ntls);
+
+        if (cacheable)
+            _tmixdynld_internal_save_cached(cache_dir, ei, providers, nproviders, bindings, ei->relocs.size);  // failures are ignored
+
+        free(addrs);
+        free(bindings);
     }
 
+    free(providers);
+
+    ssize_t tls_bound = ei->relocs.size ? __bind_tls(base, ei, tls_off) : 0;
+
+    if (tls_bound < 0)
+        return -1;
+
+    if (tls_bound)
+        _tmix_probe3(relocate, base, "tls", tls_bound);
+
+    _tmix_prof_switch(TMIX_PROF_RELRO);
+
     if (ei->relros.size) {
         tmix_chunk *relros = ei->relros.data;  // array
+        size_t j;
 
         assert(relros);
 
-        for (i = 0; i < ei->relros.size; i++) {
+        for (i = 0; i < ei->relros.size; i = j) {
+            size_t start = relros[i].off;
+            size_t end = relros[i].off + relros[i].size;
+
+            // chunks following each other, even within the same page, are protected at once
+
+            for (j = i + 1; j < ei->relros.size && relros[j].off >= start
+                            && relros[j].off <= ((end + __pagesize - 1) & ~(__pagesize - 1)); j++) {
+                if (end < relros[j].off + relros[j].size)
+                    end = relros[j].off + relros[j].size;
+            }
+
+            _tmix_prof_count(TMIX_PROF_MPROTECTS, 1);
+            _tmix_probe2(relro, (char *) base + start, end - start);
+
 #ifdef _WIN32
             DWORD old_prot = 0;  // unused
 
-            if (!VirtualProtect(base + relros[i].off, relros[i].size, PAGE_READONLY, &old_prot))
+            if (!VirtualProtect(base + start, end - start, PAGE_READONLY, &old_prot))
 #else
-            if (mprotect(base + relros[i].off, relros[i].size, PROT_READ) < 0)
+            if (mprotect(base + start, end - start, PROT_READ) < 0)
 #endif
                 return -1;
         }
@@ -114,63 +665,163 @@ int tmixdynld_handle_elf(void *base, const tmixelf_info *ei) {
     return 0;
 }
 
-__attribute__((constructor)) static void __init_libc(void) {
-    char *libc_path = getenv("TMIXDYNLD_LIBC_PATH");
-
-    if (libc_path) {
-        libc_path = strdup(libc_path);
+/*
+ * first - index of the first library loaded since the last call
+ *
+ * link native libraries loaded since first, dependencies first
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __link_deps(size_t first, const char *cache_dir) {
+    size_t ndeps;
+    tmixdynld_internal_lib *deps = _tmixdynld_internal_get_deps(&ndeps);
+    size_t i;
 
-        if (!libc_path) {
-            perror("error duplicating libc path");
+    for (i = ndeps; i-- > first;) {
+        if (deps[i].native && !deps[i].linked) {
+            if (__link(deps[i].base, deps[i].ei, deps[i].tls_off, cache_dir) < 0)
+                return -1;
 
-            return;
+            deps[i].linked = true;
         }
+    }
+
+    return 0;
+}
 
-        goto try_open;
+/*
+ * first - index of the first library loaded since the last call
+ *
+ * allocate TLS blocks of native libraries loaded since first, before any of them is linked
+ *
+ * returns 0 if succeed, otherwise prints the error, returns -1 and sets errno
+ */
+static int __alloc_deps_tls(size_t first) {
+    size_t ndeps;
+    tmixdynld_internal_lib *deps = _tmixdynld_internal_get_deps(&ndeps);
+    size_t i;
+
+    for (i = first; i < ndeps; i++) {
+        if (deps[i].native && deps[i].ei->tls.size
+            && _tmixdynld_internal_alloc_tls(deps[i].base, deps[i].ei, false, &deps[i].tls_off) < 0) {
+            fprintf(stderr, "error while allocating TLS of %s: %s\n", deps[i].name, strerror(errno));
+
+            return -1;
+        }
     }
 
-    if (!_tmix_progdir)
-        return;  // sth went wrong during startup
+    return 0;
+}
 
-    libc_path = _tmix_join_path(_tmix_progdir, _LIBC_PATH);
+/*
+ * initialize native libraries loaded since first, dependencies first
+ */
+static void __init_deps(size_t first) {
+    size_t ndeps;
+    tmixdynld_internal_lib *deps = _tmixdynld_internal_get_deps(&ndeps);
+    size_t i;
 
-    if (!libc_path) {
-        perror("error concatenating path for libc");
+    _tmix_prof_switch(TMIX_PROF_INIT);
 
-        return;
+    for (i = ndeps; i-- > first;) {
+        if (deps[i].native)
+            __run_init(deps[i].base, deps[i].ei);
     }
+}
 
-try_open:
-#ifdef _WIN32
-    __libc = LoadLibrary(libc_path);
-#else
-    __libc = dlopen(libc_path, RTLD_LAZY);
-#endif
+int tmixdynld_handle_elf(void *base, const tmixelf_info *ei) {
+    return tmixdynld_handle_elf_cached(base, ei, NULL);
+}
 
-    if (!__libc) {
-#ifdef _WIN32
-        // TODO: use FormatMessage to print human readable error message
-        fprintf(stderr, "error while opening libc: WinError %ld\n", GetLastError());
-#else
-        const char *err = dlerror();
+int tmixdynld_handle_elf_cached(void *base, const tmixelf_info *ei, const char *cache_dir) {
+    size_t first;  // libraries loaded for this image
+    tmix_prof_phase prev = _tmix_prof_switch(TMIX_PROF_DEPS);
+    int ret = -1;
 
-        if (err)
-            fprintf(stderr, "error while opening libc: %s\n", err);
-        else
-            fprintf(stderr, "unknown error while opening libc\n");
-#endif
+    _tmixdynld_internal_get_deps(&first);
+
+    // load required libraries before touching the image
+
+    if (_tmixdynld_internal_load_deps(ei, cache_dir) < 0)
+        goto exit;
+
+    // the block of the image is placed first, as the executable of a process
+
+    ssize_t tls_off = 0;
+
+    if (ei->tls.size && _tmixdynld_internal_alloc_tls(base, ei, true, &tls_off) < 0) {
+        fprintf(stderr, "error while allocating TLS: %s\n", strerror(errno));
+
+        goto exit;
     }
 
-    free(libc_path);
+    if (__alloc_deps_tls(first) < 0)
+        goto exit;
+
+    // native libraries are linked before the image, so statistics are about the image itself
+
+    if (__link_deps(first, cache_dir) < 0 || __link(base, ei, tls_off, cache_dir) < 0)
+        goto exit;
+
+    // all symbols are ready now
+    __init_deps(first);
+    ret = 0;
+
+exit:
+    _tmix_prof_switch(prev);
+
+    return ret;
 }
 
-__attribute__((destructor)) static void __destroy_libc(void) {
-    if (__libc) {
+int tmixdynld_preload_libs(const char *const *names, size_t count, const char *cache_dir) {
+    size_t first;
+    tmix_prof_phase prev = _tmix_prof_switch(TMIX_PROF_DEPS);
+    int ret = -1;
+
+    _tmixdynld_internal_get_deps(&first);
+
+    if (_tmixdynld_internal_load_libs(names, count, cache_dir) < 0 || __alloc_deps_tls(first) < 0
+        || __link_deps(first, cache_dir) < 0)
+        goto exit;
+
+    __init_deps(first);
+    ret = 0;
+
+exit:
+    _tmix_prof_switch(prev);
+
+    return ret;
+}
+
+int tmixdynld_check_elf(const tmixelf_info *ei, const char *cache_dir, tmixdynld_check *res) {
+    return _tmixdynld_internal_check_deps(ei, cache_dir, res);
+}
+
+void tmixdynld_get_stats(tmixdynld_stats *stats) {
+    *stats = __stats;
+    stats->lazy_bound = _tmixdynld_internal_lazy_count();
+    _tmixdynld_internal_symmap_stats(&stats->sym_hits, &stats->sym_misses);
+}
+
+__attribute__((constructor)) static void __init_pagesize(void) {
 #ifdef _WIN32
-        FreeLibrary(__libc);
+    SYSTEM_INFO si = {};
+    GetSystemInfo(&si);  // wont fail
+    __pagesize = si.dwPageSize;
 #else
-        dlclose(__libc);
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    if (pagesize > 0)
+        __pagesize = pagesize;
 #endif
-        __libc = NULL;
-    }
+
+    const char *populate = getenv("TMIXDYNLD_POPULATE");
+
+    if (populate && !strcmp(populate, "0"))
+        __populate = false;
+
+    const char *bind_now = getenv("TMIXDYNLD_BIND_NOW");
+
+    if (bind_now && *bind_now)
+        __bind_now = true;
 }
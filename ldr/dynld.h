@@ -18,6 +18,9 @@
 #ifndef TERMIX_LOADER_DYNAMIC_LINKER_H
 #define TERMIX_LOADER_DYNAMIC_LINKER_H
 
+#include <stdbool.h>
+#include <sys/types.h>
+
 #include "../inc/abi.h"
 
 #include "elf/elf.h"
@@ -33,14 +36,122 @@
 #  endif
 #endif
 
+/*
+ * statistics of the last tmixdynld_handle_elf call
+ */
+typedef struct {
+    size_t relocs;  // number of relocations with symbols applied
+    size_t relatives;  // number of RELATIVE relocations applied
+    size_t dirty_pages;  // number of pages written by relocations
+    bool cached;  // whether relocation results were taken from the cache
+    bool lazy;  // whether symbols are bound on their first call
+    size_t lazy_bound;  // number of symbols bound lazily so far
+    size_t sym_hits;  // number of symbol lookups answered from memory so far, shared by all images
+    size_t sym_misses;  // number of symbol lookups done in libraries so far
+} tmixdynld_stats;
+
 /*
  * base - address of the first loaded segment
- * ei - information of the loaded elf
+ * ei - information of the loaded elf, must be valid as long as the image is in use
  *
  * returns 0 if succeed, otherwise -1 and sets errno
  *
+ * PLT entries are bound lazily on their first call where supported, unless the ELF
+ * asks for DF_BIND_NOW or DF_1_NOW, or environment variable TMIXDYNLD_BIND_NOW is not empty
+ *
  * NOTE: the behavior calling this function more than once on the same loaded image is undefined
  */
 _tmixldr_api int tmixdynld_handle_elf(void *base, const tmixelf_info *ei);
 
+/*
+ * base - address of the first loaded segment
+ * ei - information of the loaded elf
+ * cache_dir - directory storing cache entries, NULL to disable caching
+ *
+ * same as tmixdynld_handle_elf, but relocation results are saved in cache_dir, keyed by
+ * GNU build IDs of the ELF and the libraries providing symbols
+ *
+ * on a cache hit relocations are applied without looking up any symbols, entries
+ * are ignored once any of the build IDs changes
+ */
+_tmixldr_api int tmixdynld_handle_elf_cached(void *base, const tmixelf_info *ei, const char *cache_dir);
+
+/*
+ * names - array, names or paths of libraries, searched as the ones required by images
+ * count - number of names
+ * cache_dir - directory storing cache entries, NULL to disable caching
+ *
+ * load, link and initialize the libraries with all their dependencies ahead of images,
+ * so later ones requiring them find them loaded, e.g. before forking processes
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+_tmixldr_api int tmixdynld_preload_libs(const char *const *names, size_t count, const char *cache_dir);
+
+/*
+ * result of tmixdynld_check_elf
+ */
+typedef struct {
+    size_t libs;  // libraries found in the dependency closure, the preloaded one included
+    size_t missing_libs;  // required libraries found nowhere
+    size_t imports;  // imported symbols
+    size_t missing_syms;  // imported symbols defined nowhere, weak ones excluded
+    const char *first_missing_lib;  // NULL if none, valid as long as ei is
+    const char *first_missing_sym;  // same as above
+} tmixdynld_check;
+
+/*
+ * ei - information of a parsed elf, which needs not be loaded
+ * cache_dir - directory storing cache entries, NULL to disable caching
+ * res - output buffer
+ *
+ * find the libraries required by ei with all their dependencies, then every imported symbol in them,
+ * as tmixdynld_handle_elf would, but nothing is loaded into the global scope and nothing is relocated,
+ * so it can be called from many threads at once
+ *
+ * no code of the libraries ever runs: libraries are only parsed, except the ones the host has loaded already,
+ * ones found nowhere the host usually searches count as missing, all are kept for later checks
+ *
+ * returns 0 if checked, even if something is missing, otherwise -1 and sets errno
+ */
+_tmixldr_api int tmixdynld_check_elf(const tmixelf_info *ei, const char *cache_dir, tmixdynld_check *res);
+
+/*
+ * alignment of the reservation for tmixdynld_set_static_tls, also the largest one of TLS segments
+ * of images, which is the one of the thread pointer
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#  define TMIXDYNLD_STATIC_TLS_ALIGN      (64)
+#else
+#  define TMIXDYNLD_STATIC_TLS_ALIGN      (2 * sizeof(void *))
+#endif
+
+/*
+ * block - the only thread-local variable of the executable, aligned to TMIXDYNLD_STATIC_TLS_ALIGN
+ * size - size of the block, a multiple of TMIXDYNLD_STATIC_TLS_ALIGN
+ *
+ * reserve the block for TLS segments of images and their libraries, e.g.
+ *
+ *   static __thread char tls[SIZE] __attribute__((aligned(TMIXDYNLD_STATIC_TLS_ALIGN)));
+ *   tmixdynld_set_static_tls(tls, sizeof(tls));
+ *
+ * the host gives every thread a copy at the same offset from the thread pointer, so code of
+ * images accesses their variables with any TLS model as in a process of their own, and threads
+ * created by them get initial values of the variables
+ *
+ * images with TLS segments fail to link with ENOTSUP if nothing is reserved
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, ENOTSUP if the block is not laid out as
+ * the executable TLS of this platform, or the platform is not supported
+ */
+_tmixldr_api int tmixdynld_set_static_tls(void *block, size_t size);
+
+/*
+ * stats - output buffer
+ *
+ * pages written by relocations are populated at once before relocating where supported,
+ * set environment variable TMIXDYNLD_POPULATE to 0 to fault them in one by one instead
+ */
+_tmixldr_api void tmixdynld_get_stats(tmixdynld_stats *stats);
+
 #endif /* TERMIX_LOADER_DYNAMIC_LINKER_H */
@@ -29,11 +29,17 @@
 #  define _ElfXX_Sym              Elf32_Sym
 #  define _ElfXX_Rel              Elf32_Rel
 #  define _ElfXX_Rela             Elf32_Rela
+#  define _ElfXX_Nhdr             Elf32_Nhdr
 #  define _ElfXX_Word             Elf32_Word
 
+#  define _ElfXX_Addr             Elf32_Addr
+
 #  define _ELFXX_ST_BIND          ELF32_ST_BIND
 #  define _ELFXX_ST_TYPE          ELF32_ST_TYPE
 #  define _ELFXX_ST_VISIBILITY    ELF32_ST_VISIBILITY
+
+#  define _ELFXX_R_SYM            ELF32_R_SYM
+#  define _ELFXX_R_TYPE           ELF32_R_TYPE
 #elif defined(TMIX64)
 #  define _ElfXX_Ehdr             Elf64_Ehdr
 #  define _ElfXX_Phdr             Elf64_Phdr
@@ -41,13 +47,62 @@
 #  define _ElfXX_Sym              Elf64_Sym
 #  define _ElfXX_Rel              Elf64_Rel
 #  define _ElfXX_Rela             Elf64_Rela
+#  define _ElfXX_Nhdr             Elf64_Nhdr
 #  define _ElfXX_Word             Elf64_Word
 
+#  define _ElfXX_Addr             Elf64_Addr
+
 #  define _ELFXX_ST_BIND          ELF64_ST_BIND
 #  define _ELFXX_ST_TYPE          ELF64_ST_TYPE
 #  define _ELFXX_ST_VISIBILITY    ELF64_ST_VISIBILITY
+
+#  define _ELFXX_R_SYM            ELF64_R_SYM
+#  define _ELFXX_R_TYPE           ELF64_R_TYPE
 #else
 #  error Dont know ELF types on this platform yet
 #endif
 
+/*
+ * machine-specific relocation types
+ */
+#define _R_ARCH_NONE              (0)  // same on all architectures
+#ifdef __i386__
+#  define _R_ARCH_JUMP_SLOT       (7)  // R_386_JMP_SLOT
+#  define _R_ARCH_GLOB_DAT        (6)  // R_386_GLOB_DAT
+#  define _R_ARCH_ABS             (1)  // R_386_32
+#  define _R_ARCH_RELATIVE        (8)  // R_386_RELATIVE
+#  define _R_ARCH_TPOFF           (14)  // R_386_TLS_TPOFF
+#  define _R_ARCH_DTPMOD          (35)  // R_386_TLS_DTPMOD32
+#  define _R_ARCH_DTPOFF          (36)  // R_386_TLS_DTPOFF32
+#  define _R_ARCH_TLSDESC         (41)  // R_386_TLS_DESC
+#elif defined(__arm__)
+#  define _R_ARCH_JUMP_SLOT       (22)  // R_ARM_JUMP_SLOT
+#  define _R_ARCH_GLOB_DAT        (21)  // R_ARM_GLOB_DAT
+#  define _R_ARCH_ABS             (2)  // R_ARM_ABS32
+#  define _R_ARCH_RELATIVE        (23)  // R_ARM_RELATIVE
+#  define _R_ARCH_TPOFF           (19)  // R_ARM_TLS_TPOFF32
+#  define _R_ARCH_DTPMOD          (17)  // R_ARM_TLS_DTPMOD32
+#  define _R_ARCH_DTPOFF          (18)  // R_ARM_TLS_DTPOFF32
+#elif defined(__x86_64__)
+#  define _R_ARCH_JUMP_SLOT       (7)  // R_X86_64_JUMP_SLOT
+#  define _R_ARCH_GLOB_DAT        (6)  // R_X86_64_GLOB_DAT
+#  define _R_ARCH_ABS             (1)  // R_X86_64_64
+#  define _R_ARCH_RELATIVE        (8)  // R_X86_64_RELATIVE
+#  define _R_ARCH_TPOFF           (18)  // R_X86_64_TPOFF64
+#  define _R_ARCH_DTPMOD          (16)  // R_X86_64_DTPMOD64
+#  define _R_ARCH_DTPOFF          (17)  // R_X86_64_DTPOFF64
+#  define _R_ARCH_TLSDESC         (36)  // R_X86_64_TLSDESC
+#elif defined(__aarch64__)
+#  define _R_ARCH_JUMP_SLOT       (1026)  // R_AARCH64_JUMP_SLOT
+#  define _R_ARCH_GLOB_DAT        (1025)  // R_AARCH64_GLOB_DAT
+#  define _R_ARCH_ABS             (257)  // R_AARCH64_ABS64
+#  define _R_ARCH_RELATIVE        (1027)  // R_AARCH64_RELATIVE
+#  define _R_ARCH_TPOFF           (1030)  // R_AARCH64_TLS_TPREL
+#  define _R_ARCH_DTPMOD          (1028)  // R_AARCH64_TLS_DTPMOD
+#  define _R_ARCH_DTPOFF          (1029)  // R_AARCH64_TLS_DTPREL
+#  define _R_ARCH_TLSDESC         (1031)  // R_AARCH64_TLSDESC
+#else
+#  error Dont know relocation types on this architecture yet
+#endif
+
 #endif /* TERMIX_LOADER_ELF_INTERNAL_ARCH_H */
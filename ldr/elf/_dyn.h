@@ -18,9 +18,16 @@
 #ifndef TERMIX_LOADER_ELF_INTERNAL_DYN_H
 #define TERMIX_LOADER_ELF_INTERNAL_DYN_H
 
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "../../inc/arena.h"
 #include "../../inc/types.h"
 
+#include "elf.h"
+
 #include "_arch.h"
+#include "_file.h"
 
 /*
  * initialize this struct with zero
@@ -29,16 +36,26 @@
  */
 typedef struct {
     tmix_array relocs;  // array, optional
+    tmix_array relatives;  // array, optional
+    bool implicit_addends;
+    tmix_array relr;  // array, optional
     tmix_array syms;  // array, optional
     tmix_array needs;  // array, optional
+    tmixelf_hashtab hashtab;  // optional
+    const char *strtab;  // optional
+    size_t pltgot;  // optional
+    const char *soname;  // optional
+    size_t init;  // optional
+    tmix_chunk init_array;  // optional
+    bool bind_now;
 } tmixelf_internal_dyn;
 
 /*
  * returns 0 if success, otherwise -1 and sets errno
  *
- * if this function fails, no memory need to be freed, but eid might get modified
- * otherwise eid might be populated, caller should take the ownership of the data inside it
+ * all memory is allocated from arena, eid might get modified even if this function fails
  */
-int _tmixelf_internal_parse_dyn(int fd, const _ElfXX_Phdr *phdr, tmixelf_internal_dyn *eid);
+int _tmixelf_internal_parse_dyn(const tmixelf_internal_file *ef, const _ElfXX_Phdr *phdr,
+                                tmix_arena *arena, tmixelf_internal_dyn *eid);
 
 #endif /* TERMIX_LOADER_ELF_INTERNAL_DYN_H */
@@ -73,6 +73,8 @@
 #define PT_NOTE             (4)
 // entry used for storing segment header table itself, unused by us
 #define PT_PHDR             (6)
+// initialization image of thread-local storage
+#define PT_TLS              (7)
 // GNU extension for stack information
 #define PT_GNU_STACK	    (0x6474e551)
 // information for post-relocation read-only segments behavior
@@ -97,42 +99,139 @@
 #define DT_NEEDED           (1)
 // size of each relocation entry
 #define DT_PLTRELSZ         (2)
-// address of procedure linking table or global offset table, unused by us
+// address of procedure linking table or global offset table
 #define DT_PLTGOT           (3)
 // address of string table
 #define DT_STRTAB           (5)
 // address of symbol table
 #define DT_SYMTAB           (6)
+// size of Rela relocation table
+#define DT_RELASZ           (8)
+// size of each Rela relocation entry
+#define DT_RELAENT          (9)
 // string table size
 #define DT_STRSZ            (10)
 // size of each symbol table entry
 #define DT_SYMENT           (11)
+// address of initialization function
+#define DT_INIT             (12)
+// address of termination function
+#define DT_FINI             (13)
+// name of the shared object itself
+#define DT_SONAME           (14)
+// size of Rel relocation table
+#define DT_RELSZ            (18)
+// size of each Rel relocation entry
+#define DT_RELENT           (19)
 // relocation type
 #define DT_PLTREL           (20)
 // placeholder for runtime debug inforatmion, unused by us
 #define DT_DEBUG            (21)
 // address of relocation entry table
 #define DT_JMPREL           (23)
+// all relocations should be processed before running
+#define DT_BIND_NOW         (24)
+// address of array of initialization functions
+#define DT_INIT_ARRAY       (25)
+// address of array of termination functions
+#define DT_FINI_ARRAY       (26)
+// size of DT_INIT_ARRAY
+#define DT_INIT_ARRAYSZ     (27)
+// size of DT_FINI_ARRAY
+#define DT_FINI_ARRAYSZ     (28)
 // library search path
 #define DT_RUNPATH          (29)
+// flags
+#define DT_FLAGS            (30)
+// size of packed relative relocation table
+#define DT_RELRSZ           (35)
+// address of packed relative relocation table
+#define DT_RELR             (36)
+// size of each packed relative relocation entry
+#define DT_RELRENT          (37)
 // GNU-style hash table
 #define DT_GNU_HASH         (0x6ffffef5)
+// PLT entry resolving TLS descriptors lazily
+#define DT_TLSDESC_PLT      (0x6ffffef6)
+// GOT entry used by the above
+#define DT_TLSDESC_GOT      (0x6ffffef7)
+// address of symbol version table
+#define DT_VERSYM           (0x6ffffff0)
+// number of leading RELATIVE entries in Rela relocation table
+#define DT_RELACOUNT        (0x6ffffff9)
+// number of leading RELATIVE entries in Rel relocation table
+#define DT_RELCOUNT         (0x6ffffffa)
 // flags
 #define DT_FLAGS_1          (0x6ffffffb)
+// address of version definition table
+#define DT_VERDEF           (0x6ffffffc)
+// number of version definitions
+#define DT_VERDEFNUM        (0x6ffffffd)
+// address of version dependency table
+#define DT_VERNEED          (0x6ffffffe)
+// number of version dependencies
+#define DT_VERNEEDNUM       (0x6fffffff)
 
 /*
  * dynamic flags
  */
+// all relocations should be processed before running
+#define DF_BIND_NOW         (0x8)
+// thread-local variables are accessed as in the static TLS
+#define DF_STATIC_TLS       (0x10)
+
+/*
+ * dynamic state flags
+ */
+// same as DF_BIND_NOW
+#define DF_1_NOW            (0x1)
+// position-independent executable
 #define DF_1_PIE            (0x8000000)
 
 /*
- * relocation types
+ * relocation types, also tags of relocation tables
  */
 // relocation entry is Rela
 #define DT_RELA             (7)
 // relocation entry is Rel
 #define DT_REL              (17)
 
+/*
+ * note types
+ */
+// unique build ID of the file, with name "GNU"
+#define NT_GNU_BUILD_ID     (3)
+
+/*
+ * symbol related values
+ */
+// undefined section index, symbol is imported
+#define SHN_UNDEF           (0)
+// binding
+#define STB_LOCAL           (0)
+#define STB_GLOBAL          (1)
+#define STB_WEAK            (2)
+// type
+#define STT_NOTYPE          (0)
+#define STT_OBJECT          (1)
+#define STT_FUNC            (2)
+#define STT_TLS             (6)
+
+#define ELF32_ST_BIND(_info)      (((unsigned char) (_info)) >> 4)
+#define ELF32_ST_TYPE(_info)      ((_info) & 0xf)
+#define ELF32_ST_VISIBILITY(_o)   ((_o) & 0x3)
+#define ELF64_ST_BIND             ELF32_ST_BIND
+#define ELF64_ST_TYPE             ELF32_ST_TYPE
+#define ELF64_ST_VISIBILITY       ELF32_ST_VISIBILITY
+
+/*
+ * relocation info
+ */
+#define ELF32_R_SYM(_info)        ((_info) >> 8)
+#define ELF32_R_TYPE(_info)       ((unsigned char) (_info))
+#define ELF64_R_SYM(_info)        ((_info) >> 32)
+#define ELF64_R_TYPE(_info)       ((_info) & 0xffffffff)
+
 /*
  * data types
  */
@@ -266,4 +365,61 @@ typedef struct {
     Elf64_Xword st_size;  // size of symbol
 } Elf64_Sym;
 
+/*
+ * relocation entry with implicit addend
+ */
+typedef struct {
+    Elf32_Addr r_offset;  // location to apply the relocation
+    Elf32_Word r_info;  // symbol index and type
+} Elf32_Rel;
+
+typedef struct {
+    Elf64_Addr r_offset;  // location to apply the relocation
+    Elf64_Xword r_info;  // symbol index and type
+} Elf64_Rel;
+
+/*
+ * relocation entry with explicit addend
+ */
+typedef struct {
+    Elf32_Addr r_offset;  // location to apply the relocation
+    Elf32_Word r_info;  // symbol index and type
+    Elf32_Sword r_addend;
+} Elf32_Rela;
+
+typedef struct {
+    Elf64_Addr r_offset;  // location to apply the relocation
+    Elf64_Xword r_info;  // symbol index and type
+    Elf64_Sxword r_addend;
+} Elf64_Rela;
+
+/*
+ * note header
+ *
+ * followed by name and descriptor, both padded to the alignment of the note segment
+ */
+typedef struct {
+    Elf32_Word n_namesz;  // size of name, including the terminator
+    Elf32_Word n_descsz;  // size of descriptor
+    Elf32_Word n_type;
+} Elf32_Nhdr;
+
+typedef struct {
+    Elf64_Word n_namesz;  // size of name, including the terminator
+    Elf64_Word n_descsz;  // size of descriptor
+    Elf64_Word n_type;
+} Elf64_Nhdr;
+
+/*
+ * header of GNU-style hash table
+ *
+ * followed by bloom filter words (in native word size), buckets and hash chains
+ */
+typedef struct {
+    Elf32_Word nbuckets;  // number of buckets
+    Elf32_Word symoffset;  // index of the first symbol accessible via the table
+    Elf32_Word bloom_size;  // number of bloom filter words
+    Elf32_Word bloom_shift;
+} Elf_GNU_Hash_Header;
+
 #endif /* TERMIX_LOADER_ELF_INTERNAL_ELF_H */
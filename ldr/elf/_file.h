@@ -0,0 +1,74 @@
+/*
+  _file.h - ELF file access
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_ELF_INTERNAL_FILE_H
+#define TERMIX_LOADER_ELF_INTERNAL_FILE_H
+
+#include <sys/types.h>
+
+#include "../../inc/arena.h"
+
+#include "_arch.h"
+
+/*
+ * read-only view of an opened ELF file
+ *
+ * initialize this struct with zero
+ */
+typedef struct {
+    int fd;
+    const char *map;  // read-only mapping of the whole file, NULL if it cannot be mapped
+    size_t size;  // file size
+    const _ElfXX_Phdr *phdrs;  // array of segment headers, set once they are available
+    size_t phnum;
+} tmixelf_internal_file;
+
+/*
+ * returns 0 if success, otherwise -1 and sets errno
+ *
+ * the file is mapped if possible, otherwise data will be read on demand
+ */
+int _tmixelf_internal_open_file(int fd, tmixelf_internal_file *ef);
+
+/*
+ * release the mapping returned in ef->map
+ */
+void _tmixelf_internal_unmap_file(const void *map, size_t size);
+
+/*
+ * returns pointer to the data of given size at file offset off
+ *
+ * if the file is mapped, the returned pointer points into the mapping and buff is untouched,
+ * otherwise the data is read into buff with positional I/O, which must hold at least size bytes
+ *
+ * returns NULL and sets errno if failed
+ */
+const void *_tmixelf_internal_view_file(const tmixelf_internal_file *ef, size_t off, size_t size, void *buff);
+
+/*
+ * same as _tmixelf_internal_view_file, but allocates the buffer from arena if needed
+ */
+const void *_tmixelf_internal_load_file(const tmixelf_internal_file *ef, size_t off, size_t size, tmix_arena *arena);
+
+/*
+ * translate a virtual address range to its file offset with segment headers stored in ef
+ *
+ * returns 0 if success, otherwise -1 and sets errno
+ */
+int _tmixelf_internal_vaddr_to_off(const tmixelf_internal_file *ef, size_t vaddr, size_t size, size_t *off);
+
+#endif /* TERMIX_LOADER_ELF_INTERNAL_FILE_H */
@@ -21,9 +21,13 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+#include "../../inc/arena.h"
 #include "../../inc/types.h"
 
+#include "elf.h"
+
 #include "_arch.h"
+#include "_file.h"
 
 /*
  * initialize this struct with zero
@@ -34,18 +38,32 @@ typedef struct {
     tmix_array segs;  // data is optional
     tmix_array relros;  // data is optional
     size_t highest_addr;
+    size_t align;
     bool execstack;
+    tmixelf_tls tls;
     tmix_array needs;  // data is optional
     tmix_array relocs;  // data is optional
+    tmix_array relatives;  // data is optional
+    bool implicit_addends;
+    tmix_array relr;  // data is optional
     tmix_array syms;  // data is optional
+    tmixelf_hashtab hashtab;  // optional
+    const char *strtab;  // optional
+    size_t pltgot;  // optional
+    const char *soname;  // optional
+    size_t init;  // optional
+    tmix_chunk init_array;  // optional
+    bool bind_now;
+    tmix_array build_id;  // data is optional
+    size_t build_id_off;
 } tmixelf_internal_segs;
 
 /*
  * returns 0 if success, otherwise -1 and sets errno
  *
- * if this function fails, no memory need to be freed, but eis might get modified
- * otherwise eis might be populated, caller should take the ownership of the data inside it
+ * all memory is allocated from arena, eis might get modified even if this function fails
  */
-int _tmixelf_internal_parse_segs(int fd, _ElfXX_Ehdr *hdr, tmixelf_internal_segs *eis);
+int _tmixelf_internal_parse_segs(tmixelf_internal_file *ef, const _ElfXX_Ehdr *hdr,
+                                 tmix_arena *arena, tmixelf_internal_segs *eis);
 
 #endif /* TERMIX_LOADER_ELF_INTERNAL_SEGS_H */
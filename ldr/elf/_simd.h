@@ -0,0 +1,41 @@
+/*
+  _simd.h - Vectorized symbol hashing kernels
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef TERMIX_LOADER_ELF_INTERNAL_SIMD_H
+#define TERMIX_LOADER_ELF_INTERNAL_SIMD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "elf.h"
+
+/*
+ * hashes[i] is set to the GNU hash of names[i]
+ *
+ * uses the best kernel supported by the machine
+ */
+void _tmixelf_internal_hash_batch(const char *const *names, size_t n, uint32_t *hashes);
+
+/*
+ * maybe[i] is set to false if the symbol with hashes[i] is definitely not in ht
+ *
+ * uses the best kernel supported by the machine
+ */
+void _tmixelf_internal_bloom_batch(const tmixelf_hashtab *ht, const uint32_t *hashes, size_t n, bool *maybe);
+
+#endif /* TERMIX_LOADER_ELF_INTERNAL_SIMD_H */
@@ -1,5 +1,5 @@
 /*
-  _reloc.h - ELF symbol table
+  _symtab.h - ELF symbol table
 
   This program is free software; you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -21,32 +21,46 @@
 #include <stdbool.h>
 #include <sys/types.h>
 
+#include "../../inc/arena.h"
 #include "../../inc/types.h"
 
+#include "elf.h"
+
+#include "_file.h"
+
 /*
  * initialize this struct with zero
  *
- * data stored in the last two fields should be moved to a tmixelf_info
+ * data stored in the last five fields should be moved to a tmixelf_info
  */
 typedef struct {
     const char *strtab;
+    size_t strtab_size;
     size_t symtab_off;
     size_t hashtab_off;
-    size_t rel_off;
+    size_t rel_off;  // PLT relocation table
     size_t rel_size;
     bool rela;
+    size_t dynrel_off;  // general relocation table
+    size_t dynrel_size;
+    bool dynrela;
+    size_t dynrel_relative_count;  // number of leading RELATIVE entries in general relocation table
+    size_t relr_off;  // packed relative relocation table
+    size_t relr_size;
     tmix_array syms;  // array, optional
     tmix_array relocs;  // array, optional
+    tmix_array relatives;  // array, optional
+    tmix_array relr;  // array, optional
+    tmixelf_hashtab hashtab;  // optional
 } tmixelf_internal_symtab;
 
 /*
- * caller should fill the fields in eist as argument and set the last two fields to zero
+ * caller should fill the fields in eist as argument and set the last four fields to zero
  *
  * returns 0 if success, otherwise -1 and sets errno
  *
- * if this function fails, no memory need to be freed, but eist might get modified
- * otherwise the last two fields might be populated, caller should take the ownership of the data inside it
+ * all memory is allocated from arena, the last four fields might get modified even if this function fails
  */
-int _tmixelf_internal_parse_symtab(int fd, tmixelf_internal_symtab *eist);
+int _tmixelf_internal_parse_symtab(const tmixelf_internal_file *ef, tmix_arena *arena, tmixelf_internal_symtab *eist);
 
 #endif /* TERMIX_LOADER_ELF_INTERNAL_SYMTAB_H */
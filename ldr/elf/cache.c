@@ -0,0 +1,685 @@
+/*
+  cache.c - Persistent cache of ELF information
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#endif
+
+#include "../../inc/arch.h"
+#include "../../inc/paths.h"
+#include "../../inc/probes.h"
+#include "../../inc/prof.h"
+#include "../../inc/types.h"
+
+#include "elf.h"
+
+#include "_arch.h"
+#include "_info.h"
+
+#ifdef __APPLE__
+#  define _ST_MTIM(_st)           ((_st)->st_mtimespec)
+#else
+#  define _ST_MTIM(_st)           ((_st)->st_mtim)
+#endif
+
+#define _ENTRY_MAGIC              "TMIXEIC"
+#define _ENTRY_VERSION            (10)
+
+// sizes of serialized structs, entries written by another build are ignored
+#define _ENTRY_LAYOUT             ((uint32_t) (sizeof(size_t) << 24 | sizeof(tmixelf_seg) << 16 \
+                                               | sizeof(tmixelf_sym) << 8 | sizeof(tmixelf_reloc)))
+
+// entries are mapped in 1GiB slots from here, so names in them need no fixups
+#define _ENTRY_BASE_START         ((uintptr_t) 0x200000000000)
+#define _ENTRY_SLOT_SHIFT         (30)
+#define _ENTRY_SLOT_BITS          (14)
+
+// alignment of each array in an entry
+#define _ENTRY_ALIGN              (16)
+#define _ALIGN_UP(_x)             (((_x) + _ENTRY_ALIGN - 1) & ~((size_t) _ENTRY_ALIGN - 1))
+
+/*
+ * header of a cache entry, followed by the arrays it refers to
+ *
+ * all arrays are stored as chunks relative to the start of the entry,
+ * names are stored as pointers into strtab as if the entry is mapped at base
+ */
+typedef struct {
+    char magic[sizeof(_ENTRY_MAGIC)];
+    uint32_t version;
+    uint32_t layout;
+    size_t total_size;  // size of the whole entry
+    uintptr_t base;  // preferred address to map the entry at
+
+    // identity of the cached file
+
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    size_t build_id_off;  // file offset of build ID, checked against the file on every hit
+
+    // tmixelf_info fields
+
+    size_t entry;
+    tmix_chunk phdrs;
+    size_t mem_size;
+    size_t align;
+    bool execstack;
+    tmixelf_tls tls;
+    bool bind_now;
+    bool implicit_addends;
+    size_t pltgot;
+    size_t soname_off;  // offset in strtab, zero if not present
+    size_t init;
+    tmix_chunk init_array;
+    uint32_t nbuckets;
+    uint32_t symoffset;
+    uint32_t bloom_size;
+    uint32_t bloom_shift;
+
+    tmix_chunk segs;
+    tmix_chunk relros;
+    tmix_chunk syms;
+    tmix_chunk needs;
+    tmix_chunk relocs;
+    tmix_chunk relatives;
+    tmix_chunk relr;
+    tmix_chunk build_id;
+    tmix_chunk strtab;
+    tmix_chunk bloom;
+    tmix_chunk buckets;
+    tmix_chunk chain;
+} __entry_header;
+
+#if !defined(_WIN32) && defined(TMIX64)
+/*
+ * returns whether the header describes the file with st
+ */
+static bool __same_file(const __entry_header *hdr, const struct stat *st) {
+    return hdr->dev == (uint64_t) st->st_dev
+           && hdr->ino == (uint64_t) st->st_ino
+           && hdr->size == (uint64_t) st->st_size
+           && hdr->mtime_sec == (int64_t) _ST_MTIM(st).tv_sec
+           && hdr->mtime_nsec == (int64_t) _ST_MTIM(st).tv_nsec;
+}
+
+/*
+ * returns the preferred address to map the entry of the file with st at,
+ * spread by file identity to avoid clashing with entries of other files
+ */
+static uintptr_t __preferred_base(const struct stat *st) {
+    uint64_t h = ((uint64_t) st->st_dev * 31 + (uint64_t) st->st_ino) * 0x9e3779b97f4a7c15ull;
+
+    return _ENTRY_BASE_START + ((uintptr_t) (h >> (64 - _ENTRY_SLOT_BITS)) << _ENTRY_SLOT_SHIFT);
+}
+
+/*
+ * returns whether the chunk lies in an entry of given size, and holds whole elements
+ */
+static bool __valid_chunk(const tmix_chunk *chunk, size_t total_size, size_t elem_size) {
+    return chunk->off <= total_size
+           && chunk->size <= total_size - chunk->off
+           && !(chunk->off % _ENTRY_ALIGN)
+           && !(chunk->size % elem_size);
+}
+
+/*
+ * returns whether size bytes at off lie in limit bytes
+ */
+static inline bool __within(size_t off, size_t size, size_t limit) {
+    return off <= limit && size <= limit - off;
+}
+
+/*
+ * returns whether every location in the entry mapped at map lies in the loaded image,
+ * or the file for segments, and segments are sorted, as the loader writes there unchecked
+ */
+static bool __valid_locations(const char *map, const __entry_header *hdr) {
+    const tmixelf_seg *segs = (const tmixelf_seg *) &map[hdr->segs.off];
+    const tmix_chunk *relros = (const tmix_chunk *) &map[hdr->relros.off];
+    const tmixelf_reloc *relocs = (const tmixelf_reloc *) &map[hdr->relocs.off];
+    const tmixelf_relative *relatives = (const tmixelf_relative *) &map[hdr->relatives.off];
+    const size_t *relr = (const size_t *) &map[hdr->relr.off];
+    size_t mem_size = hdr->mem_size;
+    size_t i;
+
+    for (i = 0; i < hdr->segs.size / sizeof(tmixelf_seg); i++) {
+        if (!__within(segs[i].off, segs[i].file.size, mem_size)
+            || !__within(segs[i].file.off, segs[i].file.size, hdr->size)
+            || !__within(segs[i].pad.off, segs[i].pad.size, mem_size - segs[i].off)
+            || (i && segs[i].off < segs[i - 1].off))
+            return false;
+    }
+
+    for (i = 0; i < hdr->relros.size / sizeof(tmix_chunk); i++) {
+        if (!__within(relros[i].off, relros[i].size, mem_size))
+            return false;
+    }
+
+    for (i = 0; i < hdr->relocs.size / sizeof(tmixelf_reloc); i++) {
+        // a TLS descriptor takes two words
+        size_t size = (relocs[i].type == TMIXELF_RELOC_TLSDESC ? 2 : 1) * sizeof(size_t);
+
+        if (!__within(relocs[i].off, size, mem_size))
+            return false;
+    }
+
+    for (i = 0; i < hdr->relatives.size / sizeof(tmixelf_relative); i++) {
+        if (!__within(relatives[i].off, sizeof(size_t), mem_size))
+            return false;
+    }
+
+    // a bitmap covers the words after the last address, and needs one before it
+
+    size_t next = 0;
+    bool addressed = false;
+
+    for (i = 0; i < hdr->relr.size / sizeof(size_t); i++) {
+        size_t word = relr[i];
+
+        if (!(word & 1)) {
+            if (!__within(word, sizeof(size_t), mem_size))
+                return false;
+
+            next = word + sizeof(size_t);
+            addressed = true;
+            continue;
+        }
+
+        size_t bitmap = word >> 1;
+
+        if (!addressed)
+            return false;
+
+        if (bitmap) {
+            size_t last = 8 * sizeof(unsigned long long) - 1 - __builtin_clzll(bitmap);  // highest bit set
+
+            if (!__within(next, (last + 1) * sizeof(size_t), mem_size))
+                return false;
+        }
+
+        next += (8 * sizeof(size_t) - 1) * sizeof(size_t);
+    }
+
+    return (!hdr->entry || hdr->entry < mem_size)
+           && (!hdr->pltgot || hdr->pltgot < mem_size)
+           && (!hdr->init || hdr->init < mem_size)
+           && __within(hdr->init_array.off, hdr->init_array.size, mem_size)
+           && !(hdr->init_array.size % sizeof(uintptr_t))
+           && hdr->phdrs.size <= mem_size / sizeof(_ElfXX_Phdr)
+           && __within(hdr->phdrs.off, hdr->phdrs.size * sizeof(_ElfXX_Phdr), mem_size);
+}
+
+/*
+ * returns the offset of name in strtab of ei
+ */
+static size_t __name_off(const tmixelf_info *ei, const char *name) {
+    return ei->strtab ? (size_t) (name - ei->strtab) : 0;
+}
+
+/*
+ * number of hash chain words of ei, see __parse_hashtab in symtab.c
+ */
+static size_t __chain_count(const tmixelf_info *ei) {
+    const tmixelf_hashtab *ht = &ei->hashtab;
+    uint32_t max_idx = 0;
+    size_t i;
+
+    for (i = 0; i < ht->nbuckets; i++) {
+        if (ht->buckets[i] > max_idx)
+            max_idx = ht->buckets[i];
+    }
+
+    if (max_idx < ht->symoffset)
+        return 0;
+
+    for (i = max_idx - ht->symoffset; !(ht->chain[i] & 1); i++);
+
+    return i + 1;
+}
+
+/*
+ * save ei of the file with st to path
+ *
+ * returns 0 if success, otherwise -1 and sets errno
+ */
+static int __write_entry(const char *path, const struct stat *st, const tmixelf_info *ei) {
+    const tmixelf_sym *syms = ei->syms.data;  // array
+    const char **needs = ei->needs.data;  // array
+    size_t i;
+
+    // the string table size is not kept after parsing, only save the referred part
+
+    size_t strtab_size = 1;
+
+    for (i = 0; ei->strtab && i < ei->syms.size; i++) {
+        size_t end = __name_off(ei, syms[i].name) + strlen(syms[i].name) + 1;
+
+        if (end > strtab_size)
+            strtab_size = end;
+    }
+
+    for (i = 0; ei->strtab && i < ei->needs.size; i++) {
+        size_t end = __name_off(ei, needs[i]) + strlen(needs[i]) + 1;
+
+        if (end > strtab_size)
+            strtab_size = end;
+    }
+
+    if (ei->soname && __name_off(ei, ei->soname) + strlen(ei->soname) + 1 > strtab_size)
+        strtab_size = __name_off(ei, ei->soname) + strlen(ei->soname) + 1;
+
+    // lay out all arrays after the header
+
+    __entry_header hdr = {
+        .magic = _ENTRY_MAGIC,
+        .version = _ENTRY_VERSION,
+        .layout = _ENTRY_LAYOUT,
+        .base = __preferred_base(st),
+        .dev = st->st_dev,
+        .ino = st->st_ino,
+        .size = st->st_size,
+        .mtime_sec = _ST_MTIM(st).tv_sec,
+        .mtime_nsec = _ST_MTIM(st).tv_nsec,
+        .build_id_off = ei->build_id_off,
+        .entry = ei->entry,
+        .phdrs = ei->phdrs,
+        .mem_size = ei->mem_size,
+        .align = ei->align,
+        .execstack = ei->execstack,
+        .tls = ei->tls,
+        .bind_now = ei->bind_now,
+        .implicit_addends = ei->implicit_addends,
+        .pltgot = ei->pltgot,
+        .soname_off = ei->soname ? __name_off(ei, ei->soname) : 0,
+        .init = ei->init,
+        .init_array = ei->init_array,
+        .nbuckets = ei->hashtab.nbuckets,
+        .symoffset = ei->hashtab.symoffset,
+        .bloom_size = ei->hashtab.bloom_size,
+        .bloom_shift = ei->hashtab.bloom_shift,
+        .segs.size = ei->segs.size * sizeof(tmixelf_seg),
+        .relros.size = ei->relros.size * sizeof(tmix_chunk),
+        .syms.size = ei->syms.size * sizeof(tmixelf_sym),
+        .needs.size = ei->needs.size * sizeof(const char *),
+        .relocs.size = ei->relocs.size * sizeof(tmixelf_reloc),
+        .relatives.size = ei->relatives.size * sizeof(tmixelf_relative),
+        .relr.size = ei->relr.size * sizeof(size_t),
+        .build_id.size = ei->build_id.size,
+        .strtab.size = strtab_size,
+        .bloom.size = ei->hashtab.bloom_size * sizeof(size_t),
+        .buckets.size = ei->hashtab.nbuckets * sizeof(uint32_t),
+        .chain.size = ei->hashtab.nbuckets ? __chain_count(ei) * sizeof(uint32_t) : 0,
+    };
+
+    tmix_chunk *chunks[] = {&hdr.segs, &hdr.relros, &hdr.syms, &hdr.needs, &hdr.relocs, &hdr.relatives,
+                            &hdr.relr, &hdr.build_id, &hdr.strtab, &hdr.bloom, &hdr.buckets, &hdr.chain};
+    const void *data[] = {ei->segs.data, ei->relros.data, NULL, NULL, ei->relocs.data, ei->relatives.data,
+                          ei->relr.data, ei->build_id.data, ei->strtab, ei->hashtab.bloom, ei->hashtab.buckets, ei->hashtab.chain};
+    size_t off = _ALIGN_UP(sizeof(hdr));
+
+    for (i = 0; i < sizeof(chunks) / sizeof(*chunks); i++) {
+        chunks[i]->off = off;
+        off = _ALIGN_UP(off + chunks[i]->size);
+    }
+
+    hdr.total_size = off;
+
+    char *buff = calloc(1, hdr.total_size);
+
+    if (!buff)
+        return -1;
+
+    memcpy(buff, &hdr, sizeof(hdr));
+
+    for (i = 0; i < sizeof(chunks) / sizeof(*chunks); i++) {
+        if (data[i] && chunks[i]->size)
+            memcpy(&buff[chunks[i]->off], data[i], chunks[i]->size);
+    }
+
+    // names are pointed into strtab in the entry mapped at base
+
+    uintptr_t strtab_addr = hdr.base + hdr.strtab.off;
+    tmixelf_sym *entry_syms = (tmixelf_sym *) &buff[hdr.syms.off];
+    uintptr_t *entry_needs = (uintptr_t *) &buff[hdr.needs.off];
+
+    for (i = 0; i < ei->syms.size; i++) {
+        entry_syms[i] = syms[i];
+        entry_syms[i].name = (const char *) (strtab_addr + __name_off(ei, syms[i].name));
+    }
+
+    for (i = 0; i < ei->needs.size; i++)
+        entry_needs[i] = strtab_addr + __name_off(ei, needs[i]);
+
+    // write to a temporary file, then replace the old entry at once,
+    // so readers never see a partial entry
+
+    char *tmp_path = malloc(strlen(path) + sizeof(".XXXXXX"));
+
+    if (!tmp_path)
+        goto error_free_buff;
+
+    sprintf(tmp_path, "%s.XXXXXX", path);
+
+    int fd = mkstemp(tmp_path);
+
+    if (fd < 0)
+        goto error_free_path;
+
+    for (off = 0; off < hdr.total_size;) {
+        ssize_t nwritten = write(fd, &buff[off], hdr.total_size - off);
+
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+
+            goto error_unlink;
+        }
+
+        off += nwritten;
+    }
+
+    if (close(fd) < 0) {
+        fd = -1;
+        goto error_unlink;
+    }
+
+    fd = -1;
+
+    if (rename(tmp_path, path) < 0)
+        goto error_unlink;
+
+    free(tmp_path);
+    free(buff);
+
+    return 0;
+
+error_unlink:
+    if (!(fd < 0))
+        close(fd);
+
+    unlink(tmp_path);
+error_free_path:
+    free(tmp_path);
+error_free_buff:
+    free(buff);
+
+    return -1;
+}
+
+/*
+ * map the entry at path into ei, if it matches the file fd with st
+ *
+ * returns 0 if hit, 1 if the entry cannot be mapped at its preferred address, otherwise -1
+ */
+static int __map_entry(const char *path, int fd, const struct stat *st, tmixelf_info *ei) {
+    int entry_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (entry_fd < 0)
+        return -1;
+
+    struct stat entry_st;
+
+    if (fstat(entry_fd, &entry_st) < 0 || (size_t) entry_st.st_size < sizeof(__entry_header)) {
+        close(entry_fd);
+        return -1;
+    }
+
+    // the entry is only usable at its preferred address, fixing up names elsewhere
+    // dirties their pages and costs more than parsing
+
+    size_t total_size = entry_st.st_size;
+    uintptr_t base;
+
+    if (pread(entry_fd, &base, sizeof(base), offsetof(__entry_header, base)) != sizeof(base)) {
+        close(entry_fd);
+        return -1;
+    }
+
+    char *map = mmap((void *) base, total_size, PROT_READ, MAP_PRIVATE, entry_fd, 0);
+
+    close(entry_fd);
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+    if (map == MAP_FAILED)
+        return -1;
+
+    if ((uintptr_t) map != base) {
+        // probably the same file is parsed again, the entry is still fine for others
+        munmap(map, total_size);
+        return 1;
+    }
+
+    const __entry_header *hdr = (const __entry_header *) map;
+
+    if (memcmp(hdr->magic, _ENTRY_MAGIC, sizeof(hdr->magic))
+        || hdr->version != _ENTRY_VERSION
+        || hdr->layout != _ENTRY_LAYOUT
+        || hdr->total_size != total_size
+        || !__same_file(hdr, st))
+        goto miss;
+
+    // the entry may be corrupted, never trust it
+
+    if (!__valid_chunk(&hdr->segs, total_size, sizeof(tmixelf_seg))
+        || !__valid_chunk(&hdr->relros, total_size, sizeof(tmix_chunk))
+        || !__valid_chunk(&hdr->syms, total_size, sizeof(tmixelf_sym))
+        || !__valid_chunk(&hdr->needs, total_size, sizeof(const char *))
+        || !__valid_chunk(&hdr->relocs, total_size, sizeof(tmixelf_reloc))
+        || !__valid_chunk(&hdr->relatives, total_size, sizeof(tmixelf_relative))
+        || !__valid_chunk(&hdr->relr, total_size, sizeof(size_t))
+        || !__valid_chunk(&hdr->build_id, total_size, 1)
+        || !__valid_chunk(&hdr->strtab, total_size, 1)
+        || !__valid_chunk(&hdr->bloom, total_size, sizeof(size_t))
+        || !__valid_chunk(&hdr->buckets, total_size, sizeof(uint32_t))
+        || !__valid_chunk(&hdr->chain, total_size, sizeof(uint32_t)))
+        goto miss;
+
+    const char *strtab = &map[hdr->strtab.off];
+    size_t sym_count = hdr->syms.size / sizeof(tmixelf_sym);
+    size_t chain_count = hdr->chain.size / sizeof(uint32_t);
+    size_t i;
+
+    if (!hdr->strtab.size || strtab[hdr->strtab.size - 1])
+        goto miss;
+
+    if (hdr->nbuckets) {
+        const uint32_t *buckets = (const uint32_t *) &map[hdr->buckets.off];
+        const uint32_t *chain = (const uint32_t *) &map[hdr->chain.off];
+
+        if (hdr->bloom.size != hdr->bloom_size * sizeof(size_t)
+            || hdr->buckets.size != hdr->nbuckets * sizeof(uint32_t)
+            || !hdr->bloom_size || hdr->bloom_shift >= 32
+            || hdr->symoffset > sym_count
+            || chain_count > sym_count - hdr->symoffset
+            || (chain_count && !(chain[chain_count - 1] & 1)))
+            goto miss;
+
+        for (i = 0; i < hdr->nbuckets; i++) {
+            if (buckets[i] >= hdr->symoffset && buckets[i] - hdr->symoffset >= chain_count)
+                goto miss;
+        }
+    }
+
+    // the file may have been rebuilt in place without changing its timestamp
+
+    if (hdr->build_id.size) {
+        char build_id[64];
+
+        if (hdr->build_id.size > sizeof(build_id)
+            || pread(fd, build_id, hdr->build_id.size, hdr->build_id_off) != (ssize_t) hdr->build_id.size
+            || memcmp(build_id, &map[hdr->build_id.off], hdr->build_id.size))
+            goto miss;
+    }
+
+    // check names
+
+    uintptr_t strtab_addr = base + hdr->strtab.off;
+    const tmixelf_sym *syms = (const tmixelf_sym *) &map[hdr->syms.off];
+    const char **needs = (const char **) &map[hdr->needs.off];
+    const tmixelf_reloc *relocs = (const tmixelf_reloc *) &map[hdr->relocs.off];
+
+    for (i = 0; i < sym_count; i++) {
+        uintptr_t name_off = (uintptr_t) syms[i].name - strtab_addr;
+
+        if (name_off >= hdr->strtab.size)
+            goto miss;
+    }
+
+    for (i = 0; i < hdr->needs.size / sizeof(const char *); i++) {
+        uintptr_t name_off = (uintptr_t) needs[i] - strtab_addr;
+
+        if (name_off >= hdr->strtab.size)
+            goto miss;
+    }
+
+    for (i = 0; i < hdr->relocs.size / sizeof(tmixelf_reloc); i++) {
+        if (relocs[i].symidx >= sym_count)
+            goto miss;
+    }
+
+    if (hdr->soname_off >= hdr->strtab.size)
+        goto miss;
+
+    if (hdr->tls.init.size > hdr->tls.size || !__within(hdr->tls.init.off, hdr->tls.init.size, hdr->mem_size))
+        goto miss;
+
+    if (!__valid_locations(map, hdr))
+        goto miss;
+
+    // finally move everything to ei
+
+    memset(ei, 0, sizeof(*ei));
+
+    ei->entry = hdr->entry;
+    ei->phdrs = hdr->phdrs;
+    ei->mem_size = hdr->mem_size;
+    ei->align = hdr->align;
+    ei->execstack = hdr->execstack;
+    ei->tls = hdr->tls;
+    ei->bind_now = hdr->bind_now;
+    ei->pltgot = hdr->pltgot;
+    ei->soname = hdr->soname_off ? &strtab[hdr->soname_off] : NULL;
+    ei->init = hdr->init;
+    ei->init_array = hdr->init_array;
+    ei->segs = (tmix_array) {&map[hdr->segs.off], hdr->segs.size / sizeof(tmixelf_seg)};
+    ei->relros = (tmix_array) {&map[hdr->relros.off], hdr->relros.size / sizeof(tmix_chunk)};
+    ei->syms = (tmix_array) {(void *) syms, sym_count};
+    ei->needs = (tmix_array) {needs, hdr->needs.size / sizeof(const char *)};
+    ei->relocs = (tmix_array) {(void *) relocs, hdr->relocs.size / sizeof(tmixelf_reloc)};
+    ei->relatives = (tmix_array) {&map[hdr->relatives.off], hdr->relatives.size / sizeof(tmixelf_relative)};
+    ei->implicit_addends = hdr->implicit_addends;
+    ei->relr = (tmix_array) {&map[hdr->relr.off], hdr->relr.size / sizeof(size_t)};
+    ei->build_id = (tmix_array) {&map[hdr->build_id.off], hdr->build_id.size};
+    ei->build_id_off = hdr->build_id_off;
+    ei->strtab = strtab;
+    ei->map = (tmix_array) {map, total_size};
+
+    if (hdr->nbuckets) {
+        ei->hashtab.nbuckets = hdr->nbuckets;
+        ei->hashtab.symoffset = hdr->symoffset;
+        ei->hashtab.bloom_size = hdr->bloom_size;
+        ei->hashtab.bloom_shift = hdr->bloom_shift;
+        ei->hashtab.bloom = (const size_t *) &map[hdr->bloom.off];
+        ei->hashtab.buckets = (const uint32_t *) &map[hdr->buckets.off];
+        ei->hashtab.chain = (const uint32_t *) &map[hdr->chain.off];
+    }
+
+    return 0;
+
+miss:
+    munmap(map, total_size);
+
+    return -1;
+}
+#endif /* !_WIN32 && TMIX64 */
+
+int tmixelf_parse_info_cached(int fd, const char *cache_dir, tmixelf_info *ei) {
+#if defined(_WIN32) || !defined(TMIX64)
+    // TODO: support caching on Windows
+    // entries cannot be mapped at fixed addresses in 32-bit address space
+    (void) cache_dir;
+
+    return tmixelf_parse_info(fd, ei);
+#else
+    if (!cache_dir)
+        return tmixelf_parse_info(fd, ei);
+
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+
+    // one entry per file, replaced once the file is changed
+
+    char name[64];
+
+    snprintf(name, sizeof(name), "%jx-%jx.ei", (uintmax_t) st.st_dev, (uintmax_t) st.st_ino);
+
+    char *path = _tmix_join_path(cache_dir, name);
+
+    if (!path)
+        return tmixelf_parse_info(fd, ei);
+
+    _tmix_probe1(parse_start, fd);
+
+    int res = __map_entry(path, fd, &st, ei);
+
+    if (!res) {
+        free(path);
+
+        _tmix_probe3(parse_end, fd, 0, true);
+
+        return 0;
+    }
+
+    if (_tmixelf_internal_parse_info(fd, ei) < 0) {
+        int err = errno;
+
+        free(path);
+
+        _tmix_probe3(parse_end, fd, -1, false);
+
+        errno = err;
+
+        return -1;
+    }
+
+    if (res < 0)
+        __write_entry(path, &st, ei);  // failures are ignored
+
+    free(path);
+
+    _tmix_probe3(parse_end, fd, 0, false);
+
+    return 0;
+#endif
+}
@@ -19,30 +19,34 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdbool.h>
-#include <stdlib.h>
-#include <string.h>
 #include <sys/types.h>
-#include <unistd.h>
 
+#include "../../inc/arena.h"
 #include "../../inc/logging.h"
 
 #include "_arch.h"
 #include "_elf.h"
 
 #include "_dyn.h"
+#include "_file.h"
 #include "_symtab.h"
 
 #define _DYN_TAKE_PTR(_dyn)       ((_dyn).d_un.d_ptr)
 #define _DYN_TAKE_VAL(_dyn)       ((_dyn).d_un.d_val)
 
-int _tmixelf_internal_parse_dyn(int fd, const _ElfXX_Phdr *phdr, tmixelf_internal_dyn *eid) {
-    if (lseek(fd, phdr->p_offset, SEEK_SET) < 0)
+int _tmixelf_internal_parse_dyn(const tmixelf_internal_file *ef, const _ElfXX_Phdr *phdr,
+                                tmix_arena *arena, tmixelf_internal_dyn *eid) {
+    // walk the whole table in place
+
+    size_t dyn_ent_count = phdr->p_filesz / sizeof(_ElfXX_Dyn);
+    const _ElfXX_Dyn *dyns = _tmixelf_internal_load_file(ef, phdr->p_offset,
+                                                         dyn_ent_count * sizeof(_ElfXX_Dyn), arena);
+
+    if (!dyns)
         return -1;
 
     // iterate through all entries
 
-    _ElfXX_Dyn dyn;
-
     size_t strtab_off = 0;
     size_t strtab_size = 0;
     size_t symtab_off = 0;
@@ -50,17 +54,22 @@ int _tmixelf_internal_parse_dyn(int fd, const _ElfXX_Phdr *phdr, tmixelf_interna
     size_t rel_off = 0;
     size_t rel_size = 0;
     bool rela = false;
+    size_t dynrel_off = 0;
+    size_t dynrel_size = 0;
+    bool dynrela = false;
+    size_t relative_count = 0;
+    size_t relr_off = 0;
+    size_t relr_size = 0;
+    size_t soname_off = 0;
+    size_t flags;
 
-    size_t dyn_ent_count = 0;
     size_t needed_shlib_count = 0;
+    size_t i;
 
-    for (;;dyn_ent_count++) {
-        if (read(fd, &dyn, sizeof(_ElfXX_Dyn)) != sizeof(_ElfXX_Dyn)) {
-            errno = EIO;
-            return -1;
-        }
+    for (i = 0; i < dyn_ent_count; i++) {
+        const _ElfXX_Dyn *dyn = &dyns[i];  // current dynamic entry
 
-        switch (dyn.d_tag) {
+        switch (dyn->d_tag) {
             case DT_NULL:
                 // end of table, handled below
                 break;
@@ -71,100 +80,159 @@ int _tmixelf_internal_parse_dyn(int fd, const _ElfXX_Phdr *phdr, tmixelf_interna
                 // rpath, currently unused by us
                 break;
             case DT_GNU_HASH:
-                hashtab_off = _DYN_TAKE_PTR(dyn);
+                hashtab_off = _DYN_TAKE_PTR(*dyn);
                 break;
             case DT_STRTAB:
-                strtab_off = _DYN_TAKE_PTR(dyn);
+                strtab_off = _DYN_TAKE_PTR(*dyn);
                 break;
             case DT_STRSZ:
-                strtab_size = _DYN_TAKE_VAL(dyn);
+                strtab_size = _DYN_TAKE_VAL(*dyn);
                 break;
             case DT_SYMENT:
-                assert(_DYN_TAKE_VAL(dyn) == sizeof(_ElfXX_Sym));
+                assert(_DYN_TAKE_VAL(*dyn) == sizeof(_ElfXX_Sym));
                 break;
             case DT_SYMTAB:
-                symtab_off = _DYN_TAKE_PTR(dyn);
+                symtab_off = _DYN_TAKE_PTR(*dyn);
                 break;
             case DT_PLTGOT:
-                // unused by us for now
+                // for lazy binding
+                eid->pltgot = _DYN_TAKE_PTR(*dyn);
                 break;
             case DT_PLTRELSZ:
-                rel_size = _DYN_TAKE_VAL(dyn);
+                rel_size = _DYN_TAKE_VAL(*dyn);
                 break;
             case DT_PLTREL:
-                rela = _DYN_TAKE_VAL(dyn) == DT_RELA;
+                rela = _DYN_TAKE_VAL(*dyn) == DT_RELA;
                 break;
             case DT_JMPREL:
                 // location of relocation entries
-                rel_off = _DYN_TAKE_PTR(dyn);
+                rel_off = _DYN_TAKE_PTR(*dyn);
+                break;
+            case DT_RELA:
+            case DT_REL:
+                // location of general relocation entries, only one of them is used
+                dynrel_off = _DYN_TAKE_PTR(*dyn);
+                dynrela = dyn->d_tag == DT_RELA;
+                break;
+            case DT_RELASZ:
+            case DT_RELSZ:
+                dynrel_size = _DYN_TAKE_VAL(*dyn);
+                break;
+            case DT_RELAENT:
+                assert(_DYN_TAKE_VAL(*dyn) == sizeof(_ElfXX_Rela));
+                break;
+            case DT_RELENT:
+                assert(_DYN_TAKE_VAL(*dyn) == sizeof(_ElfXX_Rel));
+                break;
+            case DT_RELACOUNT:
+            case DT_RELCOUNT:
+                relative_count = _DYN_TAKE_VAL(*dyn);
+                break;
+            case DT_RELR:
+                // packed relative relocation entries, decoded when applied
+                relr_off = _DYN_TAKE_PTR(*dyn);
+                break;
+            case DT_RELRSZ:
+                relr_size = _DYN_TAKE_VAL(*dyn);
+                break;
+            case DT_RELRENT:
+                assert(_DYN_TAKE_VAL(*dyn) == sizeof(_ElfXX_Addr));
+                break;
+            case DT_BIND_NOW:
+                eid->bind_now = true;
+                break;
+            case DT_SONAME:
+                soname_off = _DYN_TAKE_VAL(*dyn);
+                break;
+            case DT_INIT:
+                eid->init = _DYN_TAKE_PTR(*dyn);
+                break;
+            case DT_INIT_ARRAY:
+                eid->init_array.off = _DYN_TAKE_PTR(*dyn);
+                break;
+            case DT_INIT_ARRAYSZ:
+                eid->init_array.size = _DYN_TAKE_VAL(*dyn);
+                break;
+            case DT_FINI:
+            case DT_FINI_ARRAY:
+            case DT_FINI_ARRAYSZ:
+                // images are never unloaded, ignored
+                break;
+            case DT_VERSYM:
+            case DT_VERDEF:
+            case DT_VERDEFNUM:
+            case DT_VERNEED:
+            case DT_VERNEEDNUM:
+                // symbol versions are not checked, ignored
+                break;
+            case DT_TLSDESC_PLT:
+            case DT_TLSDESC_GOT:
+                // TLS descriptors are always resolved eagerly, ignored
+                break;
+            case DT_FLAGS:
+                flags = _DYN_TAKE_VAL(*dyn);
+
+                if (flags & DF_BIND_NOW)
+                    eid->bind_now = true;
+
+                // TLS blocks are all static, ignore
+                if (flags & ~(size_t) (DF_BIND_NOW | DF_STATIC_TLS))
+                    tmix_fixme("unhandled flags %#" PRIxPTR, flags & ~(size_t) (DF_BIND_NOW | DF_STATIC_TLS));
                 break;
             case DT_FLAGS_1:
-                switch (_DYN_TAKE_VAL(dyn)) {
-                    case DF_1_PIE:
-                        // already assumed, ignore
-                        break;
-                    default:
-                        tmix_fixme("unhandled state flag %#" PRIxPTR, _DYN_TAKE_VAL(dyn));
-                        break;
-                }
+                flags = _DYN_TAKE_VAL(*dyn);
+
+                if (flags & DF_1_NOW)
+                    eid->bind_now = true;
+
+                // PIE is already assumed, ignore
+                if (flags & ~(size_t) (DF_1_NOW | DF_1_PIE))
+                    tmix_fixme("unhandled state flags %#" PRIxPTR, flags & ~(size_t) (DF_1_NOW | DF_1_PIE));
                 break;
             case DT_DEBUG:
                 // placeholder for runtime debug info, ignored
                 break;
             default:
-                tmix_fixme("unhandled dynamic tag %#" PRIxPTR, dyn.d_tag);
+                tmix_fixme("unhandled dynamic tag %#" PRIxPTR, dyn->d_tag);
                 break;
-        } /* switch (dyn.d_tag) */
+        } /* switch (dyn->d_tag) */
 
-        if (dyn.d_tag == DT_NULL)
+        if (dyn->d_tag == DT_NULL)
             break;  // end of table, stop
-    } /* for (;;) */
+    } /* for (i = 0; i < dyn_ent_count; i++) */
+
+    dyn_ent_count = i;  // the rest are unused
 
     // now let's finish up our todos
 
-    char *strtab = NULL;  // optional
-    _ElfXX_Dyn *dyns = NULL;  // array, optional
-    char **needs = NULL;  // array, optional
+    const char *strtab = NULL;  // optional
+    const char **needs = NULL;  // array, optional
 
     // prepare string tab is needed
 
     if (strtab_size) {
-        if (!(strtab = malloc(strtab_size)))
-            return -1;
-
         assert(strtab_off);
 
-        if (lseek(fd, strtab_off, SEEK_SET) < 0)
-            goto error;
-
-        if (read(fd, strtab, strtab_size) != (ssize_t)strtab_size)
-            goto read_failed;
-    }
-
-    // prepare dynamic entries
-
-    if (dyn_ent_count) {
-        if (lseek(fd, phdr->p_offset, SEEK_SET) < 0)
-            goto error;
-
-        if (!(dyns = calloc(dyn_ent_count, sizeof(_ElfXX_Dyn))))
-            goto error;
-
-        if (read(fd, dyns, sizeof(_ElfXX_Dyn) * dyn_ent_count) != (ssize_t)(sizeof(_ElfXX_Dyn) * dyn_ent_count)) {
-read_failed:
-            errno = EIO;
-error:
-            if (strtab)
-                free(strtab);
+        if (_tmixelf_internal_vaddr_to_off(ef, strtab_off, strtab_size, &strtab_off) < 0)
+            return -1;
 
-            if (dyns)
-                free(dyns);
+        if (!(strtab = _tmixelf_internal_load_file(ef, strtab_off, strtab_size, arena)))
+            return -1;
 
-            if (needs)
-                free(needs);
+        if (strtab[strtab_size - 1] != '\0') {
+            // string table is not terminated
+            errno = EBADF;
+            return -1;
+        }
+    }
 
+    if (soname_off) {
+        if (soname_off >= strtab_size) {
+            errno = EBADF;
             return -1;
         }
+
+        eid->soname = &strtab[soname_off];
     }
 
     // handle needed shlibs if needed
@@ -172,43 +240,32 @@ error:
     if (needed_shlib_count) {
         // at least one needed shlib is found
 
-        assert(dyns);
-        assert(strtab);
+        if (!strtab) {
+            errno = EBADF;
+            return -1;
+        }
 
-        if (!(needs = calloc(needed_shlib_count, sizeof(char *))))
-            goto error;
+        if (!(needs = _tmix_arena_calloc(arena, needed_shlib_count, sizeof(char *))))
+            return -1;
 
-        size_t i;
         size_t j = 0;  // index of current needed shlib
 
         // iterate through all entries again
 
         for (i = 0; i < dyn_ent_count; i++) {
-            _ElfXX_Dyn *dyn = &dyns[i];  // current dynamic entry
+            const _ElfXX_Dyn *dyn = &dyns[i];  // current dynamic entry
 
             if (dyn->d_tag == DT_NEEDED) {
-                // find location and size of shlib name in the strtab
-
-                size_t name_off = _DYN_TAKE_VAL(dyns[i]);
-                assert(name_off);
+                // find location of shlib name in the strtab, no copy needed
 
-                char *name = &strtab[name_off];
-                size_t name_len = strlen(name);
-                assert(name_len);
+                size_t name_off = _DYN_TAKE_VAL(*dyn);
 
-                // copy it to array
-                char *name_buff = malloc(name_len + 1);
-
-                if (!name_buff) {
-                    // free up messes before return
-                    for (i = 0; i < j; i++)
-                        free(needs[i]);
-
-                    goto error;
+                if (!name_off || name_off >= strtab_size) {
+                    errno = EBADF;
+                    return -1;
                 }
 
-                strcpy(name_buff, name);
-                needs[j++] = name_buff;
+                needs[j++] = &strtab[name_off];
             }
         }
 
@@ -217,21 +274,26 @@ error:
         eid->needs.size = needed_shlib_count;
     }
 
-    // next
-
-    assert(hashtab_off);
+    // next, exports cannot be looked up without DT_GNU_HASH, which is up to the caller
 
     tmixelf_internal_symtab eist = {
         .strtab = strtab,
+        .strtab_size = strtab_size,
         .symtab_off = symtab_off,
         .hashtab_off = hashtab_off,
         .rel_off = rel_off,
         .rel_size = rel_size,
         .rela = rela,
+        .dynrel_off = dynrel_off,
+        .dynrel_size = dynrel_size,
+        .dynrela = dynrela,
+        .dynrel_relative_count = relative_count,
+        .relr_off = relr_off,
+        .relr_size = relr_size,
     };
 
-    if (_tmixelf_internal_parse_symtab(fd, &eist) < 0)
-        goto error;
+    if (_tmixelf_internal_parse_symtab(ef, arena, &eist) < 0)
+        return -1;
 
     if (eist.syms.size) {
         // at least one symbol is found
@@ -247,12 +309,22 @@ error:
         }
     }
 
-    // finally...
-    if (strtab)
-        free(strtab);
+    if (eist.relatives.size) {
+        eid->relatives.data = eist.relatives.data;
+        eid->relatives.size = eist.relatives.size;
+    }
+
+    eid->implicit_addends = dynrel_size && !dynrela;
+
+    if (eist.relr.size) {
+        eid->relr.data = eist.relr.data;
+        eid->relr.size = eist.relr.size;
+    }
+
+    eid->hashtab = eist.hashtab;
 
-    if (dyns)
-        free(dyns);
+    // names in needs and syms point into it, so keep it
+    eid->strtab = strtab;
 
     return 0;
 }
@@ -19,9 +19,11 @@
 #define TERMIX_LOADER_ELF_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 #include "../../inc/abi.h"
+#include "../../inc/arena.h"
 #include "../../inc/types.h"
 
 #ifdef __clangd__
@@ -60,29 +62,81 @@ typedef struct {
  */
 typedef enum {
     TMIXELF_SYM_DATA = 0,  // symbol is data (variables)
-    TMIXELF_SYM_FUNC = 1  // symbol is a function
+    TMIXELF_SYM_FUNC = 1,  // symbol is a function
+    TMIXELF_SYM_TLS = 2  // symbol is thread-local, located relative to the TLS block of its image
 } tmixelf_sym_type;
 
 /*
  * ELF symbol
  *
- * name - dynamically allocated, need to be freed once this struct is not used
+ * name - points into the string table of the owning tmixelf_info, valid until it is freed
  */
 typedef struct {
-    char *name;
+    const char *name;
     tmixelf_sym_type type;
     bool imported;
+    bool weak;  // whether the symbol is weak, a missing weak import is bound to zero
     size_t off;  // location of the symbol, ignored if the symbol is imported
+    uint32_t hash;  // GNU hash of the name, only computed for imported symbols
 } tmixelf_sym;
 
+/*
+ * ELF relocation type
+ */
+typedef enum {
+    TMIXELF_RELOC_JUMP_SLOT = 0,  // address of the symbol for a PLT entry, can be bound lazily
+    TMIXELF_RELOC_GLOB_DAT = 1,  // address of the symbol
+    TMIXELF_RELOC_ABS = 2,  // address of the symbol plus addend
+    // thread-local ones below, the symbol is the image itself if its index is zero
+    TMIXELF_RELOC_TPOFF = 3,  // offset of the symbol plus addend from the thread pointer
+    TMIXELF_RELOC_DTPMOD = 4,  // module ID of the image defining the symbol
+    TMIXELF_RELOC_DTPOFF = 5,  // offset of the symbol plus addend in the TLS block of its image
+    TMIXELF_RELOC_TLSDESC = 6  // TLS descriptor of the symbol plus addend, i.e. a resolver and its argument
+} tmixelf_reloc_type;
+
 /*
  * ELF relocation entry
  */
 typedef struct {
     size_t symidx;  // index of the relocated symbol in symbol table
     size_t off;  // location to the where the address to the symbol is stored
+    size_t idx;  // index of the entry in the relocation table of the file
+    tmixelf_reloc_type type;
+    size_t addend;  // ignored if addends are implicit, see tmixelf_info
 } tmixelf_reloc;
 
+/*
+ * ELF relocation entry adjusted by the load address only (i.e. RELATIVE)
+ */
+typedef struct {
+    size_t off;  // location where the adjusted address is stored
+    size_t addend;  // address relative to the first segment, ignored if addends are implicit
+} tmixelf_relative;
+
+/*
+ * GNU-style hash table of exported symbols
+ *
+ * arrays point into the mapping, or a copy in the arena of the owning tmixelf_info
+ */
+typedef struct {
+    uint32_t nbuckets;  // zero if no hash table present
+    uint32_t symoffset;  // index of the first symbol covered by the table
+    uint32_t bloom_size;  // number of words in bloom
+    uint32_t bloom_shift;
+    const size_t *bloom;  // bloom filter words
+    const uint32_t *buckets;  // index of the first symbol in each bucket
+    const uint32_t *chain;  // hash of each covered symbol, lowest bit marks the end of a chain
+} tmixelf_hashtab;
+
+/*
+ * thread-local storage of an ELF (PT_TLS)
+ */
+typedef struct {
+    tmix_chunk init;  // location (relative to the first segment) and size of the initialization image
+    size_t size;  // size of the TLS block, zeros after the initialization image, zero if no PT_TLS
+    size_t align;  // alignment of the TLS block
+} tmixelf_tls;
+
 /*
  * describes information of an ELF file
  *
@@ -90,29 +144,112 @@ typedef struct {
  */
 typedef struct {
     size_t entry;  // entrypoint address (relative to the first segment)
+    tmix_chunk phdrs;  // location of program headers (relative to the first segment) and their number, empty if not loaded
     tmix_array segs;  // array of segment informations (i.e. tmixelf_seg)
     size_t mem_size;  // sum of sizes of all loadable semgents
-    tmix_array syms;  // array of symbols from the ELF symbol table (i.e. tmixelf_sym)
+    size_t align;  // largest alignment of loadable segments (p_align), a multiple of the page size
+    tmix_array syms;  // array of symbols from the ELF symbol table (i.e. tmixelf_sym), in the same order
     bool execstack;  // whether if has an executable stack
+    tmixelf_tls tls;  // thread-local storage
     tmix_array relros;  /* array of segments that require changing memory protection to
                            read-only after dynamic linking, each element storing tmix_chunk */
-    tmix_array needs;  // list of depended shared library names
-    tmix_array relocs;  // list of relocation entries (i.e. tmixelf_reloc)
+    tmix_array needs;  // list of depended shared library names (i.e. const char *)
+    tmix_array relocs;  // list of relocation entries (i.e. tmixelf_reloc), sorted by location
+    tmix_array relatives;  // list of RELATIVE relocation entries (i.e. tmixelf_relative), sorted by location
+    bool implicit_addends;  // whether addends are stored at the relocated locations (Rel) instead
+    tmix_array relr;  /* packed RELATIVE relocation entries (i.e. size_t) as stored in DT_RELR,
+                         addends are always stored at the relocated locations */
+    size_t pltgot;  // location of the GOT used by PLT entries, zero if not present
+    const char *soname;  // name of the shared object itself (DT_SONAME), NULL if not present
+    size_t init;  // location of the initialization function (DT_INIT), zero if not present
+    tmix_chunk init_array;  // location and size in bytes of the array of initialization functions
+    bool bind_now;  // whether all symbols should be bound before running (DF_BIND_NOW or DF_1_NOW)
+    tmix_array build_id;  // GNU build ID (i.e. bytes), empty if not present
+    size_t build_id_off;  // file offset of build_id
+    tmixelf_hashtab hashtab;  // for looking up exported symbols
+    const char *strtab;  // dynamic string table, all names above point into it
+    tmix_array map;  /* read-only mapping which strtab and build_id point into, i.e. the whole ELF file
+                        or a cache entry, empty if the file could not be mapped (they are copies in arena then) */
+    tmix_arena arena;  // private, storage of all arrays above
 } tmixelf_info;
 
 /*
  * fd - read-only file descriptor referencing and opened ELF file
  * ei - output buffer
  *
- * returns 0 if succeed, otherwise -1 and sets errno
+ * the file is mapped once and parsed in place when possible, otherwise
+ * it is read piece by piece instead
+ *
+ * this function is thread-safe: it only uses positional I/O and never moves the
+ * file offset of fd, nor does it keep any global state, so the same fd can be parsed
+ * by multiple threads at once, or shared with tmixldr_load_elf
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, ENOTSUP if some relocation types are not supported
  *
  * on success, the old content in ei is cleared,
  * if the function fails, the old content in ei is unchanged.
  *
- * caller should call free_elfinfo once the returned information is no longer used
+ * caller should call tmixelf_free_info once the returned information is no longer used
  */
 _tmixlibelf_api int tmixelf_parse_info(int fd, tmixelf_info *ei);
 
+/*
+ * fd - same as tmixelf_parse_info
+ * cache_dir - directory storing cache entries, NULL to disable caching
+ * ei - output buffer
+ *
+ * same as tmixelf_parse_info, but the parsed information is saved in cache_dir, keyed by
+ * device, inode, size, modification time and GNU build ID of the file
+ *
+ * on a cache hit the entry is mapped and used directly without parsing the file,
+ * errors of the cache itself are ignored, the file is parsed as usual then
+ */
+_tmixlibelf_api int tmixelf_parse_info_cached(int fd, const char *cache_dir, tmixelf_info *ei);
+
+/*
+ * returns the GNU hash of a symbol name
+ */
+_tmixlibelf_api uint32_t tmixelf_gnu_hash(const char *name);
+
+/*
+ * ei - information of the ELF exporting the symbol
+ * name - name of the symbol to look up
+ * hash - GNU hash of name, e.g. the hash field of an imported tmixelf_sym
+ *
+ * returns the exported symbol, NULL if not found
+ *
+ * most misses are rejected by the bloom filter without touching the symbol table
+ */
+_tmixlibelf_api const tmixelf_sym *tmixelf_lookup_sym(const tmixelf_info *ei, const char *name, uint32_t hash);
+
+/*
+ * hashes[i] is set to the GNU hash of names[i]
+ *
+ * several names are hashed at once with SIMD instructions when the machine supports them
+ */
+_tmixlibelf_api void tmixelf_gnu_hash_batch(const char *const *names, size_t n, uint32_t *hashes);
+
+/*
+ * ei - information of the ELF exporting the symbols
+ * syms - symbols to look up, hash fields must be set
+ * n - number of syms
+ * res - res[i] is set to the exported symbol of syms[i], NULL if not found
+ *
+ * returns the number of symbols found
+ *
+ * same as calling tmixelf_lookup_sym for each symbol, but bloom filter
+ * probes of the whole batch are done with SIMD instructions first
+ */
+_tmixlibelf_api size_t tmixelf_lookup_syms(const tmixelf_info *ei, const tmixelf_sym *syms, size_t n,
+                                           const tmixelf_sym **res);
+
+/*
+ * returns the name of the instruction set used by batch functions, e.g. "avx2"
+ *
+ * can be limited with environment variable TMIXELF_SIMD (scalar, sse2)
+ */
+_tmixlibelf_api const char *tmixelf_simd_name(void);
+
 /*
  * to print out the information in an elfinfo buffer
  *
@@ -123,7 +260,7 @@ _tmixlibelf_api void tmixelf_print_info(const tmixelf_info *ei);
 /*
  * ei - buffer to free
  *
- * returns 0 if succeed, otherwise -1 and sets errno
+ * all arrays are released at once, names in them become invalid as well
  */
 _tmixlibelf_api void tmixelf_free_info(tmixelf_info *ei);
 
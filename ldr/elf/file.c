@@ -0,0 +1,209 @@
+/*
+  file.c - ELF file access
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>  // for pread
+
+#ifdef _WIN32
+#  include <io.h>  // for _get_osfhandle
+
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <sys/mman.h>
+#endif
+
+#include "../../inc/arena.h"
+#include "../../inc/prof.h"
+
+#include "_arch.h"
+#include "_elf.h"
+#include "_file.h"
+
+static bool __no_map = false;  // whether to always read, only set by the constructor below
+
+/*
+ * read exactly size bytes at file offset off without touching the file offset
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __pread_full(int fd, void *buff, size_t size, size_t off) {
+#ifdef _WIN32
+    HANDLE hFile = (HANDLE) _get_osfhandle(fd);
+
+    if (hFile == INVALID_HANDLE_VALUE) {
+        errno = EBADF;
+        return -1;
+    }
+#endif
+
+    while (size) {
+#ifdef _WIN32
+        // NOTE: unlike pread, this still moves the file pointer of synchronous handles,
+        //       but nothing in libelf relies on it
+        OVERLAPPED ov = {};
+        DWORD chunk = size > MAXDWORD ? MAXDWORD : (DWORD) size;
+        DWORD nread = 0;
+
+        ov.Offset = (DWORD) (((uint64_t) off) & 0xffffffff);
+        ov.OffsetHigh = (DWORD) (((uint64_t) off) >> 32);
+
+        if (!ReadFile(hFile, buff, chunk, &nread, &ov)) {
+            // FIXME: set errno according to win32 error
+            errno = EIO;
+            return -1;
+        }
+#else
+        ssize_t nread = pread(fd, buff, size, off);
+
+        if (nread < 0) {
+            if (errno == EINTR)
+                continue;
+
+            return -1;
+        }
+#endif
+
+        if (!nread) {
+            // unexpected EOF
+            errno = EIO;
+            return -1;
+        }
+
+        _tmix_prof_count(TMIX_PROF_BYTES_READ, nread);
+
+        buff = (char *) buff + nread;
+        size -= nread;
+        off += nread;
+    }
+
+    return 0;
+}
+
+int _tmixelf_internal_open_file(int fd, tmixelf_internal_file *ef) {
+    struct stat st;
+
+    if (fstat(fd, &st) < 0)
+        return -1;
+
+    ef->fd = fd;
+    ef->size = st.st_size;
+    ef->map = NULL;
+
+    if (!ef->size || __no_map)
+        return 0;  // nothing to map, or asked to read
+
+#ifdef _WIN32
+    HANDLE hFile = (HANDLE) _get_osfhandle(fd);
+
+    if (hFile == INVALID_HANDLE_VALUE)
+        return 0;  // fallback to reading
+
+    HANDLE hMapping = CreateFileMapping(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!hMapping)
+        return 0;
+
+    ef->map = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+
+    CloseHandle(hMapping);
+#else
+    void *map = mmap(NULL, ef->size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+    if (map != MAP_FAILED)
+        ef->map = map;
+#endif
+
+    // if mapping failed, we will fallback to reading
+
+    return 0;
+}
+
+void _tmixelf_internal_unmap_file(const void *map, size_t size) {
+#ifdef _WIN32
+    (void) size;
+
+    UnmapViewOfFile(map);
+#else
+    munmap((void *) map, size);
+#endif
+}
+
+const void *_tmixelf_internal_view_file(const tmixelf_internal_file *ef, size_t off, size_t size, void *buff) {
+    if (off > ef->size || size > ef->size - off) {
+        // out of bounds, the file is probably truncated
+        errno = EBADF;
+        return NULL;
+    }
+
+    if (ef->map)
+        return ef->map + off;
+
+    if (__pread_full(ef->fd, buff, size, off) < 0)
+        return NULL;
+
+    return buff;
+}
+
+const void *_tmixelf_internal_load_file(const tmixelf_internal_file *ef, size_t off, size_t size, tmix_arena *arena) {
+    if (ef->map)
+        return _tmixelf_internal_view_file(ef, off, size, NULL);
+
+    void *buff = _tmix_arena_alloc(arena, size);
+
+    if (!buff)
+        return NULL;
+
+    // on failure, the buffer is released together with the arena
+    return _tmixelf_internal_view_file(ef, off, size, buff);
+}
+
+int _tmixelf_internal_vaddr_to_off(const tmixelf_internal_file *ef, size_t vaddr, size_t size, size_t *off) {
+    size_t i;
+
+    for (i = 0; i < ef->phnum; i++) {
+        const _ElfXX_Phdr *phdr = &ef->phdrs[i];
+
+        if (phdr->p_type != PT_LOAD)
+            continue;
+
+        if (vaddr >= phdr->p_vaddr && size <= phdr->p_filesz
+            && vaddr - phdr->p_vaddr <= phdr->p_filesz - size) {
+            *off = vaddr - phdr->p_vaddr + phdr->p_offset;
+            return 0;
+        }
+    }
+
+    // not backed by file data
+    errno = EBADF;
+    return -1;
+}
+
+__attribute__((constructor)) static void __init_no_map(void) {
+    // allow testing the reading fallback on files which can be mapped
+    const char *str = getenv("TMIXELF_NO_MAP");
+
+    __no_map = str && *str;
+}
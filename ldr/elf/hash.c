@@ -0,0 +1,130 @@
+/*
+  hash.c - ELF symbol lookup
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "elf.h"
+
+#include "_simd.h"
+
+// bits in each bloom filter word
+#define _BLOOM_BITS               (sizeof(size_t) * CHAR_BIT)
+
+// number of symbols probed at once by tmixelf_lookup_syms
+#define _BATCH_SIZE               (256)
+
+uint32_t tmixelf_gnu_hash(const char *name) {
+    uint32_t h = 5381;
+
+    for (; *name; name++)
+        h = (h << 5) + h + (unsigned char) *name;
+
+    return h;
+}
+
+/*
+ * walk the hash chain for name, after it passed the bloom filter
+ */
+static const tmixelf_sym *__walk_chain(const tmixelf_info *ei, const char *name, uint32_t hash) {
+    const tmixelf_hashtab *ht = &ei->hashtab;
+    uint32_t idx = ht->buckets[hash % ht->nbuckets];
+
+    if (idx < ht->symoffset)
+        return NULL;  // empty bucket
+
+    const tmixelf_sym *syms = ei->syms.data;  // array
+
+    for (; idx < ei->syms.size; idx++) {
+        uint32_t h = ht->chain[idx - ht->symoffset];
+
+        // names are only compared after a full hash match
+        if ((h | 1) == (hash | 1)
+            && !syms[idx].imported
+            && !strcmp(syms[idx].name, name))
+            return &syms[idx];
+
+        if (h & 1)
+            break;  // end of chain
+    }
+
+    return NULL;
+}
+
+const tmixelf_sym *tmixelf_lookup_sym(const tmixelf_info *ei, const char *name, uint32_t hash) {
+    const tmixelf_hashtab *ht = &ei->hashtab;
+
+    if (!ht->nbuckets || !ht->bloom_size)
+        return NULL;  // nothing exported
+
+    // check bloom filter first
+
+    size_t word = ht->bloom[(hash / _BLOOM_BITS) % ht->bloom_size];
+    size_t mask = ((size_t) 1 << (hash % _BLOOM_BITS))
+                  | ((size_t) 1 << ((hash >> ht->bloom_shift) % _BLOOM_BITS));
+
+    if ((word & mask) != mask)
+        return NULL;  // definitely not here
+
+    // then walk the chain
+
+    return __walk_chain(ei, name, hash);
+}
+
+size_t tmixelf_lookup_syms(const tmixelf_info *ei, const tmixelf_sym *syms, size_t n, const tmixelf_sym **res) {
+    const tmixelf_hashtab *ht = &ei->hashtab;
+    size_t found = 0;
+    size_t i;
+
+    if (!ht->nbuckets || !ht->bloom_size) {
+        // nothing exported
+        for (i = 0; i < n; i++)
+            res[i] = NULL;
+
+        return 0;
+    }
+
+    uint32_t hashes[_BATCH_SIZE];
+    bool maybe[_BATCH_SIZE];
+
+    while (n) {
+        size_t chunk = n > _BATCH_SIZE ? _BATCH_SIZE : n;
+
+        for (i = 0; i < chunk; i++)
+            hashes[i] = syms[i].hash;
+
+        _tmixelf_internal_bloom_batch(ht, hashes, chunk, maybe);
+
+        // only walk chains of symbols passed the bloom filter
+
+        for (i = 0; i < chunk; i++) {
+            res[i] = maybe[i] ? __walk_chain(ei, syms[i].name, hashes[i]) : NULL;
+
+            if (res[i])
+                found++;
+        }
+
+        syms += chunk;
+        res += chunk;
+        n -= chunk;
+    }
+
+    return found;
+}
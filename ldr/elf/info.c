@@ -23,15 +23,18 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <unistd.h>
 
 #include "../../inc/arch.h"
+#include "../../inc/arena.h"
+#include "../../inc/probes.h"
 #include "../../inc/types.h"
 
 #include "elf.h"
 
 #include "_arch.h"
 #include "_elf.h"
+#include "_file.h"
+#include "_info.h"
 #include "_segs.h"
 
 #ifdef TMIX32
@@ -70,50 +73,61 @@
 #  error Dont know endian-ness on this platform yet
 #endif
 
-int tmixelf_parse_info(int fd, tmixelf_info *ei) {
-    if (lseek(fd, 0, SEEK_SET) < 0)
+int _tmixelf_internal_parse_info(int fd, tmixelf_info *ei) {
+    tmixelf_internal_file ef = {};
+    tmix_arena arena = {};  // moved to ei on success
+
+    if (_tmixelf_internal_open_file(fd, &ef) < 0)
         return -1;
 
-    _ElfXX_Ehdr hdr;
+    _ElfXX_Ehdr hdr_buff;
+    const _ElfXX_Ehdr *hdr = _tmixelf_internal_view_file(&ef, 0, sizeof(_ElfXX_Ehdr), &hdr_buff);
 
-    if (read(fd, &hdr, sizeof(_ElfXX_Ehdr)) != sizeof(_ElfXX_Ehdr)) {
-        // failed to short read
-        errno = EIO;
-        return -1;
+    if (!hdr) {
+        if (errno == EBADF)
+            errno = EIO;  // failed to short read
+
+        goto error;
     }
 
     // basic checking
 
-    if (memcmp(hdr.e_ident, ELFMAG, SELFMAG)) {
+    if (memcmp(hdr->e_ident, ELFMAG, SELFMAG)) {
 bad_elf:
         errno = EBADF;
+error:
+        _tmix_arena_free(&arena);
+
+        if (ef.map)
+            _tmixelf_internal_unmap_file(ef.map, ef.size);
+
         return -1;
     }
 
-    if (hdr.e_ident[EI_CLASS] != _EXPECTED_EICLASS
-        || hdr.e_ident[EI_DATA] != _EXPECTED_EIDATA
-        || hdr.e_ident[EI_VERSION] != EV_CURRENT
-        || (hdr.e_ident[EI_OSABI] != ELFOSABI_SYSV
-            && hdr.e_ident[EI_OSABI] != ELFOSABI_GNU)
-        || hdr.e_ident[EI_ABIVERSION] != 0)
+    if (hdr->e_ident[EI_CLASS] != _EXPECTED_EICLASS
+        || hdr->e_ident[EI_DATA] != _EXPECTED_EIDATA
+        || hdr->e_ident[EI_VERSION] != EV_CURRENT
+        || (hdr->e_ident[EI_OSABI] != ELFOSABI_SYSV
+            && hdr->e_ident[EI_OSABI] != ELFOSABI_GNU)
+        || hdr->e_ident[EI_ABIVERSION] != 0)
         goto bad_elf;
 
-    if (hdr.e_type != ET_DYN
-        || hdr.e_machine != _EXPECTED_EMACH
-        || hdr.e_version != EV_CURRENT
-        || hdr.e_ehsize != sizeof(_ElfXX_Ehdr)
-        || hdr.e_phentsize != sizeof(_ElfXX_Phdr))
+    if (hdr->e_type != ET_DYN
+        || hdr->e_machine != _EXPECTED_EMACH
+        || hdr->e_version != EV_CURRENT
+        || hdr->e_ehsize != sizeof(_ElfXX_Ehdr)
+        || hdr->e_phentsize != sizeof(_ElfXX_Phdr))
         goto bad_elf;
 
     // parse segments
 
-    if (hdr.e_phoff && hdr.e_phnum) {
+    if (hdr->e_phoff && hdr->e_phnum) {
         // at least one segment is present
 
         tmixelf_internal_segs eis = {};
 
-        if (_tmixelf_internal_parse_segs(fd, &hdr, &eis) < 0)
-            return -1;
+        if (_tmixelf_internal_parse_segs(&ef, hdr, &arena, &eis) < 0)
+            goto error;
 
         // populate elf info
 
@@ -124,11 +138,26 @@ bad_elf:
             ei->segs.size = eis.segs.size;
 
             ei->mem_size = eis.highest_addr;
+            ei->align = eis.align;
 
             tmixelf_seg *si = ei->segs.data;  // array
 
-            if (hdr.e_entry)
-                ei->entry = hdr.e_entry - si[0].off;  // setup entrypoint
+            if (hdr->e_entry)
+                ei->entry = hdr->e_entry - si[0].off;  // setup entrypoint
+
+            // program headers are only visible to the program if some segment maps them
+
+            size_t phdrs_size = hdr->e_phnum * sizeof(_ElfXX_Phdr);
+            size_t i;
+
+            for (i = 0; i < eis.segs.size; i++) {
+                if (si[i].file.size && hdr->e_phoff >= si[i].file.off
+                    && hdr->e_phoff + phdrs_size <= si[i].file.off + si[i].file.size) {
+                    ei->phdrs.off = si[i].off + hdr->e_phoff - si[i].file.off;
+                    ei->phdrs.size = hdr->e_phnum;
+                    break;
+                }
+            }
 
             if (eis.relros.size) {
                 // at least one relro entry is found
@@ -141,6 +170,12 @@ bad_elf:
         if (eis.execstack)
             ei->execstack = eis.execstack;
 
+        // the initialization image is copied from the loaded image
+        if (eis.tls.size && eis.tls.init.off + eis.tls.init.size > ei->mem_size)
+            goto bad_elf;
+
+        ei->tls = eis.tls;
+
         if (eis.needs.size) {
             ei->needs.data = eis.needs.data;
             ei->needs.size = eis.needs.size;
@@ -155,11 +190,63 @@ bad_elf:
                 ei->relocs.size = eis.relocs.size;
             }
         }
+
+        if (eis.relatives.size) {
+            ei->relatives.data = eis.relatives.data;
+            ei->relatives.size = eis.relatives.size;
+        }
+
+        ei->implicit_addends = eis.implicit_addends;
+
+        if (eis.relr.size) {
+            ei->relr.data = eis.relr.data;
+            ei->relr.size = eis.relr.size;
+        }
+
+        ei->hashtab = eis.hashtab;
+        ei->pltgot = eis.pltgot;
+        ei->soname = eis.soname;
+        ei->init = eis.init;
+        ei->init_array = eis.init_array;
+        ei->bind_now = eis.bind_now;
+
+        if (eis.build_id.size) {
+            ei->build_id.data = eis.build_id.data;
+            ei->build_id.size = eis.build_id.size;
+            ei->build_id_off = eis.build_id_off;
+        }
+
+        if (eis.strtab)
+            ei->strtab = eis.strtab;
+
+        if (eis.strtab || eis.build_id.size) {
+            if (ef.map) {
+                // strtab or build ID points into the mapping, keep it
+                ei->map.data = (void *) ef.map;
+                ei->map.size = ef.size;
+                ef.map = NULL;
+            }
+        }
     }
 
+    if (ef.map)
+        _tmixelf_internal_unmap_file(ef.map, ef.size);  // nothing refers to it
+
+    ei->arena = arena;
+
     return 0;
 }
 
+int tmixelf_parse_info(int fd, tmixelf_info *ei) {
+    _tmix_probe1(parse_start, fd);
+
+    int ret = _tmixelf_internal_parse_info(fd, ei);
+
+    _tmix_probe3(parse_end, fd, ret, false);
+
+    return ret;
+}
+
 
 void tmixelf_print_info(const tmixelf_info *ei) {
     if (!ei)
@@ -168,10 +255,24 @@ void tmixelf_print_info(const tmixelf_info *ei) {
     if (ei->entry)
         printf("entrypoint offset (relative): %#" PRIxPTR "\n", ei->entry);
 
+    if (ei->phdrs.size)
+        printf("program headers offset (relative): %#" PRIxPTR ", count: %" PRIuPTR "\n",
+               ei->phdrs.off, ei->phdrs.size);
+
+    if (ei->soname)
+        printf("soname: %s\n", ei->soname);
+
     printf("total size in memory when loaded: %#" PRIxPTR "\n", ei->mem_size);
+    printf("alignment of segments: %#" PRIxPTR "\n", ei->align);
 
     printf("stack executable: %s\n", ei->execstack ? "yes" : "no");
 
+    if (ei->tls.size)
+        printf("thread-local storage: %#" PRIxPTR " bytes aligned to %#" PRIxPTR ", initialized from %#" PRIxPTR " bytes at %#" PRIxPTR "\n",
+               ei->tls.size, ei->tls.align, ei->tls.init.size, ei->tls.init.off);
+
+    size_t i;
+
     printf("loadable segment count: %" PRIuPTR "\n", ei->segs.size);
 
     printf("post-reloc RO segment count: %" PRIuPTR "\n", ei->relros.size);
@@ -180,7 +281,25 @@ void tmixelf_print_info(const tmixelf_info *ei) {
 
     printf("relocation count: %" PRIuPTR "\n", ei->relocs.size);
 
-    size_t i;
+    printf("relative relocation count: %" PRIuPTR "\n", ei->relatives.size);
+
+    printf("packed relative relocation word count: %" PRIuPTR "\n", ei->relr.size);
+
+    printf("bind now: %s\n", ei->bind_now ? "yes" : "no");
+
+    printf("initialization function count: %" PRIuPTR "\n",
+           !!ei->init + ei->init_array.size / sizeof(void *));
+
+    if (ei->build_id.size) {
+        const unsigned char *build_id = ei->build_id.data;  // array
+
+        printf("build ID: ");
+
+        for (i = 0; i < ei->build_id.size; i++)
+            printf("%02x", build_id[i]);
+
+        printf("\n");
+    }
 
     if (ei->segs.size) {
         tmixelf_seg *si = ei->segs.data;
@@ -236,6 +355,9 @@ void tmixelf_print_info(const tmixelf_info *ei) {
                 case TMIXELF_SYM_FUNC:
                     printf("function");
                     break;
+                case TMIXELF_SYM_TLS:
+                    printf("thread-local");
+                    break;
                 default:
                     printf("unknown");
                     break;
@@ -258,7 +380,33 @@ void tmixelf_print_info(const tmixelf_info *ei) {
             for (i = 0; i < ei->relocs.size; i++) {
                 tmixelf_sym *sym = &syms[relocs[i].symidx];
 
-                printf("  " _PTRFMT " %s\n", relocs[i].off, sym->name);
+                printf("  " _PTRFMT " %s", relocs[i].off, sym->name);
+
+                switch (relocs[i].type) {
+                    case TMIXELF_RELOC_JUMP_SLOT:
+                        printf(" (PLT)");
+                        break;
+                    case TMIXELF_RELOC_GLOB_DAT:
+                        break;
+                    case TMIXELF_RELOC_ABS:
+                        if (!ei->implicit_addends)
+                            printf(" + %#" PRIxPTR, relocs[i].addend);
+                        break;
+                    case TMIXELF_RELOC_TPOFF:
+                        printf(" (TPOFF)");
+                        break;
+                    case TMIXELF_RELOC_DTPMOD:
+                        printf(" (DTPMOD)");
+                        break;
+                    case TMIXELF_RELOC_DTPOFF:
+                        printf(" (DTPOFF)");
+                        break;
+                    case TMIXELF_RELOC_TLSDESC:
+                        printf(" (TLSDESC)");
+                        break;
+                }
+
+                printf("\n");
             }
         }
     }
@@ -266,7 +414,7 @@ void tmixelf_print_info(const tmixelf_info *ei) {
     if (ei->needs.size) {
         printf("required library list:\n");
 
-        char **needs = ei->needs.data;
+        const char **needs = ei->needs.data;
 
         assert(needs);
 
@@ -278,49 +426,27 @@ void tmixelf_print_info(const tmixelf_info *ei) {
 }
 
 void tmixelf_free_info(tmixelf_info *ei) {
-    // free arrays
+    // all arrays come from the arena, so just release it at once
 
-    if (ei->segs.data) {
-        free(ei->segs.data);
+    _tmix_arena_free(&ei->arena);
 
-        ei->segs.data = NULL;
-    }
-
-    tmixelf_sym *syms = ei->syms.data;  // array
-
-    if (syms) {
-        size_t i;
-
-        // free strings, then free array
-
-        for (i = 0; i < ei->syms.size; i++) {
-            if (syms[i].name) {
-                free(syms[i].name);
-
-                syms[i].name = NULL;
-            }
-        }
-
-        free(syms);
-
-        ei->syms.data = NULL;
-    }
+    ei->segs.data = NULL;
+    ei->syms.data = NULL;
+    ei->relros.data = NULL;
+    ei->needs.data = NULL;
+    ei->relocs.data = NULL;
+    ei->relatives.data = NULL;
+    ei->relr.data = NULL;
+    ei->build_id.data = NULL;
+    ei->hashtab = (tmixelf_hashtab) {};
 
-    if (ei->relros.data) {
-        free(ei->relros.data);
+    // then the storage of the names, if it is not a copy in the arena
 
-        ei->relros.data = NULL;
-    }
-
-    if (ei->needs.data) {
-        free(ei->needs.data);
+    if (ei->map.data) {
+        _tmixelf_internal_unmap_file(ei->map.data, ei->map.size);
 
-        ei->needs.data = NULL;
+        ei->map.data = NULL;
     }
 
-    if (ei->relocs.data) {
-        free(ei->relocs.data);
-
-        ei->relocs.data = NULL;
-    }
+    ei->strtab = NULL;
 }
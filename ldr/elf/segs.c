@@ -19,6 +19,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -29,6 +30,7 @@
 #  include <unistd.h>  // for sysconf
 #endif
 
+#include "../../inc/arena.h"
 #include "../../inc/logging.h"
 #include "../../inc/types.h"
 
@@ -37,11 +39,56 @@
 #include "_arch.h"
 #include "_elf.h"
 #include "_dyn.h"
+#include "_file.h"
 #include "_segs.h"
 
 #define _ROUND_DOWN(_x, _align)   ((_x / _align) * _align)
 
-static ssize_t __pagesize = -1;
+static ssize_t __pagesize = -1;  // only written once by the constructor below
+
+/*
+ * look for the GNU build ID in a note segment
+ *
+ * returns 0 if success (even if nothing found), otherwise -1 and sets errno
+ */
+static int __parse_note(const tmixelf_internal_file *ef, const _ElfXX_Phdr *phdr,
+                        tmix_arena *arena, tmixelf_internal_segs *eis) {
+    if (eis->build_id.size || !phdr->p_filesz)
+        return 0;  // already found, or empty
+
+    const char *notes = _tmixelf_internal_load_file(ef, phdr->p_offset, phdr->p_filesz, arena);
+
+    if (!notes)
+        return -1;
+
+    size_t align = phdr->p_align == 8 ? 8 : 4;
+    size_t off = 0;
+
+    while (off <= phdr->p_filesz && phdr->p_filesz - off >= sizeof(_ElfXX_Nhdr)) {
+        const _ElfXX_Nhdr *nhdr = (const _ElfXX_Nhdr *) &notes[off];
+        size_t name_off = off + sizeof(_ElfXX_Nhdr);
+        size_t desc_off = (name_off + nhdr->n_namesz + align - 1) & ~(align - 1);
+        size_t next = (desc_off + nhdr->n_descsz + align - 1) & ~(align - 1);
+
+        if (desc_off > phdr->p_filesz || nhdr->n_descsz > phdr->p_filesz - desc_off) {
+            errno = EBADF;
+            return -1;
+        }
+
+        if (nhdr->n_type == NT_GNU_BUILD_ID
+            && nhdr->n_namesz == sizeof("GNU")
+            && !memcmp(&notes[name_off], "GNU", sizeof("GNU"))) {
+            eis->build_id.data = (void *) &notes[desc_off];
+            eis->build_id.size = nhdr->n_descsz;
+            eis->build_id_off = phdr->p_offset + desc_off;
+            break;
+        }
+
+        off = next;
+    }
+
+    return 0;
+}
 
 /*
  * convert ELF segment flags to internal ones
@@ -59,57 +106,24 @@ static inline tmixelf_seg_flag __conv_flags(_ElfXX_Word flags) {
     return res;
 }
 
-int _tmixelf_internal_parse_segs(int fd, _ElfXX_Ehdr *hdr, tmixelf_internal_segs *eis) {
+int _tmixelf_internal_parse_segs(tmixelf_internal_file *ef, const _ElfXX_Ehdr *hdr,
+                                 tmix_arena *arena, tmixelf_internal_segs *eis) {
     if (__pagesize < 0) {
         errno = EAGAIN;
 
         return -1;
     }
 
-    _ElfXX_Phdr *phdrs = NULL;  // array
+    const _ElfXX_Phdr *phdrs = NULL;  // array
 
-    // read all segment headers
+    // get all segment headers
 
-    if (lseek(fd, hdr->e_phoff, SEEK_SET) < 0)
+    if (!(phdrs = _tmixelf_internal_load_file(ef, hdr->e_phoff, sizeof(_ElfXX_Phdr) * hdr->e_phnum, arena)))
         return -1;
 
-    if (!(phdrs = calloc(hdr->e_phnum, sizeof(_ElfXX_Phdr))))
-        return -1;
-
-    if (read(fd, phdrs, sizeof(_ElfXX_Phdr) * hdr->e_phnum) != (ssize_t)(sizeof(_ElfXX_Phdr) * hdr->e_phnum)) {
-        errno = EIO;
-error:
-        // clean up messes before return
-
-        free(phdrs);
-
-        if (eis->segs.data) {
-            free(eis->segs.data);
-            eis->segs.data = NULL;
-        }
-
-        if (eis->relros.data) {
-            free(eis->relros.data);
-            eis->relros.data = NULL;
-        }
-
-        if (eis->needs.data) {
-            free(eis->needs.data);
-            eis->needs.data = NULL;
-        }
-
-        if (eis->relocs.data) {
-            free(eis->relocs.data);
-            eis->relocs.data = NULL;
-        }
-
-        if (eis->syms.data) {
-            free(eis->syms.data);
-            eis->syms.data = NULL;
-        }
-
-        return -1;
-    }
+    // for translating addresses to file offsets later
+    ef->phdrs = phdrs;
+    ef->phnum = hdr->e_phnum;
 
     // now we will iterate through all segments
 
@@ -141,12 +155,10 @@ error:
         }
     }
 
-    if (load_seg_cnt &&
-        !(eis->segs.data = calloc(load_seg_cnt, sizeof(tmixelf_seg))))
-        goto error;
+    // arrays live in the arena, never in the struct, so tmixelf_info can be copied
 
-    if (relro_seg_cnt &&
-        !(eis->relros.data = calloc(relro_seg_cnt, sizeof(tmix_chunk))))
+    if (!(eis->segs.data = _tmix_arena_calloc(arena, load_seg_cnt, sizeof(tmixelf_seg)))
+        || !(eis->relros.data = _tmix_arena_calloc(arena, relro_seg_cnt, sizeof(tmix_chunk))))
         goto error;
 
     // ok, now it's ready to go
@@ -174,6 +186,9 @@ error:
                     goto error;
                 }
 
+                if (eis->align < phdr->p_align)
+                    eis->align = phdr->p_align;
+
                 // populate segment information
 
                 tmixelf_seg *seg = &si[j++];  // current segment
@@ -196,13 +211,14 @@ error:
                     seg->file.size = filesize;  // add reminder if needed
 
                     if (phdr->p_memsz > phdr->p_filesz) {
-                        // has extra zero paddings after file data
-                        size_t file_pages = seg->file.size / phdr->p_align;
+                        // has extra zero paddings after file data, which start at the next page,
+                        // the file mapping never covers more than that, however large p_align is
+                        size_t file_pages = seg->file.size / __pagesize;
 
-                        if ((seg->file.size % phdr->p_align) != 0)
+                        if ((seg->file.size % __pagesize) != 0)
                             file_pages++;
 
-                        size_t real_size = file_pages * phdr->p_align;
+                        size_t real_size = file_pages * __pagesize;
 
                         if (real_size < memsize) {
                             // actually need explicit zero padding
@@ -240,9 +256,17 @@ error:
             case PT_DYNAMIC: {
                 tmixelf_internal_dyn eid = {};
 
-                if (_tmixelf_internal_parse_dyn(fd, phdr, &eid) < 0)
+                if (_tmixelf_internal_parse_dyn(ef, phdr, arena, &eid) < 0)
                     goto error;
 
+                eis->hashtab = eid.hashtab;
+                eis->strtab = eid.strtab;
+                eis->pltgot = eid.pltgot;
+                eis->soname = eid.soname;
+                eis->init = eid.init;
+                eis->init_array = eid.init_array;
+                eis->bind_now = eid.bind_now;
+
                 if (eid.needs.size) {
                     eis->needs.data = eid.needs.data;
                     eis->needs.size = eid.needs.size;
@@ -258,6 +282,18 @@ error:
                     }
                 }
 
+                if (eid.relatives.size) {
+                    eis->relatives.data = eid.relatives.data;
+                    eis->relatives.size = eid.relatives.size;
+                }
+
+                eis->implicit_addends = eid.implicit_addends;
+
+                if (eid.relr.size) {
+                    eis->relr.data = eid.relr.data;
+                    eis->relr.size = eid.relr.size;
+                }
+
                 break;
             }
             case PT_GNU_RELRO: {
@@ -275,13 +311,28 @@ error:
             case PT_GNU_STACK:
                 assert(!eis->execstack);
                 eis->execstack = !!(__conv_flags(phdr->p_flags) & TMIXELF_SEG_EXEC);
+                break;
+            case PT_TLS:
+                // relative to the first segment, as relro ones
+                if (phdr->p_filesz > phdr->p_memsz || (phdr->p_align & (phdr->p_align - 1))) {
+                    errno = EBADF;
+                    goto error;
+                }
+
+                eis->tls.init.off = phdr->p_vaddr;
+                eis->tls.init.size = phdr->p_filesz;
+                eis->tls.size = phdr->p_memsz;
+                eis->tls.align = phdr->p_align ? phdr->p_align : 1;
+                break;
+            case PT_NOTE:
+                if (__parse_note(ef, phdr, arena, eis) < 0)
+                    goto error;
+
                 break;
             case PT_PHDR:
                 // the program header table itself, skipping
             case PT_INTERP:
                 // path to dynamic linker, ignored
-            case PT_NOTE:
-                // compiler information, ignored
                 break;
             default:
                 tmix_fixme("unhandled segment type %#x", phdr->p_type);
@@ -294,9 +345,18 @@ error:
 
     // finally...
 
-    free(phdrs);
+    ef->phdrs = NULL;
+    ef->phnum = 0;
 
     return 0;
+
+error:
+    // everything else is released together with the arena by caller
+
+    ef->phdrs = NULL;
+    ef->phnum = 0;
+
+    return -1;
 }
 
 __attribute__((constructor)) static void __init_pagesize(void) {
@@ -0,0 +1,332 @@
+/*
+  simd.c - Vectorized symbol hashing kernels
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "elf.h"
+
+#include "_simd.h"
+
+/*
+ * kernels are written with GCC vector extensions, and compiled
+ * once for each instruction set with target attributes
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#  define _HAVE_X86_KERNELS
+#  include <immintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#  define _HAVE_NEON_KERNELS
+#  include <arm_neon.h>
+#endif
+
+// bits in each bloom filter word
+#define _BLOOM_BITS               (sizeof(size_t) * CHAR_BIT)
+
+typedef void (*__hash_kernel)(const char *const *names, size_t n, uint32_t *hashes);
+typedef void (*__bloom_kernel)(const tmixelf_hashtab *ht, const uint32_t *hashes, size_t n, bool *maybe);
+
+static void __hash_scalar(const char *const *names, size_t n, uint32_t *hashes) {
+    size_t i;
+
+    for (i = 0; i < n; i++)
+        hashes[i] = tmixelf_gnu_hash(names[i]);
+}
+
+static void __bloom_scalar(const tmixelf_hashtab *ht, const uint32_t *hashes, size_t n, bool *maybe) {
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        size_t word = ht->bloom[(hashes[i] / _BLOOM_BITS) % ht->bloom_size];
+        size_t mask = ((size_t) 1 << (hashes[i] % _BLOOM_BITS))
+                      | ((size_t) 1 << ((hashes[i] >> ht->bloom_shift) % _BLOOM_BITS));
+
+        maybe[i] = (word & mask) == mask;
+    }
+}
+
+#define _PAGE_SIZE                (4096)
+
+/*
+ * since h = h * 33 + c, a block of characters can be folded at once:
+ *   h = h * 33^16 + c[0] * 33^15 + c[1] * 33^14 + ... + c[15]
+ * products of characters are computed in vector lanes and summed up, so only one
+ * multiplication is left in the dependency chain of each block
+ *
+ * each power is split into signed 16-bit halves, p = hi * 65536 + lo,
+ * for using 16-bit multiply-add instructions available everywhere
+ */
+static int16_t __powers_lo[16] __attribute__((aligned(32)));
+static int16_t __powers_hi[16] __attribute__((aligned(32)));
+static uint32_t __mult16;  // 33^16
+static uint32_t __mult8;  // 33^8
+
+#ifdef _HAVE_X86_KERNELS
+/*
+ * horizontal sum of lo + hi * 65536
+ */
+__attribute__((target("sse2"))) static inline uint32_t __sum_sse2(__m128i lo, __m128i hi) {
+    __m128i s = _mm_add_epi32(lo, _mm_slli_epi32(hi, 16));
+
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+
+    return _mm_cvtsi128_si32(s);
+}
+
+__attribute__((target("sse2"))) static inline bool __fold16_sse2(const unsigned char *p, uint32_t *c) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i b = _mm_loadu_si128((const __m128i *) p);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(b, zero)))
+        return false;  // the terminator is in this block
+
+    __m128i w0 = _mm_unpacklo_epi8(b, zero);
+    __m128i w1 = _mm_unpackhi_epi8(b, zero);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(w0, _mm_load_si128((const __m128i *) &__powers_lo[0])),
+                               _mm_madd_epi16(w1, _mm_load_si128((const __m128i *) &__powers_lo[8])));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(w0, _mm_load_si128((const __m128i *) &__powers_hi[0])),
+                               _mm_madd_epi16(w1, _mm_load_si128((const __m128i *) &__powers_hi[8])));
+
+    *c = __sum_sse2(lo, hi);
+    return true;
+}
+
+__attribute__((target("sse2"))) static inline uint32_t __fold8_sse2(const unsigned char *p) {
+    __m128i w = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *) p), _mm_setzero_si128());
+
+    return __sum_sse2(_mm_madd_epi16(w, _mm_load_si128((const __m128i *) &__powers_lo[8])),
+                      _mm_madd_epi16(w, _mm_load_si128((const __m128i *) &__powers_hi[8])));
+}
+
+__attribute__((target("avx2"))) static inline bool __fold16_avx2(const unsigned char *p, uint32_t *c) {
+    __m128i b = _mm_loadu_si128((const __m128i *) p);
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(b, _mm_setzero_si128())))
+        return false;  // the terminator is in this block
+
+    __m256i w = _mm256_cvtepu8_epi16(b);
+    __m256i lo = _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *) __powers_lo));
+    __m256i hi = _mm256_madd_epi16(w, _mm256_load_si256((const __m256i *) __powers_hi));
+
+    *c = __sum_sse2(_mm_add_epi32(_mm256_castsi256_si128(lo), _mm256_extracti128_si256(lo, 1)),
+                    _mm_add_epi32(_mm256_castsi256_si128(hi), _mm256_extracti128_si256(hi, 1)));
+    return true;
+}
+
+__attribute__((target("avx2"))) static inline uint32_t __fold8_avx2(const unsigned char *p) {
+    __m128i w = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i *) p));
+
+    return __sum_sse2(_mm_madd_epi16(w, _mm_load_si128((const __m128i *) &__powers_lo[8])),
+                      _mm_madd_epi16(w, _mm_load_si128((const __m128i *) &__powers_hi[8])));
+}
+#elif defined(_HAVE_NEON_KERNELS)
+/*
+ * sum of all products of w and powers starting from i
+ */
+static inline uint32_t __sum_neon(int16x8_t w, size_t i) {
+    int32x4_t lo = vmull_s16(vget_low_s16(w), vld1_s16(&__powers_lo[i]));
+    int32x4_t hi = vmull_s16(vget_low_s16(w), vld1_s16(&__powers_hi[i]));
+
+    lo = vmlal_s16(lo, vget_high_s16(w), vld1_s16(&__powers_lo[i + 4]));
+    hi = vmlal_s16(hi, vget_high_s16(w), vld1_s16(&__powers_hi[i + 4]));
+
+    return vaddvq_u32(vaddq_u32(vreinterpretq_u32_s32(lo), vshlq_n_u32(vreinterpretq_u32_s32(hi), 16)));
+}
+
+static inline bool __fold16_neon(const unsigned char *p, uint32_t *c) {
+    uint8x16_t b = vld1q_u8(p);
+
+    if (!vminvq_u8(b))
+        return false;  // the terminator is in this block
+
+    *c = __sum_neon(vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b))), 0)
+         + __sum_neon(vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b))), 8);
+    return true;
+}
+
+static inline uint32_t __fold8_neon(const unsigned char *p) {
+    return __sum_neon(vreinterpretq_s16_u16(vmovl_u8(vld1_u8(p))), 8);
+}
+#endif
+
+/*
+ * blocks of 16 and 8 characters are folded while no terminator is in them,
+ * the rest characters are hashed one by one
+ *
+ * a block may be read past the terminator, but never across a page boundary,
+ * so it cannot fault
+ */
+#define _DEFINE_HASH_KERNEL(_name, _attr, _fold16, _fold8)                              \
+    _attr static void _name(const char *const *names, size_t n, uint32_t *hashes) {     \
+        size_t i;                                                                       \
+                                                                                        \
+        for (i = 0; i < n; i++) {                                                       \
+            const unsigned char *p = (const unsigned char *) names[i];                  \
+            uint32_t h = 5381;                                                          \
+                                                                                        \
+            for (;;) {                                                                  \
+                size_t in_page = _PAGE_SIZE - ((uintptr_t) p & (_PAGE_SIZE - 1));       \
+                uint32_t c;                                                             \
+                                                                                        \
+                if (in_page >= 16 && _fold16(p, &c)) {                                  \
+                    h = h * __mult16 + c;                                               \
+                    p += 16;                                                            \
+                    continue;                                                           \
+                }                                                                       \
+                                                                                        \
+                uint64_t word;                                                          \
+                                                                                        \
+                if (in_page >= 8) {                                                     \
+                    memcpy(&word, p, sizeof(word));                                     \
+                                                                                        \
+                    if (!((word - 0x0101010101010101ull) & ~word & 0x8080808080808080ull)) { \
+                        h = h * __mult8 + _fold8(p);                                    \
+                        p += 8;                                                         \
+                        continue;                                                       \
+                    }                                                                   \
+                }                                                                       \
+                                                                                        \
+                /* less than 8 characters left, or near a page boundary */              \
+                                                                                        \
+                size_t l;                                                               \
+                                                                                        \
+                for (l = 0; l < 8 && *p; l++, p++)                                      \
+                    h = (h << 5) + h + *p;                                              \
+                                                                                        \
+                if (!*p)                                                                \
+                    break;                                                              \
+            }                                                                           \
+                                                                                        \
+            hashes[i] = h;                                                              \
+        }                                                                               \
+    }
+
+/*
+ * each lane probes the bloom filter for a different hash,
+ * only used when the filter size is a power of two (which linkers always emit)
+ */
+#define _DEFINE_BLOOM_KERNEL(_name, _attr, _lanes)                                      \
+    _attr static void _name(const tmixelf_hashtab *ht, const uint32_t *hashes,          \
+                            size_t n, bool *maybe) {                                    \
+        typedef uint32_t _vh __attribute__((vector_size((_lanes) * sizeof(uint32_t)))); \
+        typedef size_t _vw __attribute__((vector_size((_lanes) * sizeof(size_t))));     \
+                                                                                        \
+        if (ht->bloom_size & (ht->bloom_size - 1)) {                                    \
+            __bloom_scalar(ht, hashes, n, maybe);                                       \
+            return;                                                                     \
+        }                                                                               \
+                                                                                        \
+        size_t i;                                                                       \
+        size_t l;                                                                       \
+                                                                                        \
+        for (i = 0; i + (_lanes) <= n; i += (_lanes)) {                                 \
+            _vh vh;                                                                     \
+            memcpy(&vh, &hashes[i], sizeof(vh));                                        \
+                                                                                        \
+            _vh vidx = (vh / _BLOOM_BITS) & (ht->bloom_size - 1);                       \
+            _vw bit1 = __builtin_convertvector(vh % _BLOOM_BITS, _vw);                  \
+            _vw bit2 = __builtin_convertvector((vh >> ht->bloom_shift) % _BLOOM_BITS,   \
+                                               _vw);                                    \
+            _vw one = (_vw) {} + 1;                                                     \
+            _vw mask = (one << bit1) | (one << bit2);                                   \
+            _vw word;                                                                   \
+                                                                                        \
+            for (l = 0; l < (_lanes); l++)                                              \
+                word[l] = ht->bloom[vidx[l]];                                           \
+                                                                                        \
+            _vw miss = (word & mask) != mask;                                           \
+                                                                                        \
+            for (l = 0; l < (_lanes); l++)                                              \
+                maybe[i + l] = !miss[l];                                                \
+        }                                                                               \
+                                                                                        \
+        __bloom_scalar(ht, &hashes[i], n - i, &maybe[i]);                               \
+    }
+
+#ifdef _HAVE_X86_KERNELS
+_DEFINE_HASH_KERNEL(__hash_sse2, __attribute__((target("sse2"))), __fold16_sse2, __fold8_sse2)
+_DEFINE_HASH_KERNEL(__hash_avx2, __attribute__((target("avx2"))), __fold16_avx2, __fold8_avx2)
+_DEFINE_BLOOM_KERNEL(__bloom_avx2, __attribute__((target("avx2"))), 32 / sizeof(size_t))
+#elif defined(_HAVE_NEON_KERNELS)
+_DEFINE_HASH_KERNEL(__hash_neon, , __fold16_neon, __fold8_neon)
+_DEFINE_BLOOM_KERNEL(__bloom_neon, , 16 / sizeof(size_t))
+#endif
+
+// only written once by the constructor below
+static __hash_kernel __hash_best = __hash_scalar;
+static __bloom_kernel __bloom_best = __bloom_scalar;
+static const char *__simd_name = "scalar";
+
+void _tmixelf_internal_hash_batch(const char *const *names, size_t n, uint32_t *hashes) {
+    __hash_best(names, n, hashes);
+}
+
+void _tmixelf_internal_bloom_batch(const tmixelf_hashtab *ht, const uint32_t *hashes, size_t n, bool *maybe) {
+    __bloom_best(ht, hashes, n, maybe);
+}
+
+void tmixelf_gnu_hash_batch(const char *const *names, size_t n, uint32_t *hashes) {
+    __hash_best(names, n, hashes);
+}
+
+const char *tmixelf_simd_name(void) {
+    return __simd_name;
+}
+
+__attribute__((constructor)) static void __init_simd(void) {
+    uint32_t power = 1;
+    size_t i;
+
+    for (i = 16; i--; power *= 33) {
+        __powers_lo[i] = (int16_t) (power & 0xffff);
+        __powers_hi[i] = (int16_t) ((power - (uint32_t) __powers_lo[i]) >> 16);
+
+        if (i == 8)
+            __mult8 = power * 33;
+    }
+
+    __mult16 = power;
+
+    // allow limiting the instruction set, e.g. for comparing kernels
+    const char *limit = getenv("TMIXELF_SIMD");
+
+    if (limit && !strcmp(limit, "scalar"))
+        return;
+
+#ifdef _HAVE_X86_KERNELS
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && !(limit && !strcmp(limit, "sse2"))) {
+        __hash_best = __hash_avx2;
+        __bloom_best = __bloom_avx2;
+        __simd_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        // SSE2 has no per-lane shifts, bloom filter probes stay scalar
+        __hash_best = __hash_sse2;
+        __simd_name = "sse2";
+    }
+#elif defined(_HAVE_NEON_KERNELS)
+    __hash_best = __hash_neon;
+    __bloom_best = __bloom_neon;
+    __simd_name = "neon";
+#endif
+}
@@ -1,5 +1,5 @@
 /*
-  reloc.c - ELF reloaction information
+  symtab.c - ELF symbol table
 
   This program is free software; you can redistribute it and/or modify
   it under the terms of the GNU General Public License as published by
@@ -15,12 +15,453 @@
   along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "../../inc/arena.h"
+#include "../../inc/logging.h"
+
+#include "elf.h"
+
+#include "_arch.h"
+#include "_elf.h"
+#include "_file.h"
+#include "_simd.h"
 #include "_symtab.h"
 
-int _tmixelf_internal_parse_symtab(int fd, tmixelf_internal_symtab *eist) {
-    // TODO
-    (void)fd;
-    (void)eist;
+// number of hash chain words read at once if the file is not mapped
+#define _WORD_CHUNK               (256)
+
+// number of imported names hashed at once
+#define _HASH_CHUNK               (256)
+
+/*
+ * compare relocation entries by location
+ */
+static int __cmp_reloc(const void *a, const void *b) {
+    size_t off_a = ((const tmixelf_reloc *) a)->off;
+    size_t off_b = ((const tmixelf_reloc *) b)->off;
+
+    return (off_a > off_b) - (off_a < off_b);
+}
+
+/*
+ * compare RELATIVE relocation entries by location
+ */
+static int __cmp_relative(const void *a, const void *b) {
+    size_t off_a = ((const tmixelf_relative *) a)->off;
+    size_t off_b = ((const tmixelf_relative *) b)->off;
+
+    return (off_a > off_b) - (off_a < off_b);
+}
+
+/*
+ * parse the GNU hash table, and count symbols in the dynamic symbol table with it,
+ * since the size of the symbol table is not recorded in the dynamic section
+ *
+ * returns 0 if success, otherwise -1 and sets errno
+ */
+static int __parse_hashtab(const tmixelf_internal_file *ef, tmix_arena *arena, size_t hashtab_off,
+                           tmixelf_hashtab *ht, size_t *count) {
+    Elf_GNU_Hash_Header hdr;
+
+    if (_tmixelf_internal_vaddr_to_off(ef, hashtab_off, sizeof(hdr), &hashtab_off) < 0)
+        return -1;
+
+    const Elf_GNU_Hash_Header *phdr = _tmixelf_internal_view_file(ef, hashtab_off, sizeof(hdr), &hdr);
+
+    if (!phdr)
+        return -1;
+
+    hdr = *phdr;
+
+    if (hdr.bloom_size > ef->size || hdr.nbuckets > ef->size || hdr.bloom_shift >= 32) {
+        // obviously broken
+        errno = EBADF;
+        return -1;
+    }
+
+    // bloom filter and buckets are stored right after the header
+
+    size_t bloom_off = hashtab_off + sizeof(hdr);
+    size_t buckets_off = bloom_off + hdr.bloom_size * sizeof(_ElfXX_Addr);
+    size_t chain_off = buckets_off + hdr.nbuckets * sizeof(Elf32_Word);
+
+    const char *tab = _tmixelf_internal_load_file(ef, bloom_off, chain_off - bloom_off, arena);
+
+    if (!tab)
+        return -1;
+
+    const Elf32_Word *buckets = (const Elf32_Word *) &tab[buckets_off - bloom_off];
+
+    // find the highest symbol index referred by buckets
+
+    Elf32_Word max_idx = 0;
+    size_t i;
+
+    for (i = 0; i < hdr.nbuckets; i++) {
+        if (buckets[i] > max_idx)
+            max_idx = buckets[i];
+    }
+
+    if (max_idx < hdr.symoffset) {
+        // no symbol is accessible via the table
+        *count = hdr.symoffset;
+        return 0;
+    }
+
+    // walk the chain of the last bucket until its end
+
+    Elf32_Word buff[_WORD_CHUNK];
+    size_t idx = max_idx;
+
+    for (;;) {
+        size_t off = chain_off + (idx - hdr.symoffset) * sizeof(Elf32_Word);
+        size_t n = off < ef->size ? (ef->size - off) / sizeof(Elf32_Word) : 0;
+
+        if (!n) {
+            // chain is not terminated
+            errno = EBADF;
+            return -1;
+        }
+
+        if (n > _WORD_CHUNK)
+            n = _WORD_CHUNK;
+
+        const Elf32_Word *chain = _tmixelf_internal_view_file(ef, off, n * sizeof(Elf32_Word), buff);
+
+        if (!chain)
+            return -1;
+
+        for (i = 0; i < n; i++, idx++) {
+            if (chain[i] & 1)
+                break;  // lowest bit set marks the end of chain
+        }
+
+        if (i < n)
+            break;
+    }
+
+    *count = idx + 1;
+
+    // keep the whole table for looking up symbols later
+
+    const Elf32_Word *chain = _tmixelf_internal_load_file(ef, chain_off, (*count - hdr.symoffset) * sizeof(Elf32_Word), arena);
+
+    if (!chain)
+        return -1;
+
+    ht->nbuckets = hdr.nbuckets;
+    ht->symoffset = hdr.symoffset;
+    ht->bloom_size = hdr.bloom_size;
+    ht->bloom_shift = hdr.bloom_shift;
+    ht->bloom = (const size_t *) tab;
+    ht->buckets = buckets;
+    ht->chain = chain;
+
+    return 0;
+}
+
+/*
+ * load the relocation table at vaddr off with size bytes
+ *
+ * returns 0 if success, otherwise -1 and sets errno
+ */
+static int __load_rels(const tmixelf_internal_file *ef, tmix_arena *arena, size_t off, size_t size,
+                       size_t ent_size, const char **rels, size_t *count) {
+    *rels = NULL;
+    *count = size / ent_size;
+
+    if (!*count)
+        return 0;
+
+    if (_tmixelf_internal_vaddr_to_off(ef, off, *count * ent_size, &off) < 0)
+        return -1;
+
+    if (!(*rels = _tmixelf_internal_load_file(ef, off, *count * ent_size, arena)))
+        return -1;
+
+    return 0;
+}
+
+/*
+ * fill relocation entries of a table into relocs, RELATIVE ones into relatives
+ *
+ * skip - number of leading RELATIVE entries already handled
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, ENOTSUP if a type is not supported
+ */
+static int __parse_rels(const char *rels, size_t count, size_t skip, bool rela, bool plt,
+                        tmixelf_reloc *relocs, size_t *nrelocs, tmixelf_relative *relatives, size_t *nrelatives) {
+    size_t ent_size = rela ? sizeof(_ElfXX_Rela) : sizeof(_ElfXX_Rel);
+    size_t i;
+
+    for (i = skip; i < count; i++) {
+        // Rel and Rela share the same leading fields
+        const _ElfXX_Rel *rel = (const _ElfXX_Rel *) &rels[i * ent_size];
+        size_t addend = rela ? (size_t) ((const _ElfXX_Rela *) rel)->r_addend : 0;
+        size_t symidx = _ELFXX_R_SYM(rel->r_info);
+        tmixelf_reloc_type type;
+
+        switch (_ELFXX_R_TYPE(rel->r_info)) {
+            case _R_ARCH_NONE:
+                continue;
+            case _R_ARCH_RELATIVE:
+                if (plt)
+                    goto unhandled;
+
+                relatives[*nrelatives].off = rel->r_offset;
+                relatives[*nrelatives].addend = addend;
+                (*nrelatives)++;
+                continue;
+            case _R_ARCH_JUMP_SLOT:
+                type = TMIXELF_RELOC_JUMP_SLOT;
+                break;
+            case _R_ARCH_GLOB_DAT:
+                type = TMIXELF_RELOC_GLOB_DAT;
+                break;
+            case _R_ARCH_ABS:
+                type = TMIXELF_RELOC_ABS;
+                break;
+            case _R_ARCH_TPOFF:
+                type = TMIXELF_RELOC_TPOFF;
+                break;
+            case _R_ARCH_DTPMOD:
+                type = TMIXELF_RELOC_DTPMOD;
+                break;
+            case _R_ARCH_DTPOFF:
+                type = TMIXELF_RELOC_DTPOFF;
+                break;
+#ifdef _R_ARCH_TLSDESC
+            case _R_ARCH_TLSDESC:
+                type = TMIXELF_RELOC_TLSDESC;
+                break;
+#endif
+            default:
+unhandled:
+                // the image would run with slots left unrelocated
+                tmix_fixme("unhandled relocation type %#" PRIxPTR, (size_t) _ELFXX_R_TYPE(rel->r_info));
+
+                errno = ENOTSUP;
+                return -1;
+        }
+
+        // thread-local ones may refer to the image itself
+        if (!symidx && type < TMIXELF_RELOC_TPOFF) {
+            errno = EBADF;
+            return -1;
+        }
+
+        // only entries in the PLT relocation table are bound lazily
+        if (type == TMIXELF_RELOC_JUMP_SLOT && !plt)
+            type = TMIXELF_RELOC_GLOB_DAT;
+
+        relocs[*nrelocs].symidx = symidx;
+        relocs[*nrelocs].off = rel->r_offset;
+        relocs[*nrelocs].idx = i;
+        relocs[*nrelocs].type = type;
+        relocs[*nrelocs].addend = addend;
+        (*nrelocs)++;
+    }
+
+    return 0;
+}
+
+int _tmixelf_internal_parse_symtab(const tmixelf_internal_file *ef, tmix_arena *arena, tmixelf_internal_symtab *eist) {
+    // relocation tables first, since imported symbols are not always covered by the hash table
+
+    size_t rel_ent_size = eist->rela ? sizeof(_ElfXX_Rela) : sizeof(_ElfXX_Rel);
+    size_t dynrel_ent_size = eist->dynrela ? sizeof(_ElfXX_Rela) : sizeof(_ElfXX_Rel);
+    const char *rels, *dynrels;
+    size_t rel_count, dynrel_count;
+    size_t i;
+
+    if (__load_rels(ef, arena, eist->rel_off, eist->rel_size, rel_ent_size, &rels, &rel_count) < 0
+        || __load_rels(ef, arena, eist->dynrel_off, eist->dynrel_size, dynrel_ent_size, &dynrels, &dynrel_count) < 0)
+        return -1;
+
+    // leading RELATIVE entries counted by DT_RELACOUNT need no checks,
+    // which are the most of a PIE
+
+    size_t relative_count = eist->dynrel_relative_count;
+
+    if (relative_count > dynrel_count) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // packed RELATIVE entries are kept as is, it's an order of magnitude smaller than expanded
+
+    const char *relr;
+    size_t relr_count;
+
+    if (__load_rels(ef, arena, eist->relr_off, eist->relr_size, sizeof(_ElfXX_Addr), &relr, &relr_count) < 0)
+        return -1;
+
+    _Static_assert(sizeof(_ElfXX_Addr) == sizeof(size_t), "packed entries are exposed as size_t");
+
+    if (relr_count) {
+        if (*(const _ElfXX_Addr *) relr & 1) {
+            // a bitmap without an address to start with
+            errno = EBADF;
+            return -1;
+        }
+
+        eist->relr.data = (void *) relr;
+        eist->relr.size = relr_count;
+    }
+
+    size_t sym_count = 0;
+
+    for (i = 0; i < rel_count + dynrel_count - relative_count; i++) {
+        const _ElfXX_Rel *rel = i < rel_count ? (const _ElfXX_Rel *) &rels[i * rel_ent_size]
+                                              : (const _ElfXX_Rel *) &dynrels[(i - rel_count + relative_count) * dynrel_ent_size];
+        size_t symidx = _ELFXX_R_SYM(rel->r_info);
+
+        if (symidx >= sym_count)
+            sym_count = symidx + 1;
+    }
+
+    if (eist->symtab_off && (eist->hashtab_off || sym_count)) {
+        size_t hashed_count = 0;
+
+        if (eist->hashtab_off && __parse_hashtab(ef, arena, eist->hashtab_off, &eist->hashtab, &hashed_count) < 0)
+            return -1;
+
+        if (hashed_count > sym_count)
+            sym_count = hashed_count;
+    } else if (sym_count) {
+        // symbols are referred without a symbol table
+        errno = EBADF;
+        return -1;
+    }
+
+    if (sym_count) {
+        // walk the symbol table in place
+
+        size_t symtab_off;
+
+        if (_tmixelf_internal_vaddr_to_off(ef, eist->symtab_off, sym_count * sizeof(_ElfXX_Sym), &symtab_off) < 0)
+            return -1;
+
+        const _ElfXX_Sym *symtab = _tmixelf_internal_load_file(ef, symtab_off, sym_count * sizeof(_ElfXX_Sym), arena);
+
+        if (!symtab)
+            return -1;
+
+        tmixelf_sym *syms = _tmix_arena_calloc(arena, sym_count, sizeof(tmixelf_sym));
+
+        if (!syms)
+            return -1;
+
+        for (i = 0; i < sym_count; i++) {
+            const _ElfXX_Sym *sym = &symtab[i];  // current symbol
+
+            if (sym->st_name >= eist->strtab_size && (sym->st_name || eist->strtab_size)) {
+                errno = EBADF;
+                return -1;
+            }
+
+            syms[i].name = eist->strtab ? &eist->strtab[sym->st_name] : "";
+            syms[i].type = _ELFXX_ST_TYPE(sym->st_info) == STT_FUNC ? TMIXELF_SYM_FUNC
+                           : _ELFXX_ST_TYPE(sym->st_info) == STT_TLS ? TMIXELF_SYM_TLS : TMIXELF_SYM_DATA;
+            syms[i].imported = i && sym->st_shndx == SHN_UNDEF;  // the first one is always a null symbol
+            syms[i].weak = _ELFXX_ST_BIND(sym->st_info) == STB_WEAK;
+            syms[i].off = sym->st_value;
+        }
+
+        // hash imported names once, so they can be looked up in many libraries,
+        // they are collected in chunks to be hashed together
+
+        const char *names[_HASH_CHUNK];
+        uint32_t hashes[_HASH_CHUNK];
+        size_t idx[_HASH_CHUNK];
+        size_t n = 0;
+
+        for (i = 0; i < sym_count; i++) {
+            if (syms[i].imported) {
+                names[n] = syms[i].name;
+                idx[n++] = i;
+            }
+
+            if (n == _HASH_CHUNK || (n && i == sym_count - 1)) {
+                _tmixelf_internal_hash_batch(names, n, hashes);
+
+                while (n--)
+                    syms[idx[n]].hash = hashes[n];
+
+                n = 0;
+            }
+        }
+
+        eist->syms.data = syms;
+        eist->syms.size = sym_count;
+    }
+
+    if (!rel_count && !dynrel_count)
+        return 0;
+
+    // then fill relocation entries in one pass, RELATIVE ones are kept apart
+
+    tmixelf_relative *relatives = NULL;
+    tmixelf_reloc *relocs = NULL;
+    size_t nrelatives = relative_count;
+    size_t nrelocs = 0;
+
+    if (dynrel_count && !(relatives = _tmix_arena_calloc(arena, dynrel_count, sizeof(tmixelf_relative))))
+        return -1;
+
+    if (rel_count + dynrel_count > relative_count
+        && !(relocs = _tmix_arena_calloc(arena, rel_count + dynrel_count - relative_count, sizeof(tmixelf_reloc))))
+        return -1;
+
+    if (eist->dynrela) {
+        for (i = 0; i < relative_count; i++) {
+            const _ElfXX_Rela *rel = (const _ElfXX_Rela *) &dynrels[i * sizeof(_ElfXX_Rela)];
+
+            relatives[i].off = rel->r_offset;
+            relatives[i].addend = rel->r_addend;
+        }
+    } else {
+        for (i = 0; i < relative_count; i++)
+            relatives[i].off = ((const _ElfXX_Rel *) &dynrels[i * sizeof(_ElfXX_Rel)])->r_offset;
+    }
+
+    if (__parse_rels(dynrels, dynrel_count, relative_count, eist->dynrela, false,
+                     relocs, &nrelocs, relatives, &nrelatives) < 0
+        || __parse_rels(rels, rel_count, 0, eist->rela, true, relocs, &nrelocs, relatives, &nrelatives) < 0)
+        return -1;
+
+    // sort them by location, so relocated pages are written one after another,
+    // linkers usually emit them in order already
+
+    for (i = 1; i < nrelatives && relatives[i - 1].off <= relatives[i].off; i++);
+
+    if (i < nrelatives)
+        qsort(relatives, nrelatives, sizeof(tmixelf_relative), __cmp_relative);
+
+    for (i = 1; i < nrelocs && relocs[i - 1].off <= relocs[i].off; i++);
+
+    if (i < nrelocs)
+        qsort(relocs, nrelocs, sizeof(tmixelf_reloc), __cmp_reloc);
+
+    if (nrelatives) {
+        eist->relatives.data = relatives;
+        eist->relatives.size = nrelatives;
+    }
+
+    if (nrelocs) {
+        if (!eist->syms.size) {
+            errno = EBADF;
+            return -1;
+        }
+
+        eist->relocs.data = relocs;
+        eist->relocs.size = nrelocs;
+    }
 
     return 0;
 }
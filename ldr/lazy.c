@@ -0,0 +1,320 @@
+/*
+  lazy.c - Lazy binding of PLT entries
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+
+#include "../inc/abi.h"
+
+#include "elf/elf.h"
+
+#include "_lazy.h"
+
+/*
+ * PLT entries jump through the GOT, which initially points back to the PLT, then to PLT0,
+ * PLT0 jumps to GOT[2] with GOT[1] at hand, which are set to the trampoline and the image below
+ *
+ * the trampoline saves argument registers of the guest, calls __fixup with the image and
+ * an architecture-specific argument identifying the entry, then jumps to the bound symbol
+ */
+typedef struct {
+    char *base;  // address of the first loaded segment
+    const tmixelf_info *ei;
+    uint32_t *index;  // position in ei->relocs of each relocation table entry
+    size_t index_size;
+} __lazy_image;
+
+static size_t __lazy_count = 0;
+
+#ifdef TMIXDYNLD_LAZY_SUPPORTED
+
+#ifdef __ELF__
+#  define _ASM_FUNC_BEGIN(_name)  ".globl " _name "\n.hidden " _name "\n.type " _name ", %function\n" _name ":\n"
+#  define _ASM_FUNC_END(_name)    ".size " _name ", .-" _name "\n"
+#else
+#  define _ASM_FUNC_BEGIN(_name)  ".globl " _name "\n" _name ":\n"
+#  define _ASM_FUNC_END(_name)    ""
+#endif
+
+void __trampoline(void) __asm__("tmixdynld_internal_lazy_trampoline");
+void *__tmixabi __fixup(__lazy_image *image, uintptr_t arg) __asm__("tmixdynld_internal_lazy_fixup");
+
+#if defined(__x86_64__)
+/*
+ * stack: image, index of the relocation entry, return address
+ *
+ * SSE registers are saved as a whole, upper halves of wider vector arguments are not
+ */
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_lazy_trampoline")
+    ".byte 0xf3, 0x0f, 0x1e, 0xfa\n"  // endbr64
+    "pushq %rax\n"
+    "pushq %rdi\n"
+    "pushq %rsi\n"
+    "pushq %rdx\n"
+    "pushq %rcx\n"
+    "pushq %r8\n"
+    "pushq %r9\n"
+    "subq $128, %rsp\n"
+    "movaps %xmm0, 0(%rsp)\n"
+    "movaps %xmm1, 16(%rsp)\n"
+    "movaps %xmm2, 32(%rsp)\n"
+    "movaps %xmm3, 48(%rsp)\n"
+    "movaps %xmm4, 64(%rsp)\n"
+    "movaps %xmm5, 80(%rsp)\n"
+    "movaps %xmm6, 96(%rsp)\n"
+    "movaps %xmm7, 112(%rsp)\n"
+    "movq 184(%rsp), %rdi\n"
+    "movq 192(%rsp), %rsi\n"
+    "call tmixdynld_internal_lazy_fixup\n"
+    "movq %rax, %r11\n"
+    "movaps 0(%rsp), %xmm0\n"
+    "movaps 16(%rsp), %xmm1\n"
+    "movaps 32(%rsp), %xmm2\n"
+    "movaps 48(%rsp), %xmm3\n"
+    "movaps 64(%rsp), %xmm4\n"
+    "movaps 80(%rsp), %xmm5\n"
+    "movaps 96(%rsp), %xmm6\n"
+    "movaps 112(%rsp), %xmm7\n"
+    "addq $128, %rsp\n"
+    "popq %r9\n"
+    "popq %r8\n"
+    "popq %rcx\n"
+    "popq %rdx\n"
+    "popq %rsi\n"
+    "popq %rdi\n"
+    "popq %rax\n"
+    "addq $16, %rsp\n"
+    "jmp *%r11\n"
+    _ASM_FUNC_END("tmixdynld_internal_lazy_trampoline")
+);
+#elif defined(__i386__)
+/*
+ * stack: image, offset of the relocation entry, return address
+ */
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_lazy_trampoline")
+    "pushl %eax\n"
+    "pushl %ecx\n"
+    "pushl %edx\n"
+    "pushl 16(%esp)\n"
+    "pushl 16(%esp)\n"
+    "call tmixdynld_internal_lazy_fixup\n"
+    "addl $8, %esp\n"
+    "popl %edx\n"
+    "movl (%esp), %ecx\n"
+    "movl %eax, (%esp)\n"  // jump there by returning
+    "movl 4(%esp), %eax\n"
+    "ret $12\n"
+    _ASM_FUNC_END("tmixdynld_internal_lazy_trampoline")
+);
+#elif defined(__aarch64__)
+/*
+ * x16: address of GOT[2], stack: address of the GOT entry, return address
+ */
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_lazy_trampoline")
+    "stp x8, x9, [sp, #-208]!\n"
+    "stp x6, x7, [sp, #16]\n"
+    "stp x4, x5, [sp, #32]\n"
+    "stp x2, x3, [sp, #48]\n"
+    "stp x0, x1, [sp, #64]\n"
+    "stp q0, q1, [sp, #80]\n"
+    "stp q2, q3, [sp, #112]\n"
+    "stp q4, q5, [sp, #144]\n"
+    "stp q6, q7, [sp, #176]\n"
+    "ldr x0, [x16, #-8]\n"
+    "ldr x1, [sp, #208]\n"
+    "bl tmixdynld_internal_lazy_fixup\n"
+    "mov x16, x0\n"
+    "ldp q6, q7, [sp, #176]\n"
+    "ldp q4, q5, [sp, #144]\n"
+    "ldp q2, q3, [sp, #112]\n"
+    "ldp q0, q1, [sp, #80]\n"
+    "ldp x0, x1, [sp, #64]\n"
+    "ldp x2, x3, [sp, #48]\n"
+    "ldp x4, x5, [sp, #32]\n"
+    "ldp x6, x7, [sp, #16]\n"
+    "ldp x8, x9, [sp], #208\n"
+    "ldp x17, x30, [sp], #16\n"
+    "br x16\n"
+    _ASM_FUNC_END("tmixdynld_internal_lazy_trampoline")
+);
+#elif defined(__arm__)
+/*
+ * ip: address of the GOT entry, lr: address of GOT[2], stack: return address
+ */
+__asm__(
+    ".text\n"
+    ".arm\n"
+    ".p2align 2\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_lazy_trampoline")
+    "push {r0-r4}\n"
+#  ifdef __ARM_PCS_VFP
+    "vpush {d0-d7}\n"
+#  endif
+    "ldr r0, [lr, #-4]\n"
+    "mov r1, ip\n"
+    "bl tmixdynld_internal_lazy_fixup\n"
+    "mov ip, r0\n"
+#  ifdef __ARM_PCS_VFP
+    "vpop {d0-d7}\n"
+#  endif
+    "pop {r0-r4, lr}\n"
+    "bx ip\n"
+    _ASM_FUNC_END("tmixdynld_internal_lazy_trampoline")
+);
+#endif
+
+/*
+ * called by the trampoline on the first call of a PLT entry
+ *
+ * returns the address to jump to, never returns if the symbol cannot be bound
+ */
+__attribute__((used)) void *__tmixabi __fixup(__lazy_image *image, uintptr_t arg) {
+    const tmixelf_reloc *relocs = image->ei->relocs.data;  // array
+    const tmixelf_sym *syms = image->ei->syms.data;  // array
+    const tmixelf_reloc *reloc = NULL;
+
+#if defined(__x86_64__) || defined(__i386__)
+    // index of the relocation entry, or offset of it in REL table on i386
+#  ifdef __i386__
+    arg /= 2 * sizeof(uint32_t);
+#  endif
+
+    if (arg < image->index_size && image->index[arg] < image->ei->relocs.size)
+        reloc = &relocs[image->index[arg]];
+#else
+    // address of the GOT entry, find it in the sorted relocation entries
+    size_t off = arg - (uintptr_t) image->base;
+    size_t lo = 0, hi = image->ei->relocs.size;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        if (relocs[mid].off < off)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo < image->ei->relocs.size && relocs[lo].off == off)
+        reloc = &relocs[lo];
+#endif
+
+    if (!reloc) {
+        fprintf(stderr, "error binding symbol lazily: no relocation entry for %#jx\n", (uintmax_t) arg);
+        abort();
+    }
+
+    const tmixelf_sym *sym = &syms[reloc->symidx];
+    void *the_sym = _tmixdynld_internal_resolve(image->base, sym);
+
+    if (!the_sym) {
+        // the error is already reported, unless sym is weak
+        if (sym->weak)
+            fprintf(stderr, "error binding symbol lazily: weak symbol %s is undefined\n", sym->name);
+
+        abort();
+    }
+
+    // racing with other threads is fine, they write the same value
+    *(void **) (image->base + reloc->off) = the_sym;
+    __atomic_fetch_add(&__lazy_count, 1, __ATOMIC_RELAXED);
+
+    return the_sym;
+}
+#endif /* TMIXDYNLD_LAZY_SUPPORTED */
+
+int _tmixdynld_internal_setup_lazy(void *base, const tmixelf_info *ei) {
+#ifndef TMIXDYNLD_LAZY_SUPPORTED
+    (void) base;
+    (void) ei;
+
+    errno = ENOTSUP;
+    return -1;
+#else
+    if (!ei->pltgot || ei->mem_size < 3 * sizeof(void *) || ei->pltgot > ei->mem_size - 3 * sizeof(void *)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    const tmixelf_reloc *relocs = ei->relocs.data;  // array
+    size_t i;
+
+    // the image lives as long as the guest, so it's never freed
+
+    __lazy_image *image = calloc(1, sizeof(__lazy_image));
+
+    if (!image)
+        return -1;
+
+    image->base = base;
+    image->ei = ei;
+
+#if defined(__x86_64__) || defined(__i386__)
+    // PLT entries identify themselves with the order in the relocation table,
+    // which might be different from the sorted one
+
+    for (i = 0; i < ei->relocs.size; i++) {
+        if (relocs[i].type == TMIXELF_RELOC_JUMP_SLOT && relocs[i].idx >= image->index_size)
+            image->index_size = relocs[i].idx + 1;
+    }
+
+    if (!(image->index = malloc(image->index_size * sizeof(uint32_t)))) {
+        free(image);
+        return -1;
+    }
+
+    for (i = 0; i < image->index_size; i++)
+        image->index[i] = UINT32_MAX;
+
+    for (i = 0; i < ei->relocs.size; i++) {
+        if (relocs[i].type == TMIXELF_RELOC_JUMP_SLOT)
+            image->index[relocs[i].idx] = i;
+    }
+#endif
+
+    void **got = (void **) ((char *) base + ei->pltgot);
+
+    got[1] = image;
+    got[2] = (void *) __trampoline;
+
+    // GOT entries point back to the PLT before binding, just relocate them,
+    // other kinds of relocations are left to the caller
+
+    for (i = 0; i < ei->relocs.size; i++) {
+        if (relocs[i].type == TMIXELF_RELOC_JUMP_SLOT)
+            *(uintptr_t *) ((char *) base + relocs[i].off) += (uintptr_t) base;
+    }
+
+    return 0;
+#endif
+}
+
+size_t _tmixdynld_internal_lazy_count(void) {
+    return __atomic_load_n(&__lazy_count, __ATOMIC_RELAXED);
+}
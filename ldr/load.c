@@ -17,8 +17,12 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #ifdef _WIN32
@@ -30,12 +34,172 @@
 
 #  define MAP_FAILED        NULL
 #else
+#  include <fcntl.h>
 #  include <sys/mman.h>
+#  include <sys/resource.h>
+#  include <unistd.h>
+#endif
+
+// a stack can be made for programs only where the layout Linux gives them is known
+#if defined(__linux__) && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__) || defined(__arm__))
+#  define _STACK_SUPPORTED
+#  include <link.h>
+#  include <sys/auxv.h>
+#  include <sys/random.h>
 #endif
 
+#include "../inc/probes.h"
+#include "../inc/prof.h"
+
 #include "elf/elf.h"
 #include "load.h"
 
+// writable pages are about to be relocated, text is about to run
+static const tmixldr_load_policy __builtin_policy = {
+    .text = TMIXLDR_ADVICE_WILLNEED,
+    .rodata = TMIXLDR_ADVICE_DEMAND,
+    .data = TMIXLDR_ADVICE_POPULATE,
+};
+
+static tmixldr_load_policy __policy = {};  // process-wide one, only written by the constructor below or users
+static size_t __pagesize = 4096;  // only written once by the constructor below
+static size_t __huge_pagesize = 0;  // read on first use
+
+#define _DEFAULT_STACK_SIZE       (8 * 1024 * 1024)  // if RLIMIT_STACK is unlimited
+#define _DEFAULT_STACK_GUARD      (1024 * 1024)  // the same as stack_guard_gap of Linux
+#define _STACK_RANDOM_SIZE        (16)  // bytes pointed by AT_RANDOM
+
+static const char *const __advice_names[] = {
+    [TMIXLDR_ADVICE_DEFAULT] = "default",
+    [TMIXLDR_ADVICE_DEMAND] = "demand",
+    [TMIXLDR_ADVICE_POPULATE] = "populate",
+    [TMIXLDR_ADVICE_WILLNEED] = "willneed",
+    [TMIXLDR_ADVICE_SEQUENTIAL] = "sequential",
+    [TMIXLDR_ADVICE_RANDOM] = "random",
+};
+
+/*
+ * returns the advice of policy for segments with flags
+ */
+static inline tmixldr_advice __pick_advice(const tmixldr_load_policy *policy, tmixelf_seg_flag flags) {
+    if (flags & TMIXELF_SEG_EXEC)
+        return policy->text;
+
+    return flags & TMIXELF_SEG_WRITE ? policy->data : policy->rodata;
+}
+
+/*
+ * returns the advice for segments with flags, falling back to the process-wide policy,
+ * then the built-in one
+ */
+static tmixldr_advice __get_advice(const tmixldr_load_policy *policy, tmixelf_seg_flag flags) {
+    tmixldr_advice advice = policy ? __pick_advice(policy, flags) : TMIXLDR_ADVICE_DEFAULT;
+
+    if (advice == TMIXLDR_ADVICE_DEFAULT)
+        advice = __pick_advice(&__policy, flags);
+
+    if (advice == TMIXLDR_ADVICE_DEFAULT)
+        advice = __pick_advice(&__builtin_policy, flags);
+
+    return advice;
+}
+
+/*
+ * returns the size of transparent huge pages, 2MiB if unknown
+ */
+static size_t __get_huge_pagesize(void) {
+    size_t size = __atomic_load_n(&__huge_pagesize, __ATOMIC_RELAXED);
+
+    if (size)
+        return size;
+
+    size = 2 * 1024 * 1024;
+
+#ifdef __linux__
+    FILE *fp = fopen("/sys/kernel/mm/transparent_hugepage/hpage_pmd_size", "r");
+
+    if (fp) {
+        unsigned long value;
+
+        // only powers of two make sense
+        if (fscanf(fp, "%lu", &value) == 1 && value && !(value & (value - 1)))
+            size = value;
+
+        fclose(fp);
+    }
+#endif
+
+    // racing with other threads is fine, they write the same value
+    __atomic_store_n(&__huge_pagesize, size, __ATOMIC_RELAXED);
+
+    return size;
+}
+
+/*
+ * returns the alignment the image should be reserved with, zero if any page works
+ */
+static size_t __get_align(const tmixelf_info *ei, bool huge) {
+    size_t align = ei->align;
+
+    if (huge && align < __get_huge_pagesize())
+        align = __get_huge_pagesize();
+
+    // never trust a broken value
+    if (align <= __pagesize || (align & (align - 1)))
+        return 0;
+
+    return align;
+}
+
+#ifndef _WIN32
+/*
+ * addr - where the file part of seg is mapped
+ *
+ * pass the advice on to the kernel, both for the mapping and the page cache
+ */
+static void __advise(int fd, void *addr, const tmixelf_seg *seg, tmixldr_advice advice) {
+    int madv;
+#  ifdef POSIX_FADV_NORMAL
+    int fadv;
+#  endif
+
+    switch (advice) {
+#  ifndef MAP_POPULATE
+        case TMIXLDR_ADVICE_POPULATE:  // the closest one
+#  endif
+        case TMIXLDR_ADVICE_WILLNEED:
+            madv = MADV_WILLNEED;
+#  ifdef POSIX_FADV_NORMAL
+            fadv = POSIX_FADV_WILLNEED;
+#  endif
+            break;
+        case TMIXLDR_ADVICE_SEQUENTIAL:
+            madv = MADV_SEQUENTIAL;
+#  ifdef POSIX_FADV_NORMAL
+            fadv = POSIX_FADV_SEQUENTIAL;
+#  endif
+            break;
+        case TMIXLDR_ADVICE_RANDOM:
+            madv = MADV_RANDOM;
+#  ifdef POSIX_FADV_NORMAL
+            fadv = POSIX_FADV_RANDOM;
+#  endif
+            break;
+        default:
+            return;
+    }
+
+    // only hints, failures are fine
+
+#  ifdef POSIX_FADV_NORMAL
+    posix_fadvise(fd, seg->file.off, seg->file.size, fadv);
+#  else
+    (void) fd;
+#  endif
+    madvise(addr, seg->file.size, madv);
+}
+#endif
+
 #ifdef _WIN32
 #define tmixldr_internal_prot_zero      {}
 typedef struct {
@@ -143,7 +307,78 @@ error:
 }
 #endif
 
+#ifndef _WIN32
+/*
+ * returns whether next follows seg in both memory and the file, so they can share a mapping
+ */
+static inline bool __is_contiguous(const tmixelf_seg *seg, const tmixelf_seg *next) {
+    size_t mapped = (seg->file.size + __pagesize - 1) & ~(__pagesize - 1);
+
+    return seg->file.size && !seg->pad.size && next->file.size
+           && seg->off + mapped == next->off && seg->file.off + mapped == next->file.off;
+}
+
+/*
+ * si - segments to map, from first to last - 1, each one follows the previous one
+ *
+ * map segments with a single mmap, in the protection shared by most runs of segments
+ * with the same protection, then mprotect the other runs
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __map_segs(char *base, int fd, const tmixelf_seg *si, size_t first, size_t last, int map_flags) {
+    int best_prot = __conv_prot(si[first].flags, false);
+    size_t best_count = 0;
+    size_t i, j;
+
+    for (i = first; i < last; i++) {
+        int prot = __conv_prot(si[i].flags, false);
+        size_t count = 0;
+
+        for (j = first; j < last; j++) {
+            if (__conv_prot(si[j].flags, false) == prot && (j == first || __conv_prot(si[j - 1].flags, false) != prot))
+                count++;
+        }
+
+        if (best_count < count) {
+            best_count = count;
+            best_prot = prot;
+        }
+    }
+
+    const tmixelf_seg *end = &si[last - 1];
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+    if (mmap(base + si[first].off, end->off + end->file.size - si[first].off, best_prot,
+             map_flags, fd, si[first].file.off) == MAP_FAILED)
+        return -1;
+
+    for (i = first; i < last; i = j) {
+        int prot = __conv_prot(si[i].flags, false);
+
+        for (j = i + 1; j < last && __conv_prot(si[j].flags, false) == prot; j++);
+
+        size_t size = (j < last ? si[j].off : end->off + end->file.size) - si[i].off;
+
+        if (prot == best_prot)
+            continue;
+
+        _tmix_prof_count(TMIX_PROF_MPROTECTS, 1);
+
+        if (mprotect(base + si[i].off, size, prot) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+#endif
+
 int tmixldr_load_elf(int fd, const tmixelf_info *ei, tmixldr_elf *e) {
+    return tmixldr_load_elf_with_policy(fd, ei, NULL, e);
+}
+
+int tmixldr_load_elf_with_policy(int fd, const tmixelf_info *ei, const tmixldr_load_policy *policy, tmixldr_elf *e) {
     if (e->base) {
         // seems already loaded
         errno = EBUSY;
@@ -174,15 +409,23 @@ int tmixldr_load_elf(int fd, const tmixelf_info *ei, tmixldr_elf *e) {
     }
 #endif
 
-    // reserve memory
+    // reserve memory, more than needed if segments ask for an alignment larger than pages,
+    // or the image should be backed by huge pages
+
+    bool huge = (policy && policy->huge) || __policy.huge;
+    size_t align = __get_align(ei, huge);
+    size_t reserved_size = ei->mem_size + align;
 
 #ifdef _WIN32
-    void *base = VirtualAlloc(NULL, ei->mem_size, MEM_RESERVE, PAGE_NOACCESS);
+    void *reserved = VirtualAlloc(NULL, reserved_size, MEM_RESERVE, PAGE_NOACCESS);
 #else
-    void *base = mmap(NULL, ei->mem_size, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    void *reserved = mmap(NULL, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
 #endif
+    void *base = reserved;
 
-    if (base == MAP_FAILED) {
+    if (reserved == MAP_FAILED) {
 #ifdef _WIN32
         // FIXME: set errno according to win32 error
         errno = -1;
@@ -194,11 +437,27 @@ quit:
         return -1;
     }
 
+    if (align) {
+        base = (void *) (((uintptr_t) reserved + align - 1) & ~(uintptr_t) (align - 1));
+
+#if !defined(_WIN32) && !defined(__CYGWIN__)
+        // trim the reservation around the image, whole pages only
+
+        void *end = base + ((ei->mem_size + __pagesize - 1) & ~(__pagesize - 1));
+
+        if (base > reserved)
+            munmap(reserved, base - reserved);
+
+        if (end < reserved + reserved_size)
+            munmap(end, reserved + reserved_size - end);
+#endif
+    }
+
 // Unlike Linux, NT kernel doesn't like overlapped memory mappings
 #ifdef _WIN32
-    VirtualFree(base, 0, MEM_RELEASE);
+    VirtualFree(reserved, 0, MEM_RELEASE);
 #elif defined(__CYGWIN__)
-    munmap(base, ei->mem_size);
+    munmap(reserved, reserved_size);
 #endif
 
     // setup segments
@@ -208,18 +467,46 @@ quit:
     assert(si && si[0].off == 0);
 
     size_t i;
+#ifndef _WIN32
+    size_t mapped_end = 0;  // index of the first segment not mapped yet
+#endif
 
     for (i = 0; i < ei->segs.size; i++) {
+#ifdef _WIN32
         tmixldr_internal_prot_t prot_file = __conv_prot(si[i].flags, false);
+#endif
         tmixldr_internal_prot_t prot_pad = __conv_prot(si[i].flags, true);
+        tmixldr_advice advice = __get_advice(policy, si[i].flags);
+
+#ifdef _WIN32
+        (void) advice;  // TODO: PrefetchVirtualMemory
+#else
+        int map_flags = MAP_FIXED | MAP_PRIVATE;
+
+#  ifdef MAP_POPULATE
+        if (advice == TMIXLDR_ADVICE_POPULATE)
+            map_flags |= MAP_POPULATE;
+#  endif
+
+        // segments following each other in both memory and the file are mapped at once,
+        // unless they are populated differently, so there are fewer syscalls and VMAs
+
+        size_t run_end = i + 1;
+
+        if (i >= mapped_end) {
+            while (run_end < ei->segs.size && __is_contiguous(&si[run_end - 1], &si[run_end])
+                   && (__get_advice(policy, si[run_end].flags) == TMIXLDR_ADVICE_POPULATE)
+                      == (advice == TMIXLDR_ADVICE_POPULATE))
+                run_end++;
+        }
+#endif
 
         if (si[i].file.size &&
 #ifdef _WIN32
             __win32_mmap_file(base + si[i].off, si[i].file.size,
                         prot_file, hFile, si[i].file.off) == MAP_FAILED) {
 #else
-            mmap(base + si[i].off, si[i].file.size, prot_file,
-                    MAP_FIXED | MAP_PRIVATE, fd, si[i].file.off) == MAP_FAILED) {
+            i >= mapped_end && __map_segs(base, fd, si, i, run_end, map_flags) < 0) {
 #endif
 error:
 #if defined(_WIN32)
@@ -255,6 +542,30 @@ error:
 #endif
             goto error;
         }
+
+#ifndef _WIN32
+        if (si[i].pad.size)
+            _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+        if (mapped_end < run_end)
+            mapped_end = run_end;
+
+        if (si[i].file.size)
+            __advise(fd, base + si[i].off, &si[i], advice);
+#endif
+
+        _tmix_probe3(map_segment, base + si[i].off,
+                     si[i].pad.size ? si[i].pad.off + si[i].pad.size : si[i].file.size, si[i].flags);
+
+#ifdef MADV_HUGEPAGE
+        // text is only backed by huge pages if the file allows, zero paddings always are,
+        // failures are fine as well
+        if (huge && (si[i].flags & TMIXELF_SEG_EXEC) && si[i].file.size)
+            madvise(base + si[i].off, si[i].file.size, MADV_HUGEPAGE);
+
+        if (huge && si[i].pad.size)
+            madvise(base + si[i].off + si[i].pad.off, si[i].pad.size, MADV_HUGEPAGE);
+#endif
     }
 
 #ifdef _WIN32
@@ -296,3 +607,505 @@ void tmixldr_unload_elf(tmixldr_elf *e, const tmixelf_info *ei) {
 #endif
     e->base = NULL;
 }
+
+int tmixldr_parse_load_policy(const char *str, tmixldr_load_policy *policy) {
+    while (*str) {
+        size_t len = strcspn(str, ",");
+        const char *eq = memchr(str, '=', len);
+        const char *name = eq ? eq + 1 : str;
+        size_t name_len = len - (name - str);
+        size_t kind_len = eq ? (size_t) (eq - str) : 0;
+        size_t i;
+
+        if (!eq && name_len == 4 && !strncmp(name, "huge", 4)) {
+            policy->huge = true;
+
+            goto next;
+        }
+
+        for (i = 0; i < sizeof(__advice_names) / sizeof(__advice_names[0]); i++) {
+            if (strlen(__advice_names[i]) == name_len && !strncmp(name, __advice_names[i], name_len))
+                break;
+        }
+
+        if (i == sizeof(__advice_names) / sizeof(__advice_names[0])) {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (!eq)
+            policy->text = policy->rodata = policy->data = i;
+        else if (kind_len == 4 && !strncmp(str, "text", 4))
+            policy->text = i;
+        else if (kind_len == 6 && !strncmp(str, "rodata", 6))
+            policy->rodata = i;
+        else if (kind_len == 4 && !strncmp(str, "data", 4))
+            policy->data = i;
+        else {
+            errno = EINVAL;
+            return -1;
+        }
+
+next:
+        str += len;
+
+        if (*str)
+            str++;  // skip the comma
+    }
+
+    return 0;
+}
+
+void tmixldr_set_load_policy(const tmixldr_load_policy *policy) {
+    __policy = *policy;
+}
+
+void tmixldr_get_load_policy(tmixldr_load_policy *policy) {
+    *policy = __policy;
+}
+
+ssize_t tmixldr_count_huge_pages(const tmixldr_elf *e, const tmixelf_info *ei) {
+#ifndef __linux__
+    (void) e;
+    (void) ei;
+
+    errno = ENOTSUP;
+    return -1;
+#else
+    FILE *fp = fopen("/proc/self/smaps", "r");
+
+    if (!fp)
+        return -1;
+
+    // sum huge pages of all mappings within the image, anonymous or file-backed ones
+
+    uintptr_t lo = (uintptr_t) e->base, hi = lo + ei->mem_size;
+    bool inside = false;
+    size_t kbytes = 0;
+    char line[512];
+
+    while (fgets(line, sizeof(line), fp)) {
+        uintptr_t start, end;
+        size_t value;
+
+        if (sscanf(line, "%" SCNxPTR "-%" SCNxPTR " ", &start, &end) == 2)
+            inside = start < hi && end > lo;
+        else if (inside && (sscanf(line, "AnonHugePages: %zu kB", &value) == 1
+                            || sscanf(line, "FilePmdMapped: %zu kB", &value) == 1))
+            kbytes += value;
+    }
+
+    fclose(fp);
+
+    return kbytes * 1024 / __get_huge_pagesize();
+#endif
+}
+
+/*
+ * str - a size in bytes, optionally followed by K, M or G
+ * len - length of str
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __parse_size(const char *str, size_t len, size_t *size) {
+    size_t value = 0;
+    size_t i;
+
+    for (i = 0; i < len && str[i] >= '0' && str[i] <= '9'; i++) {
+        if (value > (SIZE_MAX - 9) / 10)
+            goto invalid;
+
+        value = value * 10 + (str[i] - '0');
+    }
+
+    if (!i)
+        goto invalid;
+
+    if (i + 1 == len) {
+        int shift;
+
+        switch (str[i]) {
+            case 'K': case 'k': shift = 10; break;
+            case 'M': case 'm': shift = 20; break;
+            case 'G': case 'g': shift = 30; break;
+            default: goto invalid;
+        }
+
+        if (value > SIZE_MAX >> shift)
+            goto invalid;
+
+        value <<= shift;
+    } else if (i != len)
+        goto invalid;
+
+    *size = value;
+
+    return 0;
+
+invalid:
+    errno = EINVAL;
+    return -1;
+}
+
+int tmixldr_parse_stack_policy(const char *str, tmixldr_stack_policy *policy) {
+    while (*str) {
+        size_t len = strcspn(str, ",");
+        const char *eq = memchr(str, '=', len);
+        size_t kind_len = eq ? (size_t) (eq - str) : len;
+        size_t *field;
+
+        if (!eq && kind_len == 4 && !strncmp(str, "huge", 4)) {
+            policy->huge = true;
+
+            goto next;
+        }
+
+        if (eq && kind_len == 4 && !strncmp(str, "size", 4))
+            field = &policy->size;
+        else if (eq && kind_len == 5 && !strncmp(str, "guard", 5))
+            field = &policy->guard;
+        else if (eq && kind_len == 8 && !strncmp(str, "prefault", 8))
+            field = &policy->prefault;
+        else {
+            errno = EINVAL;
+            return -1;
+        }
+
+        if (__parse_size(eq + 1, len - kind_len - 1, field) < 0)
+            return -1;
+
+next:
+        str += len;
+
+        if (*str)
+            str++;  // skip the comma
+    }
+
+    return 0;
+}
+
+#ifdef _STACK_SUPPORTED
+/*
+ * copy len bytes of data right below *top, and move *top there
+ */
+static inline char *__push(char **top, const void *data, size_t len) {
+    *top -= len;
+    memcpy(*top, data, len);
+
+    return *top;
+}
+#endif
+
+int tmixldr_make_stack(const tmixldr_stack_policy *policy, const tmixldr_elf *e, const tmixelf_info *ei,
+                       char *const *argv, char *const *envp, tmixldr_stack *stack) {
+#ifndef _STACK_SUPPORTED
+    (void) policy;
+    (void) e;
+    (void) ei;
+    (void) argv;
+    (void) envp;
+    (void) stack;
+
+    errno = ENOTSUP;
+    return -1;
+#else
+    static const tmixldr_stack_policy default_policy = {};
+
+    if (!policy)
+        policy = &default_policy;
+
+    if (!argv[0]) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t size = policy->size;
+    size_t guard = policy->guard ? policy->guard : _DEFAULT_STACK_GUARD;
+    size_t align = policy->huge ? __get_huge_pagesize() : __pagesize;
+
+    if (!size) {
+        struct rlimit rl;
+
+        if (!getrlimit(RLIMIT_STACK, &rl) && rl.rlim_cur != RLIM_INFINITY)
+            size = rl.rlim_cur;
+        else
+            size = _DEFAULT_STACK_SIZE;
+    }
+
+    size = (size + align - 1) & ~(align - 1);
+    guard = (guard + __pagesize - 1) & ~(__pagesize - 1);
+
+    // count everything going onto the stack, limited to a quarter of it like Linux does
+
+    const char *platform = (const char *) getauxval(AT_PLATFORM);
+    size_t argc, envc;
+    size_t strings_size = sizeof(uintptr_t) + strlen(argv[0]) + 1  // end marker and AT_EXECFN
+                          + (platform ? strlen(platform) + 1 : 0) + _STACK_RANDOM_SIZE;
+
+    for (argc = 0; argv[argc]; argc++)
+        strings_size += strlen(argv[argc]) + 1;
+
+    for (envc = 0; envp[envc]; envc++)
+        strings_size += strlen(envp[envc]) + 1;
+
+    uintptr_t auxv[22][2];  // enough for all entries below, AT_NULL included
+    size_t nwords = 1 + argc + 1 + envc + 1 + 2 * (sizeof(auxv) / sizeof(auxv[0]));
+
+    if (strings_size + nwords * sizeof(uintptr_t) + 16 > size / 4) {
+        errno = E2BIG;
+        return -1;
+    }
+
+    // reserve the guard and the stack, the top is aligned to huge pages if asked
+
+    size_t reserved_size = guard + size + (align > __pagesize ? align : 0);
+    char *reserved = mmap(NULL, reserved_size, PROT_NONE, MAP_PRIVATE | MAP_ANON | MAP_NORESERVE, -1, 0);
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+    if (reserved == MAP_FAILED)
+        return -1;
+
+    char *top = (char *) (((uintptr_t) reserved + reserved_size) & ~(uintptr_t) (align - 1));
+    char *low = top - size - guard;
+
+    if (low > reserved)
+        munmap(reserved, low - reserved);
+
+    if (top < reserved + reserved_size)
+        munmap(top, reserved + reserved_size - top);
+
+    int prot = PROT_READ | PROT_WRITE | (ei->execstack ? PROT_EXEC : 0);
+    int map_flags = MAP_PRIVATE | MAP_ANON | MAP_FIXED;
+
+#ifdef MAP_STACK
+    map_flags |= MAP_STACK;
+#endif
+
+    if (mmap(top - size, size, prot, map_flags, -1, 0) == MAP_FAILED) {
+        int saved_errno = errno;
+
+        munmap(low, size + guard);
+        errno = saved_errno;
+
+        return -1;
+    }
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+#ifdef MADV_HUGEPAGE
+    if (policy->huge)
+        madvise(top - size, size, MADV_HUGEPAGE);
+#endif
+
+    // fault in the top ahead, instead of one page at a time while the program goes deeper
+
+    size_t prefault = (policy->prefault + __pagesize - 1) & ~(__pagesize - 1);
+
+    if (prefault > size)
+        prefault = size;
+
+    if (prefault) {
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(top - prefault, prefault, MADV_POPULATE_WRITE) < 0)
+#endif
+        {
+            // older kernels, touching each page does the same
+            char *page;
+
+            for (page = top - prefault; page < top; page += __pagesize)
+                *(volatile char *) page = 0;
+        }
+    }
+
+    // strings first, from the top: end marker, AT_EXECFN, environment, arguments, then
+    // AT_PLATFORM and AT_RANDOM, the new mapping is already zeroed
+
+    char *p = top - sizeof(uintptr_t);
+    char *execfn = __push(&p, argv[0], strlen(argv[0]) + 1);
+    size_t i;
+
+    for (i = envc; i-- > 0;)
+        __push(&p, envp[i], strlen(envp[i]) + 1);
+
+    char *env_strings = p;
+
+    for (i = argc; i-- > 0;)
+        __push(&p, argv[i], strlen(argv[i]) + 1);
+
+    char *arg_strings = p;
+    char *platform_copy = platform ? __push(&p, platform, strlen(platform) + 1) : NULL;
+    unsigned char random[_STACK_RANDOM_SIZE];
+
+    if (getrandom(random, sizeof(random), GRND_NONBLOCK) != sizeof(random)) {
+        // the loader's own ones are still unpredictable to the program
+        const void *host_random = (const void *) getauxval(AT_RANDOM);
+
+        if (host_random)
+            memcpy(random, host_random, sizeof(random));
+        else
+            memset(random, 0, sizeof(random));
+    }
+
+    char *random_copy = __push(&p, random, sizeof(random));
+
+    // then the auxiliary vector, mostly what the loader itself got, except the ones of the program
+
+    size_t nauxv = 0;
+
+#define _ADD_AUXV(_type, _value)   do { auxv[nauxv][0] = (_type); auxv[nauxv][1] = (uintptr_t) (_value); \
+                                        nauxv++; } while (0)
+
+    if (ei->phdrs.size) {
+        _ADD_AUXV(AT_PHDR, (char *) e->base + ei->phdrs.off);
+        _ADD_AUXV(AT_PHENT, sizeof(ElfW(Phdr)));
+        _ADD_AUXV(AT_PHNUM, ei->phdrs.size);
+    }
+
+    _ADD_AUXV(AT_PAGESZ, __pagesize);
+    _ADD_AUXV(AT_BASE, 0);  // no interpreter
+    _ADD_AUXV(AT_FLAGS, 0);
+    _ADD_AUXV(AT_ENTRY, e->entry);
+    _ADD_AUXV(AT_UID, getauxval(AT_UID));
+    _ADD_AUXV(AT_EUID, getauxval(AT_EUID));
+    _ADD_AUXV(AT_GID, getauxval(AT_GID));
+    _ADD_AUXV(AT_EGID, getauxval(AT_EGID));
+    _ADD_AUXV(AT_SECURE, getauxval(AT_SECURE));
+    _ADD_AUXV(AT_RANDOM, random_copy);
+    _ADD_AUXV(AT_EXECFN, execfn);
+
+    if (platform_copy)
+        _ADD_AUXV(AT_PLATFORM, platform_copy);
+
+    // ones the host might not have
+
+    static const unsigned long host_types[] = {
+        AT_HWCAP,
+        AT_HWCAP2,
+        AT_CLKTCK,
+#ifdef AT_SYSINFO_EHDR
+        AT_SYSINFO_EHDR,  // the vDSO is mapped in the process anyway
+#endif
+#ifdef AT_MINSIGSTKSZ
+        AT_MINSIGSTKSZ,
+#endif
+    };
+
+    for (i = 0; i < sizeof(host_types) / sizeof(host_types[0]); i++) {
+        unsigned long value = getauxval(host_types[i]);
+
+        if (value)
+            _ADD_AUXV(host_types[i], value);
+    }
+
+    _ADD_AUXV(AT_NULL, 0);
+
+#undef _ADD_AUXV
+
+    assert(nauxv <= sizeof(auxv) / sizeof(auxv[0]));
+
+    // finally argc, argv and envp, at the 16-byte aligned stack pointer
+
+    uintptr_t *sp = (uintptr_t *) (((uintptr_t) p - nwords * sizeof(uintptr_t)) & ~(uintptr_t) 15);
+    uintptr_t *word = sp;
+
+    *word++ = argc;
+
+    for (i = 0; i < argc; i++) {
+        *word++ = (uintptr_t) arg_strings;
+        arg_strings += strlen(arg_strings) + 1;
+    }
+
+    *word++ = 0;
+
+    for (i = 0; i < envc; i++) {
+        *word++ = (uintptr_t) env_strings;
+        env_strings += strlen(env_strings) + 1;
+    }
+
+    *word++ = 0;
+
+    memcpy(word, auxv, nauxv * sizeof(auxv[0]));
+
+    stack->addr = low;
+    stack->size = size + guard;
+    stack->sp = sp;
+
+    return 0;
+#endif
+}
+
+void tmixldr_free_stack(tmixldr_stack *stack) {
+#ifdef _STACK_SUPPORTED
+    if (stack->addr)
+        munmap(stack->addr, stack->size);
+#endif
+
+    *stack = (tmixldr_stack) {};
+}
+
+void tmixldr_start(const tmixldr_elf *e, const tmixldr_stack *stack) {
+    // the rest of registers are left as they are, Linux only promises these ones
+#if defined(_STACK_SUPPORTED) && defined(__x86_64__)
+    // rdx holds a function to register with atexit, none here
+    __asm__ __volatile__ ("mov %0, %%rsp\n"
+                          "xor %%edx, %%edx\n"
+                          "xor %%ebp, %%ebp\n"
+                          "jmp *%1\n"
+                          :: "r" (stack->sp), "a" (e->entry) : "memory");
+#elif defined(_STACK_SUPPORTED) && defined(__i386__)
+    __asm__ __volatile__ ("mov %0, %%esp\n"
+                          "xor %%edx, %%edx\n"
+                          "xor %%ebp, %%ebp\n"
+                          "jmp *%1\n"
+                          :: "r" (stack->sp), "a" (e->entry) : "memory");
+#elif defined(_STACK_SUPPORTED) && defined(__aarch64__)
+    // x0 holds a function to register with atexit, none here,
+    // the entry is pinned to ip0, since x29 cannot be declared clobbered with frame pointers
+    register uintptr_t entry __asm__("x16") = (uintptr_t) e->entry;
+
+    __asm__ __volatile__ ("mov sp, %0\n"
+                          "mov x0, xzr\n"
+                          "mov x29, xzr\n"
+                          "mov x30, xzr\n"
+                          "br %1\n"
+                          :: "r" (stack->sp), "r" (entry) : "x0", "x30", "memory");
+#elif defined(_STACK_SUPPORTED) && defined(__arm__)
+    register uintptr_t entry __asm__("ip") = (uintptr_t) e->entry;
+
+    __asm__ __volatile__ ("mov sp, %0\n"
+                          "mov r0, #0\n"
+                          "mov lr, #0\n"
+                          "bx %1\n"
+                          :: "r" (stack->sp), "r" (entry) : "r0", "lr", "memory");
+#else
+    // never made on this platform
+    (void) e;
+    (void) stack;
+
+    abort();
+#endif
+
+    __builtin_unreachable();
+}
+
+__attribute__((constructor)) static void __init_policy(void) {
+#ifdef _WIN32
+    SYSTEM_INFO si = {};
+    GetSystemInfo(&si);  // wont fail
+    __pagesize = si.dwAllocationGranularity;  // where views can be mapped
+#else
+    long pagesize = sysconf(_SC_PAGESIZE);
+
+    if (pagesize > 0)
+        __pagesize = pagesize;
+#endif
+
+    const char *str = getenv("TMIXLDR_LOAD_POLICY");
+
+    if (str && tmixldr_parse_load_policy(str, &__policy) < 0) {
+        fprintf(stderr, "ignoring invalid TMIXLDR_LOAD_POLICY: %s\n", str);
+
+        __policy = (tmixldr_load_policy) {};
+    }
+}
@@ -18,6 +18,9 @@
 #ifndef TERMIX_LOADER_LOAD_H
 #define TERMIX_LOADER_LOAD_H
 
+#include <stdbool.h>
+#include <sys/types.h>
+
 #include "../inc/abi.h"
 
 #include "elf/elf.h"
@@ -43,6 +46,54 @@ typedef struct {
     __tmixabi void (*entry)(void);  // ELF entrypoint function pointer
 } tmixldr_elf;
 
+/*
+ * how pages of a segment are brought in, all but demand paging are only hints
+ */
+typedef enum {
+    TMIXLDR_ADVICE_DEFAULT = 0,  // whatever the process-wide policy says
+    TMIXLDR_ADVICE_DEMAND,  // fault pages in on first access
+    TMIXLDR_ADVICE_POPULATE,  // fault all pages in while mapping, private copies of writable ones
+    TMIXLDR_ADVICE_WILLNEED,  // read the file ahead in background
+    TMIXLDR_ADVICE_SEQUENTIAL,  // read ahead aggressively, drop pages soon after access
+    TMIXLDR_ADVICE_RANDOM  // never read ahead
+} tmixldr_advice;
+
+/*
+ * advices for each kind of segment, only the part backed by the file is affected
+ *
+ * initialize this struct with zero to follow the process-wide policy
+ */
+typedef struct {
+    tmixldr_advice text;  // executable segments
+    tmixldr_advice rodata;  // other read-only segments
+    tmixldr_advice data;  // writable segments
+    bool huge;  /* align the image to huge pages and ask for them for text and zero paddings,
+                   either this or the process-wide one is enough */
+} tmixldr_load_policy;
+
+/*
+ * how the initial stack of a program is set up
+ *
+ * initialize this struct with zero for defaults
+ */
+typedef struct {
+    size_t size;  // usable bytes, zero for the soft limit of RLIMIT_STACK, or 8MiB if unlimited
+    size_t guard;  // inaccessible bytes right below the stack, zero for 1MiB
+    size_t prefault;  // bytes at the top faulted in before starting, zero for none
+    bool huge;  // align the stack to huge pages and ask for them
+} tmixldr_stack_policy;
+
+/*
+ * the initial stack of a program
+ *
+ * initialize this struct with zero
+ */
+typedef struct {
+    void *addr;  // lowest address of the mapping, guard included
+    size_t size;  // size of the mapping, guard included
+    void *sp;  // initial stack pointer, pointing at argc
+} tmixldr_stack;
+
 /*
  * fd - read-only file descriptor referencing and opened ELF file
  * ei - buffer holding information about the previously parsed ELF file
@@ -50,10 +101,57 @@ typedef struct {
  *
  * returns 0 if succeed, otherwise -1 and sets errno
  *
+ * segments are loaded with the process-wide policy, see tmixldr_set_load_policy,
+ * the image is aligned to the largest alignment of its segments
+ *
  * NOTE: if the function failed, no ELF data is mapped to memory
+ * NOTE: the file offset of fd is not used, so fd can still be shared with tmixelf_parse_info
  */
 _tmixldr_api int tmixldr_load_elf(int fd, const tmixelf_info *ei, tmixldr_elf *e);
 
+/*
+ * policy - advices overriding the process-wide policy, NULL to follow it
+ *
+ * same as tmixldr_load_elf, but with the given policy
+ */
+_tmixldr_api int tmixldr_load_elf_with_policy(int fd, const tmixelf_info *ei,
+                                              const tmixldr_load_policy *policy, tmixldr_elf *e);
+
+/*
+ * str - comma separated list of advices, each one is kind=advice, or just advice for all kinds,
+ *       kinds are text, rodata and data, advices are default, demand, populate, willneed,
+ *       sequential and random, or huge to ask for huge pages, e.g. "text=willneed,data=populate"
+ * policy - buffer holding the policy to update
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, policy might be partially updated
+ */
+_tmixldr_api int tmixldr_parse_load_policy(const char *str, tmixldr_load_policy *policy);
+
+/*
+ * policy - new process-wide policy, its default advices are the built-in ones
+ *
+ * the process-wide policy is used by all ELFs loaded later, including libraries loaded by
+ * the dynamic linker, it's initialized from environment variable TMIXLDR_LOAD_POLICY,
+ * on top of the built-in one, which populates writable segments, and reads text ahead
+ *
+ * NOTE: not thread-safe, should be set before loading anything
+ */
+_tmixldr_api void tmixldr_set_load_policy(const tmixldr_load_policy *policy);
+
+/*
+ * policy - output buffer, the process-wide policy
+ */
+_tmixldr_api void tmixldr_get_load_policy(tmixldr_load_policy *policy);
+
+/*
+ * e - information about the loaded ELF
+ * ei - the ELF header information which used for loading previously
+ *
+ * returns the number of huge pages backing the image now, otherwise -1 and sets errno,
+ * text is only collapsed into huge pages in background by the kernel, if ever
+ */
+_tmixldr_api ssize_t tmixldr_count_huge_pages(const tmixldr_elf *e, const tmixelf_info *ei);
+
 /*
  * e - information about the loaded ELF
  * ei - the ELF header information which used for loading previously
@@ -62,4 +160,44 @@ _tmixldr_api int tmixldr_load_elf(int fd, const tmixelf_info *ei, tmixldr_elf *e
  */
 _tmixldr_api void tmixldr_unload_elf(tmixldr_elf *e, const tmixelf_info *ei);
 
+/*
+ * str - comma separated list of size=bytes, guard=bytes and prefault=bytes, sizes may end
+ *       with K, M or G, or just huge to ask for huge pages, e.g. "size=64M,prefault=256K"
+ * policy - buffer holding the policy to update
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, policy might be partially updated
+ */
+_tmixldr_api int tmixldr_parse_stack_policy(const char *str, tmixldr_stack_policy *policy);
+
+/*
+ * policy - how to set up the stack, NULL for defaults
+ * e - information about the loaded ELF
+ * ei - the ELF header information which used for loading previously
+ * argv - arguments of the program, ends with NULL, argv[0] is passed as AT_EXECFN as well
+ * envp - environment of the program, ends with NULL
+ * stack - output buffer
+ *
+ * map a stack, executable if the ELF asks so, and lay out argc, argv, envp and the auxiliary
+ * vector on its top as Linux does for a new process, strings are copied onto the stack
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno, ENOTSUP if the platform is not supported
+ */
+_tmixldr_api int tmixldr_make_stack(const tmixldr_stack_policy *policy, const tmixldr_elf *e,
+                                    const tmixelf_info *ei, char *const *argv, char *const *envp,
+                                    tmixldr_stack *stack);
+
+/*
+ * stack - the stack made previously
+ */
+_tmixldr_api void tmixldr_free_stack(tmixldr_stack *stack);
+
+/*
+ * e - information about the loaded ELF
+ * stack - the stack made for it
+ *
+ * switch to the stack and jump to the entrypoint with registers set as Linux does,
+ * the loader's own stack is left behind for good
+ */
+_tmixldr_api __attribute__((noreturn)) void tmixldr_start(const tmixldr_elf *e, const tmixldr_stack *stack);
+
 #endif /* TERMIX_LOADER_LOAD_H */
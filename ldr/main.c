@@ -17,103 +17,320 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
+#include "../inc/probes.h"
+#include "../inc/prof.h"
+
 #include "dynld.h"
 #include "elf/elf.h"
 #include "load.h"
 
+#include "_batch.h"
+#include "_server.h"
+
+// TLS blocks of the program and its libraries together
+#define _STATIC_TLS_SIZE          (64 * 1024)
+
+extern char **environ;  // passed to the program as is, unless it runs for a client of the server
+
+// the only thread-local variable, so every thread has it right next to its thread pointer
+static __thread char __static_tls[_STATIC_TLS_SIZE] __attribute__((aligned(TMIXDYNLD_STATIC_TLS_ALIGN)));
+
 static int __fd = -1;  // ELF file
 static tmixelf_info __ei = {};
 static tmixldr_elf __e = {};
+static tmixldr_stack_policy __stack_policy = {};
+static tmixldr_stack __stack = {};  // never unmapped, the program exits on it
+
+// parsed information and relocation results are cached across runs if a directory is given
+static const char *__cache_dir = NULL;
+
+static bool __timing = false;  // whether to print the time spent in each phase
+static const char *__prof_path = NULL;  // file to append the same as JSON to, NULL if not asked
 
 /*
- * entrypoint
+ * print huge pages backing the image once the program exits
  */
-int main(int argc, char **argv) {
-    const char *path = NULL;
-    bool debug = false;
-    int c;
+static void __report_huge_pages(void) {
+    ssize_t huge_pages = tmixldr_count_huge_pages(&__e, &__ei);
 
-    while ((c = getopt(argc, argv, "d")) != -1) {
-        switch (c) {
-            case 'd':
-                debug = true;
-                break;
-            default:
-usage_and_exit:
-                fprintf(stderr, "Usage: %s [-d] <elf file>\n", argv[0]);
-                goto exit;
-                break;
-        }
-    }
+    if (huge_pages >= 0)
+        fprintf(stderr, "huge pages backing the image at exit: %zd\n", huge_pages);
+}
 
-    int i;
+/*
+ * print and save phases recorded so far, right before jumping to the program, then stop recording
+ */
+static void __report_prof(const char *path) {
+    if (!__timing && !__prof_path)
+        return;
 
-    for (i = optind; i < argc; i++) {
-        if (path) {
-            fprintf(stderr, "only one elf file can be specified at a time\n");
-            goto usage_and_exit;
-        } else
-            path = argv[i];
-    }
+    tmix_prof prof;
 
-    if (!path) {
-        fprintf(stderr, "must specify an elf file to execute\n");
-        goto usage_and_exit;
-    }
+    _tmix_prof_snapshot(&prof);
+    _tmix_prof_disable();
+
+    if (__timing)
+        _tmix_prof_print(&prof, stderr);
+
+    if (__prof_path && _tmix_prof_write_json(&prof, path, __prof_path) < 0)
+        perror("error saving profile");
+}
+
+/*
+ * load and run the ELF at argv[0] with argv and envp, returns only if failed
+ */
+static void __run(char *const *argv, char *const *envp, bool debug) {
+    const char *path = argv[0];
+
+    // recording starts here, so programs forked by the server only count their own work
+    if (__timing || __prof_path)
+        _tmix_prof_enable();
+
+    _tmix_prof_switch(TMIX_PROF_PARSE);
 
     __fd = open(path, O_RDONLY);
     if (__fd < 0) {
         perror("error opening ELF");
 
-        goto exit;
+        return;
     }
 
-    if (tmixelf_parse_info(__fd, &__ei) < 0) {
+    if (tmixelf_parse_info_cached(__fd, __cache_dir, &__ei) < 0) {
         perror("error parsing ELF");
 
         if (errno == EBADF)
             fprintf(stderr, "the file may not be a vaild ELF, "
                             "or incompatible with this machine\n");
 
-        goto exit;
+        return;
     }
 
     if (debug)
         tmixelf_print_info(&__ei);
 
+    _tmix_prof_switch(TMIX_PROF_LOAD);
+
     if (tmixldr_load_elf(__fd, &__ei, &__e) < 0) {
         perror("error loading ELF");
 
         if (errno == EINVAL)
             fprintf(stderr, "the file might not be a loadable ELF\n");
 
-        goto exit;
+        return;
     }
 
     // fd can be closed once ELF itself is loaded
     close(__fd);
     __fd = -1;
 
+    _tmix_prof_switch(TMIX_PROF_OTHER);
+
     if (!__e.entry) {
         fprintf(stderr, "ELF entrypoint in unknown\n");
 
-        goto exit;
+        return;
     }
 
-    if (tmixdynld_handle_elf(__e.base, &__ei) < 0) {
+    if (tmixdynld_handle_elf_cached(__e.base, &__ei, __cache_dir) < 0) {
         perror("error linking ELF");
 
-        goto exit;
+        return;
     }
 
+    if (debug) {
+        tmixdynld_stats stats;
+
+        tmixdynld_get_stats(&stats);
+        fprintf(stderr, "applied %zu relative relocations and %zu relocations%s, %zu pages dirtied\n",
+                stats.relatives, stats.relocs, stats.cached ? " from cache" : stats.lazy ? " lazily" : "",
+                stats.dirty_pages);
+        fprintf(stderr, "symbol lookups: %zu hits, %zu misses\n", stats.sym_hits, stats.sym_misses);
+
+        // most pages are only touched by the program
+        atexit(__report_huge_pages);
+    }
+
+    // the program runs on a stack of its own, laid out as a new process, if the platform allows
+
+    if (tmixldr_make_stack(&__stack_policy, &__e, &__ei, argv, envp, &__stack) < 0
+        && errno != ENOTSUP) {
+        perror("error making stack");
+
+        return;
+    }
+
+    __report_prof(path);
+
+    _tmix_probe1(entry, __e.entry);
+
+    if (__stack.sp)
+        tmixldr_start(&__e, &__stack);
+
     __e.entry();
 
     fprintf(stderr, "[program returned to loader unexpectedly]\n");
+}
+
+/*
+ * entrypoint
+ */
+int main(int argc, char **argv) {
+    static const struct option options[] = {
+        { "server", required_argument, NULL, 's' },
+        { "check", optional_argument, NULL, 'c' },
+        { "info", no_argument, NULL, 'i' },
+        {}
+    };
+    static const char *const stage_names[TMIXLDR_INTERNAL_CHECK_NSTAGES] = {
+        [TMIXLDR_INTERNAL_CHECK_PARSE] = "parse",
+        [TMIXLDR_INTERNAL_CHECK_MAP] = "map",
+        [TMIXLDR_INTERNAL_CHECK_LINK] = "link",
+    };
+    const char *sock_path = NULL;
+    tmixldr_load_policy policy = {};
+    bool debug = false;
+    bool check = false;
+    bool info = false;
+    tmixldr_internal_check_stage stage = TMIXLDR_INTERNAL_CHECK_LINK;
+    size_t nthreads = 0;
+    int c;
+
+    tmixldr_get_load_policy(&policy);
+
+    // programs with TLS fail to link without it, which is up to them
+    tmixdynld_set_static_tls(__static_tls, sizeof(__static_tls));
+
+    // -S goes on top of it
+    const char *stack_str = getenv("TMIXLDR_STACK_POLICY");
+
+    if (stack_str && tmixldr_parse_stack_policy(stack_str, &__stack_policy) < 0) {
+        fprintf(stderr, "ignoring invalid TMIXLDR_STACK_POLICY: %s\n", stack_str);
+
+        __stack_policy = (tmixldr_stack_policy) {};
+    }
+
+    while ((c = getopt_long(argc, argv, "+dj:p:S:t", options, NULL)) != -1) {
+        switch (c) {
+            case 'd':
+                debug = true;
+                break;
+            case 't':
+                __timing = true;
+                break;
+            case 'p':
+                // on top of TMIXLDR_LOAD_POLICY, libraries are loaded with it as well
+                if (tmixldr_parse_load_policy(optarg, &policy) < 0) {
+                    fprintf(stderr, "invalid load policy: %s\n", optarg);
+                    goto usage_and_exit;
+                }
+
+                tmixldr_set_load_policy(&policy);
+                break;
+            case 'S':
+                if (tmixldr_parse_stack_policy(optarg, &__stack_policy) < 0) {
+                    fprintf(stderr, "invalid stack policy: %s\n", optarg);
+                    goto usage_and_exit;
+                }
+
+                break;
+            case 's':
+                sock_path = optarg;
+                break;
+            case 'c':
+                check = true;
+
+                if (!optarg)
+                    break;
+
+                for (stage = 0; stage < TMIXLDR_INTERNAL_CHECK_NSTAGES; stage++) {
+                    if (!strcmp(optarg, stage_names[stage]))
+                        break;
+                }
+
+                if (stage == TMIXLDR_INTERNAL_CHECK_NSTAGES) {
+                    fprintf(stderr, "invalid check stage: %s\n", optarg);
+                    goto usage_and_exit;
+                }
+
+                break;
+            case 'i':
+                info = true;
+                break;
+            case 'j': {
+                char *end;
+
+                // zero means a thread per CPU internally, which is only the default
+                errno = 0;
+                nthreads = strtoul(optarg, &end, 10);
+
+                if (errno || end == optarg || *end || *optarg == '-' || !nthreads) {
+                    fprintf(stderr, "invalid number of threads: %s\n", optarg);
+                    goto usage_and_exit;
+                }
+
+                break;
+            }
+            default:
+usage_and_exit:
+                fprintf(stderr, "Usage: %s [-d] [-t] [-p <load policy>] [-S <stack policy>] <elf file> [arg...]\n"
+                                "       %s [-t] [-p <load policy>] --server <socket> [library...]\n"
+                                "       %s [-j <threads>] [--check[=parse|map|link]] [--info] <elf file|@list>...\n",
+                                argv[0], argv[0], argv[0]);
+                goto exit;
+                break;
+        }
+    }
+
+    __cache_dir = getenv("TMIXLDR_CACHE_DIR");
+    __prof_path = getenv("TMIXLDR_PROF_JSON");
+
+    if (__prof_path && !*__prof_path)
+        __prof_path = NULL;
+
+    if (sock_path) {
+        // startup of the server is not counted for any program
+        if (__timing || __prof_path)
+            _tmix_prof_enable();
+
+        // libraries given are loaded once and shared by all programs
+
+        if (tmixdynld_preload_libs((const char *const *) &argv[optind], argc - optind, __cache_dir) < 0) {
+            perror("error preloading libraries");
+
+            goto exit;
+        }
+
+        _tmixldr_internal_serve(sock_path, __run);
+        perror("error serving socket");
+
+        goto exit;
+    }
+
+    if (check || info) {
+        // --info alone only parses
+        if (!check)
+            stage = TMIXLDR_INTERNAL_CHECK_PARSE;
+
+        int ret = _tmixldr_internal_batch((const char *const *) &argv[optind], argc - optind, stage,
+                                          info, nthreads, __cache_dir);
+
+        return ret < 0 ? EXIT_FAILURE : ret;
+    }
+
+    // the rest are arguments of the program, the path being argv[0]
+    if (optind >= argc) {
+        fprintf(stderr, "must specify an elf file to execute\n");
+        goto usage_and_exit;
+    }
+
+    __run(&argv[optind], environ, debug);
 
 exit:
     return EXIT_FAILURE;
@@ -0,0 +1,328 @@
+/*
+  relcache.c - Cache of relocation results
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#ifndef _WIN32
+#  include <sys/mman.h>
+#endif
+
+#include "../inc/paths.h"
+#include "../inc/prof.h"
+#include "../inc/types.h"
+
+#include "elf/elf.h"
+
+#include "_relcache.h"
+
+#define _ENTRY_MAGIC              "TMIXRC"
+#define _ENTRY_VERSION            (3)
+
+// sizes of serialized structs, entries written by another build are ignored
+#define _ENTRY_LAYOUT             ((uint32_t) (sizeof(size_t) << 8 | sizeof(tmixdynld_internal_binding)))
+
+#define _ALIGN_UP(_x)             (((_x) + 7) & ~(size_t) 7)
+
+/*
+ * header of a cache entry, followed by build IDs of the image and all providers,
+ * each prefixed with its size in uint32_t, then bindings
+ */
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint32_t nproviders;
+    uint32_t ids_size;  // size of all build IDs with their prefixes
+    uint64_t count;  // number of bindings
+} __entry_header;
+
+#ifndef _WIN32
+/*
+ * serialize build IDs of ei and providers as stored after the header
+ *
+ * returns a buffer the caller should free, NULL if any of them has no build ID
+ */
+static char *__serialize_ids(const tmixelf_info *ei, const tmixdynld_internal_provider *providers,
+                             size_t nproviders, size_t *size) {
+    size_t i;
+
+    *size = sizeof(uint32_t) + ei->build_id.size;
+
+    for (i = 0; i < nproviders; i++) {
+        if (!providers[i].build_id.size)
+            return NULL;
+
+        *size += sizeof(uint32_t) + providers[i].build_id.size;
+    }
+
+    char *buff = malloc(*size);
+
+    if (!buff)
+        return NULL;
+
+    char *p = buff;
+
+    for (i = 0; i <= nproviders; i++) {
+        const tmix_array *id = i ? &providers[i - 1].build_id : &ei->build_id;
+        uint32_t id_size = id->size;
+
+        memcpy(p, &id_size, sizeof(id_size));
+        memcpy(p + sizeof(id_size), id->data, id->size);
+        p += sizeof(id_size) + id->size;
+    }
+
+    return buff;
+}
+
+/*
+ * returns the path of the entry of ei, the caller should free it, NULL if ei has no build ID
+ */
+static char *__entry_path(const char *cache_dir, const tmixelf_info *ei) {
+    if (!cache_dir || !ei->build_id.size)
+        return NULL;
+
+    const unsigned char *id = ei->build_id.data;
+    char name[2 * 64 + sizeof(".rc")];
+    size_t i;
+
+    if (ei->build_id.size > 64)
+        return NULL;  // too long to be a real one
+
+    for (i = 0; i < ei->build_id.size; i++)
+        sprintf(&name[2 * i], "%02x", id[i]);
+
+    strcpy(&name[2 * i], ".rc");
+
+    return _tmix_join_path(cache_dir, name);
+}
+#endif /* !_WIN32 */
+
+int _tmixdynld_internal_apply_cached(const char *cache_dir, void *base, const tmixelf_info *ei,
+                                     const tmixdynld_internal_provider *providers, size_t nproviders) {
+#ifdef _WIN32
+    // TODO: support caching on Windows
+    (void) cache_dir;
+    (void) base;
+    (void) ei;
+    (void) providers;
+    (void) nproviders;
+
+    return -1;
+#else
+    char *path = __entry_path(cache_dir, ei);
+
+    if (!path)
+        return -1;
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    free(path);
+
+    if (fd < 0)
+        return -1;
+
+    struct stat st;
+    char *map = MAP_FAILED;
+    char *ids = NULL;
+    size_t ids_size;
+    int ret = -1;
+
+    if (fstat(fd, &st) < 0 || (size_t) st.st_size < sizeof(__entry_header))
+        goto exit;
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    _tmix_prof_count(TMIX_PROF_MMAPS, 1);
+
+    if (map == MAP_FAILED)
+        goto exit;
+
+    // an entry only matches if the image and all providers have the same build IDs
+
+    const __entry_header *hdr = (const __entry_header *) map;
+
+    if (memcmp(hdr->magic, _ENTRY_MAGIC, sizeof(_ENTRY_MAGIC))
+        || hdr->version != _ENTRY_VERSION
+        || hdr->layout != _ENTRY_LAYOUT
+        || hdr->nproviders != nproviders
+        || hdr->count != ei->relocs.size)
+        goto exit;
+
+    if (!(ids = __serialize_ids(ei, providers, nproviders, &ids_size)))
+        goto exit;
+
+    size_t bindings_off = _ALIGN_UP(sizeof(*hdr) + ids_size);
+
+    if (hdr->ids_size != ids_size
+        || (size_t) st.st_size != bindings_off + hdr->count * sizeof(tmixdynld_internal_binding)
+        || memcmp(&map[sizeof(*hdr)], ids, ids_size))
+        goto exit;
+
+    // check every binding before touching the image
+
+    const tmixdynld_internal_binding *bindings = (const tmixdynld_internal_binding *) &map[bindings_off];
+    const tmixelf_reloc *relocs = ei->relocs.data;  // array
+    size_t i;
+
+    for (i = 0; i < hdr->count; i++) {
+        if (bindings[i].off != relocs[i].off
+            || (bindings[i].provider >= nproviders && bindings[i].provider != TMIXDYNLD_INTERNAL_NO_PROVIDER
+                && bindings[i].provider != TMIXDYNLD_INTERNAL_NOT_CACHED)
+            || ei->mem_size < sizeof(uintptr_t)
+            || bindings[i].off > ei->mem_size - sizeof(uintptr_t))
+            goto exit;
+    }
+
+    for (i = 0; i < hdr->count; i++) {
+        if (bindings[i].provider == TMIXDYNLD_INTERNAL_NOT_CACHED)
+            continue;
+
+        uintptr_t provider_base = bindings[i].provider == TMIXDYNLD_INTERNAL_NO_PROVIDER
+                                  ? 0 : providers[bindings[i].provider].base;
+
+        *(uintptr_t *) ((char *) base + bindings[i].off) = provider_base + bindings[i].sym_off;
+    }
+
+    ret = 0;
+
+exit:
+    free(ids);
+
+    if (map != MAP_FAILED)
+        munmap(map, st.st_size);
+
+    close(fd);
+
+    return ret;
+#endif
+}
+
+int _tmixdynld_internal_save_cached(const char *cache_dir, const tmixelf_info *ei,
+                                    const tmixdynld_internal_provider *providers, size_t nproviders,
+                                    const tmixdynld_internal_binding *bindings, size_t count) {
+#ifdef _WIN32
+    // TODO: support caching on Windows
+    (void) cache_dir;
+    (void) ei;
+    (void) providers;
+    (void) nproviders;
+    (void) bindings;
+    (void) count;
+
+    errno = ENOSYS;
+    return -1;
+#else
+    char *path = __entry_path(cache_dir, ei);
+
+    if (!path) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    size_t ids_size;
+    char *ids = __serialize_ids(ei, providers, nproviders, &ids_size);
+    char *buff = NULL;
+    char *tmp_path = NULL;
+    int fd = -1;
+
+    if (!ids) {
+        errno = EINVAL;
+        goto error;
+    }
+
+    __entry_header hdr = {
+        .magic = _ENTRY_MAGIC,
+        .version = _ENTRY_VERSION,
+        .layout = _ENTRY_LAYOUT,
+        .nproviders = nproviders,
+        .ids_size = ids_size,
+        .count = count,
+    };
+
+    size_t bindings_off = _ALIGN_UP(sizeof(hdr) + ids_size);
+    size_t total_size = bindings_off + count * sizeof(tmixdynld_internal_binding);
+
+    if (!(buff = calloc(1, total_size)))
+        goto error;
+
+    memcpy(buff, &hdr, sizeof(hdr));
+    memcpy(&buff[sizeof(hdr)], ids, ids_size);
+    memcpy(&buff[bindings_off], bindings, count * sizeof(tmixdynld_internal_binding));
+
+    // write to a temporary file, then replace the old entry at once,
+    // so readers never see a partial entry
+
+    if (!(tmp_path = malloc(strlen(path) + sizeof(".XXXXXX"))))
+        goto error;
+
+    sprintf(tmp_path, "%s.XXXXXX", path);
+
+    if ((fd = mkstemp(tmp_path)) < 0)
+        goto error;
+
+    size_t off;
+
+    for (off = 0; off < total_size;) {
+        ssize_t nwritten = write(fd, &buff[off], total_size - off);
+
+        if (nwritten < 0) {
+            if (errno == EINTR)
+                continue;
+
+            goto error_unlink;
+        }
+
+        off += nwritten;
+    }
+
+    int res = close(fd);
+
+    fd = -1;
+
+    if (res < 0 || rename(tmp_path, path) < 0)
+        goto error_unlink;
+
+    free(tmp_path);
+    free(buff);
+    free(ids);
+    free(path);
+
+    return 0;
+
+error_unlink:
+    if (!(fd < 0))
+        close(fd);
+
+    unlink(tmp_path);
+error:
+    free(tmp_path);
+    free(buff);
+    free(ids);
+    free(path);
+
+    return -1;
+#endif
+}
@@ -0,0 +1,342 @@
+/*
+  server.c - Fork server of the ELF loader
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <signal.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/un.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+#include "_server.h"
+
+#ifndef _WIN32
+extern char **environ;
+
+/*
+ * returns 0 if all size bytes are read, otherwise -1 and sets errno
+ */
+static int __read_full(int fd, void *buff, size_t size) {
+    while (size) {
+        ssize_t ret = read(fd, buff, size);
+
+        if (ret < 0 && errno == EINTR)
+            continue;
+
+        if (ret <= 0) {
+            if (!ret)
+                errno = EPIPE;
+
+            return -1;
+        }
+
+        buff = (char *) buff + ret;
+        size -= ret;
+    }
+
+    return 0;
+}
+
+/*
+ * fds - output, stdin, stdout and stderr of the client
+ * cwd - output, working directory of the client, in the same buffer as all strings
+ * argv, envp - output, arguments and environment, both in a buffer at argv and end with NULL
+ *
+ * returns flags of the request if succeed, otherwise -1 and sets errno
+ */
+static int64_t __recv_request(int conn, int fds[3], char **cwd, char ***argv, char ***envp) {
+    tmixldr_internal_request req;
+    union {
+        char buff[CMSG_SPACE(3 * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct iovec iov = { .iov_base = &req, .iov_len = sizeof(req) };
+    struct msghdr msg = {
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = control.buff,
+        .msg_controllen = sizeof(control.buff),
+    };
+    ssize_t ret;
+
+    while ((ret = recvmsg(conn, &msg, 0)) < 0 && errno == EINTR);
+
+    if (ret <= 0) {
+        if (!ret)
+            errno = EPIPE;
+
+        return -1;
+    }
+
+    // descriptors come with the first byte, the rest of the header might not
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+
+    if (!cmsg || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(3 * sizeof(int)) || (msg.msg_flags & MSG_CTRUNC)) {
+        errno = EPROTO;
+        return -1;
+    }
+
+    memcpy(fds, CMSG_DATA(cmsg), 3 * sizeof(int));
+
+    if (__read_full(conn, (char *) &req + ret, sizeof(req) - ret) < 0)
+        goto error;
+
+    // every string takes a byte at least, which also bounds the counts
+
+    if (req.magic != TMIXLDR_INTERNAL_REQUEST_MAGIC || !req.size || req.size > TMIXLDR_INTERNAL_REQUEST_MAX_SIZE
+        || !req.argc || (uint64_t) req.argc + req.envc >= req.size) {
+        errno = EPROTO;
+        goto error;
+    }
+
+    char *payload = malloc(req.size);
+    char **strs = malloc((req.argc + req.envc + 2) * sizeof(char *));  // both end with NULL
+
+    if (!payload || !strs)
+        goto error_free;
+
+    if (__read_full(conn, payload, req.size) < 0)
+        goto error_free;
+
+    // all strings must end within the payload, and fill it exactly
+
+    size_t off = strnlen(payload, req.size) + 1;
+    size_t i, j = 0;
+
+    for (i = 0; i < req.argc + req.envc; i++) {
+        if (off >= req.size)
+            goto error_proto;
+
+        if (i == req.argc)
+            strs[j++] = NULL;
+
+        strs[j++] = payload + off;
+        off += strnlen(payload + off, req.size - off) + 1;
+    }
+
+    if (off != req.size || payload[req.size - 1])
+        goto error_proto;
+
+    if (!req.envc)
+        strs[j++] = NULL;
+
+    strs[j] = NULL;
+
+    *cwd = payload;
+    *argv = strs;
+    *envp = &strs[req.argc + 1];
+
+    return req.flags;
+
+error_proto:
+    errno = EPROTO;
+error_free:
+    free(strs);
+    free(payload);
+
+error:
+    close(fds[0]);
+    close(fds[1]);
+    close(fds[2]);
+
+    return -1;
+}
+
+/*
+ * serve the request on conn in a forked process, never returns
+ */
+__attribute__((noreturn)) static void __session(int conn, void (*run)(char *const *argv, char *const *envp,
+                                                                      bool debug)) {
+    int fds[3];
+    char *cwd, **argv, **envp;
+    int64_t flags = __recv_request(conn, fds, &cwd, &argv, &envp);
+
+    if (flags < 0) {
+        perror("error receiving request");
+        _exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+
+    if (!pid) {
+        close(conn);
+
+        // descriptors received are never below 3, since ours are still open
+
+        int i;
+
+        for (i = 0; i < 3; i++) {
+            if (dup2(fds[i], i) < 0)
+                _exit(EXIT_FAILURE);
+
+            close(fds[i]);
+        }
+
+        if (chdir(cwd) < 0) {
+            perror("error changing directory");
+            _exit(EXIT_FAILURE);
+        }
+
+        // libraries of the host look the environment up as well
+        environ = envp;
+
+        run(argv, envp, flags & TMIXLDR_INTERNAL_REQUEST_DEBUG);
+
+        _exit(EXIT_FAILURE);
+    }
+
+    close(fds[0]);
+    close(fds[1]);
+    close(fds[2]);
+
+    // exit status is reported as a shell does
+
+    int32_t code = EXIT_FAILURE;
+    int status;
+
+    if (pid < 0)
+        perror("error forking program");
+    else {
+        while (waitpid(pid, &status, 0) < 0) {
+            if (errno != EINTR) {
+                perror("error waiting for program");
+                status = -1;
+                break;
+            }
+        }
+
+        if (status != -1 && WIFEXITED(status))
+            code = WEXITSTATUS(status);
+        else if (status != -1 && WIFSIGNALED(status))
+            code = 128 + WTERMSIG(status);
+    }
+
+    // the client might be gone, nothing to do about it
+    while (write(conn, &code, sizeof(code)) < 0 && errno == EINTR);
+
+    _exit(EXIT_SUCCESS);
+}
+
+/*
+ * returns the listening socket at sock_path if succeed, otherwise -1 and sets errno
+ */
+static int __listen(const char *sock_path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(sock_path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    strcpy(addr.sun_path, sock_path);
+
+    // a socket left by a dead server is replaced, other files are never touched
+
+    struct stat st;
+
+    if (!lstat(sock_path, &st) && S_ISSOCK(st.st_mode))
+        unlink(sock_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0)
+        return -1;
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    // only the owner can connect, since programs run as the server
+    mode_t mask = umask(077);
+    int ret = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+
+    umask(mask);
+
+    if (ret < 0 || listen(fd, SOMAXCONN) < 0) {
+        int saved_errno = errno;
+
+        close(fd);
+        errno = saved_errno;
+
+        return -1;
+    }
+
+    return fd;
+}
+#endif /* _WIN32 */
+
+int _tmixldr_internal_serve(const char *sock_path, void (*run)(char *const *argv, char *const *envp, bool debug)) {
+#ifdef _WIN32
+    (void) sock_path;
+    (void) run;
+
+    errno = ENOTSUP;
+    return -1;
+#else
+    int fd = __listen(sock_path);
+
+    if (fd < 0)
+        return -1;
+
+    // sessions are reaped automatically, they wait for their own programs instead
+    signal(SIGCHLD, SIG_IGN);
+
+    for (;;) {
+        int conn = accept(fd, NULL, NULL);
+
+        if (conn < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            int saved_errno = errno;
+
+            close(fd);
+            errno = saved_errno;
+
+            return -1;
+        }
+
+        // nothing buffered is written twice by children
+        fflush(NULL);
+
+        pid_t pid = fork();
+
+        if (!pid) {
+            close(fd);
+            signal(SIGCHLD, SIG_DFL);
+
+            __session(conn, run);
+        }
+
+        if (pid < 0)
+            perror("error forking session");
+
+        close(conn);
+    }
+#endif
+}
@@ -0,0 +1,159 @@
+/*
+  symmap.c - Map of resolved symbols
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../inc/arena.h"
+
+#include "_symmap.h"
+
+#define _INITIAL_CAPACITY         (256)
+
+/*
+ * open addressing with linear probing, slots with a NULL name are empty
+ */
+typedef struct {
+    const char *name;  // copy in __names
+    uint32_t hash;
+    void *addr;  // NULL if missing
+    unsigned scope;  // generation of the global scope a miss was seen in, only valid in the same one
+} __slot;
+
+// never released, lazily bound symbols might be looked up until the process exits
+
+static __slot *__slots = NULL;
+static size_t __capacity = 0;  // power of two
+static size_t __count = 0;
+static tmix_arena __names = {};
+static unsigned __scope = 0;  // bumped whenever a library joins the global scope
+static pthread_mutex_t __lock = PTHREAD_MUTEX_INITIALIZER;  // contended only by guest threads binding lazily
+static size_t __hits = 0;
+static size_t __misses = 0;
+
+/*
+ * returns the slot of name, or the empty one it should be put in
+ */
+static __slot *__find(__slot *slots, size_t capacity, uint32_t hash, const char *name) {
+    size_t i = hash & (capacity - 1);
+
+    for (;; i = (i + 1) & (capacity - 1)) {
+        __slot *slot = &slots[i];
+
+        if (!slot->name || (slot->hash == hash && !strcmp(slot->name, name)))
+            return slot;
+    }
+}
+
+/*
+ * double the capacity, rehashing all slots
+ *
+ * returns 0 if succeed, otherwise -1 and sets errno
+ */
+static int __grow(void) {
+    size_t capacity = __capacity ? 2 * __capacity : _INITIAL_CAPACITY;
+    __slot *slots = calloc(capacity, sizeof(__slot));
+    size_t i;
+
+    if (!slots)
+        return -1;
+
+    for (i = 0; i < __capacity; i++) {
+        if (__slots[i].name)
+            *__find(slots, capacity, __slots[i].hash, __slots[i].name) = __slots[i];
+    }
+
+    free(__slots);
+    __slots = slots;
+    __capacity = capacity;
+
+    return 0;
+}
+
+bool _tmixdynld_internal_symmap_get(uint32_t hash, const char *name, void **addr) {
+    pthread_mutex_lock(&__lock);
+
+    __slot *slot = __capacity ? __find(__slots, __capacity, hash, name) : NULL;
+
+    // libraries only join after the ones defining found symbols, but might define missing ones
+    bool found = slot && slot->name && (slot->addr || slot->scope == __scope);
+
+    if (found) {
+        *addr = slot->addr;
+        __hits++;
+    } else
+        __misses++;
+
+    pthread_mutex_unlock(&__lock);
+
+    return found;
+}
+
+int _tmixdynld_internal_symmap_put(uint32_t hash, const char *name, void *addr) {
+    int ret = -1;
+
+    pthread_mutex_lock(&__lock);
+
+    // keep the load factor below 3/4, so probes stay short
+
+    if (4 * (__count + 1) > 3 * __capacity && __grow() < 0)
+        goto exit;
+
+    __slot *slot = __find(__slots, __capacity, hash, name);
+
+    if (!slot->name) {
+        size_t size = strlen(name) + 1;
+        char *copy = _tmix_arena_alloc(&__names, size);
+
+        if (!copy)
+            goto exit;
+
+        memcpy(copy, name, size);
+        slot->name = copy;
+        slot->hash = hash;
+        __count++;
+    }
+
+    slot->addr = addr;
+    slot->scope = __scope;
+    ret = 0;
+
+exit:
+    pthread_mutex_unlock(&__lock);
+
+    return ret;
+}
+
+void _tmixdynld_internal_symmap_scope_grown(void) {
+    pthread_mutex_lock(&__lock);
+    __scope++;
+    pthread_mutex_unlock(&__lock);
+}
+
+void _tmixdynld_internal_symmap_stats(size_t *hits, size_t *misses) {
+    pthread_mutex_lock(&__lock);
+
+    *hits = __hits;
+    *misses = __misses;
+
+    pthread_mutex_unlock(&__lock);
+}
@@ -0,0 +1,385 @@
+/*
+  tls.c - Static thread-local storage of loaded images
+
+  This program is free software; you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation; either version 2 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "../inc/abi.h"
+
+#include "elf/elf.h"
+
+#include "_tls.h"
+#include "dynld.h"
+
+#ifdef TMIXDYNLD_TLS_SUPPORTED
+#  include <pthread.h>
+#endif
+
+/*
+ * the reservation is the TLS block of the executable, which the host places at a fixed offset from
+ * the thread pointer of every thread, so blocks carved from it are too, and any TLS access model works
+ * with no DTV, the layout of the executable is kept: the block of the program goes where it would be
+ * in a new process, libraries take the rest from the other end
+ *
+ * below the thread pointer on x86 (variant II), after a TCB of two words elsewhere (variant I)
+ *
+ * offsets are from the thread pointer, only written while loading, which is single-threaded
+ */
+static ssize_t __res_start = 0;
+static ssize_t __res_end = 0;  // equal to __res_start if nothing is reserved
+static ssize_t __lib_cursor = 0;  // end of the blocks of libraries on x86, their start elsewhere
+static ssize_t __prog_start = 0;
+static ssize_t __prog_end = 0;  // equal to __prog_start if the program has no block
+static bool __prog_placed = false;
+
+// initial contents of the reservation, copied in each new thread, only between __used_start and __used_end
+static char *__template = NULL;
+static ssize_t __used_start = 0;
+static ssize_t __used_end = 0;
+
+#ifdef TMIXDYNLD_TLS_SUPPORTED
+
+#ifdef __ELF__
+#  define _ASM_FUNC_BEGIN(_name)  ".globl " _name "\n.hidden " _name "\n.type " _name ", %function\n" _name ":\n"
+#  define _ASM_FUNC_END(_name)    ".size " _name ", .-" _name "\n"
+#else
+#  define _ASM_FUNC_BEGIN(_name)  ".globl " _name "\n" _name ":\n"
+#  define _ASM_FUNC_END(_name)    ""
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#  define _TLS_BELOW_TP
+#endif
+
+// 32-bit Arm has no TLS descriptors in its ABI
+#ifndef __arm__
+#  define _TLSDESC_SUPPORTED
+#endif
+
+/*
+ * argument of __tls_get_addr, the module is the offset of its block from the thread pointer,
+ * which DTPMOD relocations are bound to instead of an index into a DTV
+ */
+typedef struct {
+    uintptr_t module;
+    uintptr_t off;
+} __tls_index;
+
+/*
+ * start routine of a guest thread
+ */
+typedef struct {
+    void *(*routine)(void *);
+    void *arg;
+} __thread_start;
+
+#ifdef _TLSDESC_SUPPORTED
+void __tlsdesc_static(void) __asm__("tmixdynld_internal_tlsdesc_static");
+#endif
+
+/*
+ * the descriptor is passed in the return register and holds the offset in its second word,
+ * all other registers are preserved
+ */
+#if defined(__x86_64__)
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_tlsdesc_static")
+    ".byte 0xf3, 0x0f, 0x1e, 0xfa\n"  // endbr64
+    "movq 8(%rax), %rax\n"
+    "ret\n"
+    _ASM_FUNC_END("tmixdynld_internal_tlsdesc_static")
+);
+#elif defined(__i386__)
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_tlsdesc_static")
+    "movl 4(%eax), %eax\n"
+    "ret\n"
+    _ASM_FUNC_END("tmixdynld_internal_tlsdesc_static")
+);
+#elif defined(__aarch64__)
+__asm__(
+    ".text\n"
+    ".p2align 4\n"
+    _ASM_FUNC_BEGIN("tmixdynld_internal_tlsdesc_static")
+    "ldr x0, [x0, #8]\n"
+    "ret\n"
+    _ASM_FUNC_END("tmixdynld_internal_tlsdesc_static")
+);
+#endif
+
+static inline char *__thread_pointer(void) {
+    char *tp;
+
+#if defined(__x86_64__)
+    __asm__("movq %%fs:0, %0" : "=r" (tp));
+#elif defined(__i386__)
+    __asm__("movl %%gs:0, %0" : "=r" (tp));
+#elif defined(__aarch64__)
+    __asm__("mrs %0, tpidr_el0" : "=r" (tp));
+#else
+    __asm__("mrc p15, 0, %0, c13, c0, 3" : "=r" (tp));
+#endif
+
+    return tp;
+}
+
+/*
+ * copy initial contents of all blocks into the reservation of the calling thread
+ */
+static void __init_thread(void) {
+    if (__used_end > __used_start)
+        memcpy(__thread_pointer() + __used_start, &__template[__used_start - __res_start],
+               __used_end - __used_start);
+}
+
+/*
+ * general and local dynamic accesses are a single addition, since blocks are never allocated lazily
+ */
+static void *__tmixabi __tls_get_addr_static(const __tls_index *ti) {
+    return __thread_pointer() + ti->module + ti->off;
+}
+
+#ifdef __i386__
+// the GNU variant takes its argument in a register
+static void *__attribute__((regparm(1))) ___tls_get_addr_static(const __tls_index *ti) {
+    return __thread_pointer() + ti->module + ti->off;
+}
+#endif
+
+static void *__start_thread(void *data) {
+    __thread_start start = *(__thread_start *) data;
+
+    free(data);
+    __init_thread();
+
+    return ((__tmixabi void *(*)(void *)) start.routine)(start.arg);
+}
+
+/*
+ * pthread_create of guests, new threads initialize their blocks before anything else
+ */
+static int __tmixabi __pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                                      void *(*routine)(void *), void *arg) {
+    __thread_start *start = malloc(sizeof(__thread_start));
+
+    if (!start)
+        return EAGAIN;
+
+    start->routine = routine;
+    start->arg = arg;
+
+    int ret = pthread_create(thread, attr, __start_thread, start);
+
+    if (ret)
+        free(start);
+
+    return ret;
+}
+
+static struct {
+    const char *name;
+    void *addr;
+    uint32_t hash;  // computed by the constructor below
+} __builtins[] = {
+    { "__tls_get_addr", (void *) __tls_get_addr_static, 0 },
+#ifdef __i386__
+    { "___tls_get_addr", (void *) ___tls_get_addr_static, 0 },
+#endif
+    { "pthread_create", (void *) __pthread_create, 0 },
+};
+
+__attribute__((constructor)) static void __init_builtins(void) {
+    size_t i;
+
+    for (i = 0; i < sizeof(__builtins) / sizeof(__builtins[0]); i++)
+        __builtins[i].hash = tmixelf_gnu_hash(__builtins[i].name);
+}
+
+#endif /* TMIXDYNLD_TLS_SUPPORTED */
+
+int tmixdynld_set_static_tls(void *block, size_t size) {
+#ifdef TMIXDYNLD_TLS_SUPPORTED
+    if (__res_end != __res_start) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    // the block must be the whole TLS of the executable, or offsets differ in other threads
+
+    ssize_t start = (char *) block - __thread_pointer();
+
+#ifdef _TLS_BELOW_TP
+    if (start + (ssize_t) size != 0) {
+#else
+    if (start != (ssize_t) (2 * sizeof(void *))) {
+#endif
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (!(__template = calloc(1, size)))
+        return -1;
+
+    __res_start = start;
+    __res_end = start + size;
+#ifdef _TLS_BELOW_TP
+    __lib_cursor = __res_start;
+#else
+    __lib_cursor = __res_end;
+#endif
+
+    return 0;
+#else
+    (void) block;
+    (void) size;
+
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+int _tmixdynld_internal_alloc_tls(void *base, const tmixelf_info *ei, bool program, ssize_t *tls_off) {
+#ifdef TMIXDYNLD_TLS_SUPPORTED
+    size_t size = ei->tls.size;
+    size_t align = ei->tls.align;  // a power of two
+    ssize_t start;
+
+    // blocks are aligned by their offsets, which only holds up to the alignment of the thread pointer
+    if (__res_end == __res_start || align > TMIXDYNLD_STATIC_TLS_ALIGN) {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    if (size > (size_t) (__res_end - __res_start)) {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    if (program) {
+        if (__prog_placed) {
+            errno = EBUSY;
+            return -1;
+        }
+
+#ifdef _TLS_BELOW_TP
+        start = -(ssize_t) ((size + align - 1) & ~(align - 1));
+
+        if (start < __lib_cursor) {
+#else
+        start = (__res_start + align - 1) & ~(ssize_t) (align - 1);
+
+        if (start + (ssize_t) size > __lib_cursor) {
+#endif
+            errno = ENOMEM;
+            return -1;
+        }
+
+        __prog_start = start;
+        __prog_end = start + size;
+        __prog_placed = true;
+    } else {
+        // the slot of the program is left free until it is placed
+
+#ifdef _TLS_BELOW_TP
+        start = (__lib_cursor + align - 1) & ~(ssize_t) (align - 1);
+
+        if (start + (ssize_t) size > (__prog_placed ? __prog_start : __res_end)) {
+#else
+        start = (__lib_cursor - (ssize_t) size) & ~(ssize_t) (align - 1);
+
+        if (start < (__prog_placed ? __prog_end : __res_start)) {
+#endif
+            errno = ENOMEM;
+            return -1;
+        }
+
+#ifdef _TLS_BELOW_TP
+        __lib_cursor = start + size;
+#else
+        __lib_cursor = start;
+#endif
+    }
+
+    // .tbss is zero in the template as well as in the reservation of every thread
+
+    char *init = &__template[start - __res_start];
+
+    memcpy(init, (char *) base + ei->tls.init.off, ei->tls.init.size);
+    memcpy(__thread_pointer() + start, init, size);
+
+    if (__used_end == __used_start) {
+        __used_start = start;
+        __used_end = start + size;
+    } else {
+        if (start < __used_start)
+            __used_start = start;
+
+        if (start + (ssize_t) size > __used_end)
+            __used_end = start + size;
+    }
+
+    *tls_off = start;
+
+    return 0;
+#else
+    (void) base;
+    (void) ei;
+    (void) program;
+    (void) tls_off;
+
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+void *_tmixdynld_internal_tlsdesc_static(void) {
+#if defined(TMIXDYNLD_TLS_SUPPORTED) && defined(_TLSDESC_SUPPORTED)
+    return (void *) __tlsdesc_static;
+#else
+    return NULL;
+#endif
+}
+
+void *_tmixdynld_internal_tls_builtin(const char *name, uint32_t hash) {
+#ifdef TMIXDYNLD_TLS_SUPPORTED
+    size_t i;
+
+    for (i = 0; i < sizeof(__builtins) / sizeof(__builtins[0]); i++) {
+        if (__builtins[i].hash != hash || strcmp(__builtins[i].name, name))
+            continue;
+
+        // threads only need to be intercepted once some blocks are in use
+        if (__builtins[i].addr == (void *) __pthread_create && __used_end == __used_start)
+            return NULL;
+
+        return __builtins[i].addr;
+    }
+#else
+    (void) name;
+    (void) hash;
+#endif
+
+    return NULL;
+}
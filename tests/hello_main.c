@@ -1,5 +1,9 @@
 #include "lib/hello.h"
 
+// entered as a new process, the stack is aligned at argc rather than at a return address
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((force_align_arg_pointer))
+#endif
 void _start() {
     _foo();  // noreturn
 }
@@ -0,0 +1,9 @@
+#include "tls.h"
+
+__tmixtlstest_api __thread int tmixtest_tls_counter = 7;
+
+static __thread int __calls;  // zero-filled, local to the library
+
+int tmixtest_tls_get(void) {
+    return tmixtest_tls_counter + 1000 * __calls++;
+}
@@ -0,0 +1,23 @@
+#ifndef TERMIX_TESTS_LIB_TLS
+#define TERMIX_TESTS_LIB_TLS
+
+#include "../../inc/abi.h"
+
+#ifdef TMIX_BUILDING_TLSTEST_SHLIB
+#  define __tmixtlstest_api     __tmixapi_export
+#else
+#  define __tmixtlstest_api     __tmixapi_import
+#endif
+
+// thread-local variables of a library loaded by us, every thread starts with the initial values
+
+extern __tmixtlstest_api __thread int tmixtest_tls_counter;  // 7 initially
+
+// returns tmixtest_tls_counter, plus 1000 for each earlier call in the same thread,
+// accessed through __tls_get_addr (general and local dynamic)
+__tmixtlstest_api int tmixtest_tls_get(void);
+
+// returns a variable starting at 1234, then increments it, accessed through TLS descriptors if supported
+__tmixtlstest_api long tmixtest_tls_desc_get(void);
+
+#endif /* TERMIX_TESTS_LIB_TLS */
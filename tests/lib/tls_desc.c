@@ -0,0 +1,8 @@
+#include "tls.h"
+
+// compiled with TLS descriptors where the compiler does not default to them
+static __thread long __desc = 1234;
+
+long tmixtest_tls_desc_get(void) {
+    return __desc++;
+}
@@ -0,0 +1,243 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../ldr/elf/elf.h"
+
+#define _NTHREADS                 (8)
+#define _NROUNDS                  (50)  // parses in each thread
+#define _FD_OFFSET                (123)  // set before parsing, must be left as is
+
+static int __fd = -1;
+static tmixelf_info __ref = {};  // parsed in a single thread
+static pthread_barrier_t __barrier;
+
+/*
+ * returns whether both arrays hold the same bytes, elements being size bytes each without paddings
+ */
+static bool __same_array(const tmix_array *a, const tmix_array *b, size_t size) {
+    return a->size == b->size && (!a->size || !memcmp(a->data, b->data, a->size * size));
+}
+
+/*
+ * returns whether both arrays of segments are the same, compared by field since they have paddings
+ */
+static bool __same_segs(const tmix_array *a, const tmix_array *b) {
+    const tmixelf_seg *x = a->data, *y = b->data;  // arrays
+    size_t i;
+
+    if (a->size != b->size)
+        return false;
+
+    for (i = 0; i < a->size; i++) {
+        if (x[i].off != y[i].off || memcmp(&x[i].file, &y[i].file, sizeof(tmix_chunk))
+            || memcmp(&x[i].pad, &y[i].pad, sizeof(tmix_chunk)) || x[i].flags != y[i].flags)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * returns whether both arrays of relocations are the same, compared by field since they have paddings
+ */
+static bool __same_relocs(const tmix_array *a, const tmix_array *b) {
+    const tmixelf_reloc *x = a->data, *y = b->data;  // arrays
+    size_t i;
+
+    if (a->size != b->size)
+        return false;
+
+    for (i = 0; i < a->size; i++) {
+        if (x[i].symidx != y[i].symidx || x[i].off != y[i].off || x[i].idx != y[i].idx
+            || x[i].type != y[i].type || x[i].addend != y[i].addend)
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * returns whether both strings are the same, or both NULL
+ */
+static bool __same_str(const char *a, const char *b) {
+    return a == b || (a && b && !strcmp(a, b));
+}
+
+/*
+ * returns whether ei holds the same as __ref, names are compared by content,
+ * since each parse has its own copy when the file is read
+ */
+static bool __same_info(const tmixelf_info *ei) {
+    const tmixelf_info *ref = &__ref;
+    size_t i;
+
+    if (ei->entry != ref->entry || memcmp(&ei->phdrs, &ref->phdrs, sizeof(ei->phdrs))
+        || ei->mem_size != ref->mem_size || ei->align != ref->align || ei->execstack != ref->execstack
+        || memcmp(&ei->tls, &ref->tls, sizeof(ei->tls)) || ei->implicit_addends != ref->implicit_addends
+        || ei->pltgot != ref->pltgot || !__same_str(ei->soname, ref->soname) || ei->init != ref->init
+        || memcmp(&ei->init_array, &ref->init_array, sizeof(ei->init_array)) || ei->bind_now != ref->bind_now
+        || ei->build_id_off != ref->build_id_off || ei->map.size != ref->map.size)
+        return false;
+
+    if (!__same_segs(&ei->segs, &ref->segs)
+        || !__same_array(&ei->relros, &ref->relros, sizeof(tmix_chunk))
+        || !__same_relocs(&ei->relocs, &ref->relocs)
+        || !__same_array(&ei->relatives, &ref->relatives, sizeof(tmixelf_relative))
+        || !__same_array(&ei->relr, &ref->relr, sizeof(size_t))
+        || !__same_array(&ei->build_id, &ref->build_id, 1)
+        || ei->syms.size != ref->syms.size || ei->needs.size != ref->needs.size)
+        return false;
+
+    const tmixelf_sym *syms = ei->syms.data, *ref_syms = ref->syms.data;  // arrays
+
+    for (i = 0; i < ei->syms.size; i++) {
+        if (!__same_str(syms[i].name, ref_syms[i].name) || syms[i].type != ref_syms[i].type
+            || syms[i].imported != ref_syms[i].imported || syms[i].weak != ref_syms[i].weak
+            || syms[i].off != ref_syms[i].off || syms[i].hash != ref_syms[i].hash)
+            return false;
+    }
+
+    const char **needs = ei->needs.data, **ref_needs = ref->needs.data;  // arrays
+
+    for (i = 0; i < ei->needs.size; i++) {
+        if (!__same_str(needs[i], ref_needs[i]))
+            return false;
+    }
+
+    const tmixelf_hashtab *ht = &ei->hashtab, *ref_ht = &ref->hashtab;
+
+    if (ht->nbuckets != ref_ht->nbuckets || ht->symoffset != ref_ht->symoffset
+        || ht->bloom_size != ref_ht->bloom_size || ht->bloom_shift != ref_ht->bloom_shift)
+        return false;
+
+    // chains are only compared as far as the symbols go, which covers all of them
+    size_t nchain = ei->syms.size > ht->symoffset ? ei->syms.size - ht->symoffset : 0;
+
+    return !ht->nbuckets
+           || (!memcmp(ht->bloom, ref_ht->bloom, ht->bloom_size * sizeof(size_t))
+               && !memcmp(ht->buckets, ref_ht->buckets, ht->nbuckets * sizeof(uint32_t))
+               && !memcmp(ht->chain, ref_ht->chain, nchain * sizeof(uint32_t)));
+}
+
+static void *__thread_main(void *arg) {
+    (void) arg;
+
+    intptr_t failed = 0;
+    int i;
+
+    // all threads start parsing at once
+    pthread_barrier_wait(&__barrier);
+
+    for (i = 0; i < _NROUNDS; i++) {
+        tmixelf_info ei = {};
+
+        if (tmixelf_parse_info(__fd, &ei) < 0) {
+            perror("error parsing in a thread");
+            failed++;
+            continue;
+        }
+
+        if (!__same_info(&ei))
+            failed++;
+
+        tmixelf_free_info(&ei);
+    }
+
+    return (void *) failed;
+}
+
+/*
+ * parse path from all threads, returns the number of failures
+ */
+static int __check(const char *path, bool mapped) {
+    pthread_t threads[_NTHREADS];
+    int failed = 0;
+    int i;
+
+    if ((__fd = open(path, O_RDONLY)) < 0) {
+        perror("error opening ELF");
+        return 1;
+    }
+
+    if (lseek(__fd, _FD_OFFSET, SEEK_SET) < 0 || tmixelf_parse_info(__fd, &__ref) < 0) {
+        perror("error parsing ELF");
+        close(__fd);
+        return 1;
+    }
+
+    // the fallback keeps nothing mapped
+    if (!__ref.map.size == mapped) {
+        printf("%s: expected the file to be %s\n", path, mapped ? "mapped" : "read");
+        failed++;
+    }
+
+    pthread_barrier_init(&__barrier, NULL, _NTHREADS);
+
+    for (i = 0; i < _NTHREADS; i++) {
+        if (pthread_create(&threads[i], NULL, __thread_main, NULL)) {
+            // the barrier would never open, nothing else to do
+            fprintf(stderr, "error creating thread\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    for (i = 0; i < _NTHREADS; i++) {
+        void *ret;
+
+        pthread_join(threads[i], &ret);
+        failed += (intptr_t) ret;
+    }
+
+    pthread_barrier_destroy(&__barrier);
+
+    if (lseek(__fd, 0, SEEK_CUR) != _FD_OFFSET) {
+        printf("%s: file offset moved\n", path);
+        failed++;
+    }
+
+    printf("%s: %s, %d of %d parses differ\n", path, mapped ? "mapped" : "read", failed, _NTHREADS * _NROUNDS);
+
+    tmixelf_free_info(&__ref);
+    close(__fd);
+
+    return failed;
+}
+
+/*
+ * parse each ELF given, or this program itself, from several threads at once, as mapped first,
+ * then again in a new image of this program which always reads
+ */
+int main(int argc, char **argv) {
+    static char *self_argv[] = {"/proc/self/exe", NULL};
+    char *const *paths = argc > 1 ? &argv[1] : self_argv;
+    const char *no_map = getenv("TMIXELF_NO_MAP");
+    bool mapped = !no_map || !*no_map;
+    int failed = 0;
+
+    for (; *paths; paths++)
+        failed += __check(*paths, mapped);
+
+    if (failed) {
+        printf("parse failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if (!mapped) {
+        printf("parse ok\n");
+        return EXIT_SUCCESS;
+    }
+
+    // the parser only looks at it once
+    setenv("TMIXELF_NO_MAP", "1", 1);
+    fflush(stdout);
+    execv("/proc/self/exe", argv);
+
+    perror("error running again without mapping");
+
+    return EXIT_FAILURE;
+}
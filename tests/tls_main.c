@@ -0,0 +1,70 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lib/tls.h"
+
+// initialized, zero-filled and aligned variables of the program itself, accessed as local exec
+static __thread int __counter = 42;
+static __thread long __zeroed;
+static __thread char __aligned[32] __attribute__((aligned(16))) = "termix";
+
+/*
+ * check every variable has its initial value in the calling thread, then change them all
+ *
+ * returns the number of mismatches
+ */
+static int __check(const char *who) {
+    int failed = 0;
+
+#define _EXPECT(_cond)  do { if (!(_cond)) { printf("%s: %s failed\n", who, #_cond); failed++; } } while (0)
+
+    _EXPECT(__counter == 42);
+    _EXPECT(__zeroed == 0);
+    _EXPECT(!strcmp(__aligned, "termix"));
+    _EXPECT((uintptr_t) __aligned % 16 == 0);
+    _EXPECT(tmixtest_tls_counter == 7);  // initial exec from the program
+    _EXPECT(tmixtest_tls_get() == 7);
+    _EXPECT(tmixtest_tls_desc_get() == 1234);
+
+#undef _EXPECT
+
+    __counter++;
+    __zeroed = -1;
+    strcpy(__aligned, "changed");
+    tmixtest_tls_counter = 100;
+
+    return failed;
+}
+
+static void *__thread_main(void *arg) {
+    (void) arg;
+
+    return (void *) (intptr_t) __check("thread");
+}
+
+// entered as a new process, the stack is aligned at argc rather than at a return address
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((force_align_arg_pointer))
+#endif
+void _start() {
+    int failed = __check("main");
+    pthread_t thread;
+    void *ret;
+
+    // a new thread starts from the initial values, not the ones changed above
+    if (pthread_create(&thread, NULL, __thread_main, NULL) || pthread_join(thread, &ret))
+        failed++;
+    else
+        failed += (intptr_t) ret;
+
+    // and never touches the ones of the main thread
+    if (__counter != 43 || tmixtest_tls_counter != 100 || tmixtest_tls_get() != 1100
+        || tmixtest_tls_desc_get() != 1235)
+        failed++;
+
+    printf(failed ? "TLS failed\n" : "TLS ok\n");
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}